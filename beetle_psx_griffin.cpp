@@ -9,6 +9,7 @@
 #include "mednafen/psx/spu.cpp"
 #include "mednafen/psx/gpu.cpp"
 #include "mednafen/psx/mdec.cpp"
+#include "mednafen/psx/profiler.cpp"
 #include "mednafen/psx/input/gamepad.cpp"
 #include "mednafen/psx/input/dualanalog.cpp"
 #include "mednafen/psx/input/dualshock.cpp"
@@ -24,6 +25,7 @@
 #include "mednafen/general.cpp"
 #include "mednafen/FileStream.cpp"
 #include "mednafen/MemoryStream.cpp"
+#include "mednafen/MappedFileStream.cpp"
 #include "mednafen/Stream.cpp"
 #include "mednafen/state.cpp"
 
@@ -17,6 +17,8 @@
 #include "mednafen/file.c"
 #include "mednafen/md5.c"
 #include "mednafen/mednafen-endian.c"
+#include "mednafen/state_async.c"
+#include "mednafen/largemem.c"
 
 #include "libretro_cbs.c"
 #include "libretro-common/streams/file_stream.c"
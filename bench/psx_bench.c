@@ -0,0 +1,486 @@
+/* Headless benchmark harness for the Beetle PSX libretro core.
+ *
+ * Loads the core shared object, boots a disc image or PS-EXE through
+ * retro_load_game() and runs a fixed number of frames through retro_run()
+ * with stub video/audio/input callbacks. Reports throughput, per-frame
+ * latency percentiles and FNV-1a hashes of the video and audio output so
+ * that both performance and bit-exactness can be compared between builds.
+ *
+ * Usage: mednafen_psx_bench [options] <content>
+ *   -c <core>     core shared object (default ./mednafen_psx_libretro.so)
+ *   -n <frames>   number of frames to run (default 3600)
+ *   -w <frames>   warm-up frames excluded from timing (default 0)
+ *   -b <dir>      system (BIOS) directory (default .)
+ *   -s <dir>      save directory (default: system directory)
+ *   -o key=value  override a core option, may be repeated
+ *   -q            only print the summary line
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <dlfcn.h>
+
+#include <libretro.h>
+
+#ifndef BENCH_DEFAULT_CORE
+#define BENCH_DEFAULT_CORE "./mednafen_psx_libretro.so"
+#endif
+
+#define BENCH_MAX_OPTIONS 256
+
+struct bench_option
+{
+   char *key;
+   char *value;
+};
+
+struct bench_core
+{
+   void *handle;
+   void (*retro_init)(void);
+   void (*retro_deinit)(void);
+   void (*retro_set_environment)(retro_environment_t);
+   void (*retro_set_video_refresh)(retro_video_refresh_t);
+   void (*retro_set_audio_sample)(retro_audio_sample_t);
+   void (*retro_set_audio_sample_batch)(retro_audio_sample_batch_t);
+   void (*retro_set_input_poll)(retro_input_poll_t);
+   void (*retro_set_input_state)(retro_input_state_t);
+   void (*retro_get_system_av_info)(struct retro_system_av_info *);
+   bool (*retro_load_game)(const struct retro_game_info *);
+   void (*retro_unload_game)(void);
+   void (*retro_run)(void);
+};
+
+static struct bench_option options[BENCH_MAX_OPTIONS];
+static unsigned num_options       = 0;
+static const char *system_dir     = ".";
+static const char *save_dir       = NULL;
+static enum retro_pixel_format pixel_format = RETRO_PIXEL_FORMAT_0RGB1555;
+static bool quiet                 = false;
+
+static uint64_t video_hash        = 14695981039346656037ULL;
+static uint64_t audio_hash        = 14695981039346656037ULL;
+static uint64_t video_frames_out  = 0;
+static uint64_t video_frames_dup  = 0;
+static uint64_t audio_samples_out = 0;
+
+static void fnv1a(uint64_t *hash, const void *data, size_t len)
+{
+   const uint8_t *p = (const uint8_t*)data;
+   uint64_t h       = *hash;
+
+   while (len--)
+   {
+      h ^= *p++;
+      h *= 1099511628211ULL;
+   }
+
+   *hash = h;
+}
+
+static uint64_t time_now_ns(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct bench_option *find_option(const char *key)
+{
+   unsigned i;
+
+   for (i = 0; i < num_options; i++)
+      if (!strcmp(options[i].key, key))
+         return &options[i];
+
+   return NULL;
+}
+
+static void set_option(const char *key, const char *value, bool overwrite)
+{
+   struct bench_option *opt = find_option(key);
+
+   if (opt)
+   {
+      if (overwrite)
+      {
+         free(opt->value);
+         opt->value = strdup(value);
+      }
+      return;
+   }
+
+   if (num_options >= BENCH_MAX_OPTIONS)
+      return;
+
+   options[num_options].key   = strdup(key);
+   options[num_options].value = strdup(value);
+   num_options++;
+}
+
+/* Legacy core option definitions look like "Description; default|other|...",
+ * the first value being the default one. */
+static void register_variables(const struct retro_variable *vars)
+{
+   for (; vars && vars->key; vars++)
+   {
+      char value[256];
+      const char *start = vars->value ? strchr(vars->value, ';') : NULL;
+      size_t len;
+
+      if (!start)
+         continue;
+
+      start++;
+      while (*start == ' ')
+         start++;
+
+      len = strcspn(start, "|");
+      if (len >= sizeof(value))
+         len = sizeof(value) - 1;
+
+      memcpy(value, start, len);
+      value[len] = '\0';
+
+      set_option(vars->key, value, false);
+   }
+}
+
+static void log_printf(enum retro_log_level level, const char *fmt, ...)
+{
+   va_list ap;
+
+   if (quiet || level < RETRO_LOG_WARN)
+      return;
+
+   va_start(ap, fmt);
+   vfprintf(stderr, fmt, ap);
+   va_end(ap);
+}
+
+static bool environment_cb(unsigned cmd, void *data)
+{
+   switch (cmd)
+   {
+      case RETRO_ENVIRONMENT_GET_LOG_INTERFACE:
+         ((struct retro_log_callback*)data)->log = log_printf;
+         return true;
+      case RETRO_ENVIRONMENT_GET_SYSTEM_DIRECTORY:
+         *(const char**)data = system_dir;
+         return true;
+      case RETRO_ENVIRONMENT_GET_SAVE_DIRECTORY:
+         *(const char**)data = save_dir ? save_dir : system_dir;
+         return true;
+      case RETRO_ENVIRONMENT_GET_CORE_OPTIONS_VERSION:
+         /* Force the legacy SET_VARIABLES path, it is the simplest one
+          * to extract default values from. */
+         *(unsigned*)data = 0;
+         return true;
+      case RETRO_ENVIRONMENT_SET_VARIABLES:
+         register_variables((const struct retro_variable*)data);
+         return true;
+      case RETRO_ENVIRONMENT_GET_VARIABLE:
+         {
+            struct retro_variable *var = (struct retro_variable*)data;
+            struct bench_option *opt   = find_option(var->key);
+
+            var->value = opt ? opt->value : NULL;
+            return opt != NULL;
+         }
+      case RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE:
+         *(bool*)data = false;
+         return true;
+      case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
+         pixel_format = *(const enum retro_pixel_format*)data;
+         return true;
+      case RETRO_ENVIRONMENT_GET_INPUT_BITMASKS:
+         return true;
+      case RETRO_ENVIRONMENT_SET_SYSTEM_AV_INFO:
+      case RETRO_ENVIRONMENT_SET_GEOMETRY:
+      case RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY:
+      case RETRO_ENVIRONMENT_SET_DISK_CONTROL_INTERFACE:
+      case RETRO_ENVIRONMENT_SET_DISK_CONTROL_EXT_INTERFACE:
+      case RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS:
+      case RETRO_ENVIRONMENT_SET_CONTROLLER_INFO:
+      case RETRO_ENVIRONMENT_SET_SERIALIZATION_QUIRKS:
+      case RETRO_ENVIRONMENT_SET_MESSAGE:
+      case RETRO_ENVIRONMENT_SET_MESSAGE_EXT:
+         return true;
+      default:
+         break;
+   }
+
+   return false;
+}
+
+static unsigned bytes_per_pixel(void)
+{
+   return pixel_format == RETRO_PIXEL_FORMAT_XRGB8888 ? 4 : 2;
+}
+
+static void video_cb(const void *data, unsigned width, unsigned height, size_t pitch)
+{
+   unsigned y;
+   size_t row_len = width * bytes_per_pixel();
+
+   video_frames_out++;
+
+   /* NULL means the core asked for the previous frame to be duped */
+   if (!data || data == RETRO_HW_FRAME_BUFFER_VALID)
+   {
+      video_frames_dup++;
+      return;
+   }
+
+   fnv1a(&video_hash, &width, sizeof(width));
+   fnv1a(&video_hash, &height, sizeof(height));
+
+   for (y = 0; y < height; y++)
+      fnv1a(&video_hash, (const uint8_t*)data + y * pitch, row_len);
+}
+
+static void audio_cb(int16_t left, int16_t right)
+{
+   int16_t frame[2];
+   frame[0] = left;
+   frame[1] = right;
+   fnv1a(&audio_hash, frame, sizeof(frame));
+   audio_samples_out++;
+}
+
+static size_t audio_batch_cb(const int16_t *data, size_t frames)
+{
+   fnv1a(&audio_hash, data, frames * 2 * sizeof(int16_t));
+   audio_samples_out += frames;
+   return frames;
+}
+
+static void input_poll_cb(void)
+{
+}
+
+static int16_t input_state_cb(unsigned port, unsigned device, unsigned index, unsigned id)
+{
+   return 0;
+}
+
+static bool load_core(struct bench_core *core, const char *path)
+{
+   core->handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+
+   if (!core->handle)
+   {
+      fprintf(stderr, "Failed to load core \"%s\": %s\n", path, dlerror());
+      return false;
+   }
+
+#define LOAD_SYM(S) \
+   if (!(*(void**)&core->S = dlsym(core->handle, #S))) \
+   { \
+      fprintf(stderr, "Core is missing symbol %s\n", #S); \
+      return false; \
+   }
+
+   LOAD_SYM(retro_init);
+   LOAD_SYM(retro_deinit);
+   LOAD_SYM(retro_set_environment);
+   LOAD_SYM(retro_set_video_refresh);
+   LOAD_SYM(retro_set_audio_sample);
+   LOAD_SYM(retro_set_audio_sample_batch);
+   LOAD_SYM(retro_set_input_poll);
+   LOAD_SYM(retro_set_input_state);
+   LOAD_SYM(retro_get_system_av_info);
+   LOAD_SYM(retro_load_game);
+   LOAD_SYM(retro_unload_game);
+   LOAD_SYM(retro_run);
+
+#undef LOAD_SYM
+
+   return true;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+   uint64_t x = *(const uint64_t*)a;
+   uint64_t y = *(const uint64_t*)b;
+   return (x > y) - (x < y);
+}
+
+static double percentile_ms(const uint64_t *sorted, unsigned count, unsigned pct)
+{
+   unsigned idx;
+
+   if (!count)
+      return 0.0;
+
+   idx = (unsigned)(((uint64_t)(count - 1) * pct) / 100);
+   return sorted[idx] / 1000000.0;
+}
+
+static void usage(const char *argv0)
+{
+   fprintf(stderr,
+         "Usage: %s [-c core] [-n frames] [-w warmup] [-b system_dir] [-s save_dir]\n"
+         "          [-o key=value]... [-q] <content>\n", argv0);
+}
+
+int main(int argc, char **argv)
+{
+   struct bench_core core;
+   struct retro_game_info info;
+   struct retro_system_av_info av_info;
+   const char *core_path = BENCH_DEFAULT_CORE;
+   const char *content   = NULL;
+   unsigned frames       = 3600;
+   unsigned warmup       = 0;
+   uint64_t *frame_times = NULL;
+   uint64_t start, total = 0;
+   unsigned i;
+
+   for (i = 1; i < (unsigned)argc; i++)
+   {
+      const char *arg = argv[i];
+      bool has_value  = (i + 1) < (unsigned)argc;
+
+      if (!strcmp(arg, "-c") && has_value)
+         core_path = argv[++i];
+      else if (!strcmp(arg, "-n") && has_value)
+         frames = strtoul(argv[++i], NULL, 0);
+      else if (!strcmp(arg, "-w") && has_value)
+         warmup = strtoul(argv[++i], NULL, 0);
+      else if (!strcmp(arg, "-b") && has_value)
+         system_dir = argv[++i];
+      else if (!strcmp(arg, "-s") && has_value)
+         save_dir = argv[++i];
+      else if (!strcmp(arg, "-o") && has_value)
+      {
+         char key[256];
+         const char *kv = argv[++i];
+         const char *eq = strchr(kv, '=');
+
+         if (!eq || (size_t)(eq - kv) >= sizeof(key))
+         {
+            usage(argv[0]);
+            return 1;
+         }
+
+         memcpy(key, kv, eq - kv);
+         key[eq - kv] = '\0';
+         set_option(key, eq + 1, true);
+      }
+      else if (!strcmp(arg, "-q"))
+         quiet = true;
+      else if (arg[0] == '-')
+      {
+         usage(argv[0]);
+         return 1;
+      }
+      else
+         content = arg;
+   }
+
+   if (!content || !frames)
+   {
+      usage(argv[0]);
+      return 1;
+   }
+
+   memset(&core, 0, sizeof(core));
+   if (!load_core(&core, core_path))
+      return 1;
+
+   /* Explicit -o overrides are registered before the core declares its
+    * options, so they take precedence over the defaults. */
+   core.retro_set_environment(environment_cb);
+   core.retro_set_video_refresh(video_cb);
+   core.retro_set_audio_sample(audio_cb);
+   core.retro_set_audio_sample_batch(audio_batch_cb);
+   core.retro_set_input_poll(input_poll_cb);
+   core.retro_set_input_state(input_state_cb);
+   core.retro_init();
+
+   memset(&info, 0, sizeof(info));
+   info.path = content;
+
+   if (!core.retro_load_game(&info))
+   {
+      fprintf(stderr, "Failed to load content \"%s\"\n", content);
+      core.retro_deinit();
+      dlclose(core.handle);
+      return 1;
+   }
+
+   core.retro_get_system_av_info(&av_info);
+
+   for (i = 0; i < warmup; i++)
+      core.retro_run();
+
+   /* Only the timed frames contribute to the hashes */
+   video_hash        = 14695981039346656037ULL;
+   audio_hash        = 14695981039346656037ULL;
+   video_frames_out  = 0;
+   video_frames_dup  = 0;
+   audio_samples_out = 0;
+
+   frame_times = (uint64_t*)malloc(frames * sizeof(*frame_times));
+   if (!frame_times)
+      return 1;
+
+   for (i = 0; i < frames; i++)
+   {
+      start          = time_now_ns();
+      core.retro_run();
+      frame_times[i] = time_now_ns() - start;
+      total         += frame_times[i];
+   }
+
+   qsort(frame_times, frames, sizeof(*frame_times), compare_u64);
+
+   if (!quiet)
+   {
+      printf("content:        %s\n", content);
+      printf("frames:         %u (+%u warm-up)\n", frames, warmup);
+      printf("emulated fps:   %.3f\n", av_info.timing.fps);
+      printf("total time:     %.3f s\n", total / 1000000000.0);
+      printf("frames/sec:     %.2f (%.2fx realtime)\n",
+            frames * 1000000000.0 / total,
+            (frames * 1000000000.0 / total) / av_info.timing.fps);
+      printf("frame time ms:  p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n",
+            percentile_ms(frame_times, frames, 50),
+            percentile_ms(frame_times, frames, 90),
+            percentile_ms(frame_times, frames, 99),
+            frame_times[frames - 1] / 1000000.0);
+      printf("video:          %llu frames, %llu duped, hash %016llx\n",
+            (unsigned long long)video_frames_out,
+            (unsigned long long)video_frames_dup,
+            (unsigned long long)video_hash);
+      printf("audio:          %llu samples, hash %016llx\n",
+            (unsigned long long)audio_samples_out,
+            (unsigned long long)audio_hash);
+   }
+   else
+      printf("%.2f fps p50=%.3fms p99=%.3fms video=%016llx audio=%016llx\n",
+            frames * 1000000000.0 / total,
+            percentile_ms(frame_times, frames, 50),
+            percentile_ms(frame_times, frames, 99),
+            (unsigned long long)video_hash,
+            (unsigned long long)audio_hash);
+
+   free(frame_times);
+
+   core.retro_unload_game();
+   core.retro_deinit();
+   dlclose(core.handle);
+
+   for (i = 0; i < num_options; i++)
+   {
+      free(options[i].key);
+      free(options[i].value);
+   }
+
+   return 0;
+}
@@ -16,16 +16,49 @@
 #include "debug.h"
 #include "lightrec-private.h"
 #include "memmanager.h"
+#include "recompiler.h"
 
+#include <errno.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if ENABLE_THREADED_COMPILER
+#include <pthread.h>
+#endif
 
 /* Must be power of two */
 #define LUT_SIZE 0x4000
 
+#define IR_CACHE_MAGIC		0x5249524c /* "LRIR" */
+
+struct ir_cache_op {
+	u32 opcode;
+	u16 flags;
+	u16 offset;
+};
+
+/* Optimized and tagged opcode list of a compiled block, along with the
+ * hash of the MIPS code it was generated from */
+struct ir_cache_entry {
+	struct ir_cache_entry *next;
+	u32 pc;
+	u32 hash;
+	u16 nb_ops;
+	u16 nb_list;
+	struct ir_cache_op ops[];
+};
+
 struct blockcache {
 	struct lightrec_state *state;
 	struct block * lut[LUT_SIZE];
+	struct ir_cache_entry * ir_lut[LUT_SIZE];
+	unsigned int nb_ir_entries;
+	bool ir_cache_enabled;
+#if ENABLE_THREADED_COMPILER
+	/* The IR cache is filled from the recompiler thread */
+	pthread_mutex_t ir_mutex;
+#endif
 };
 
 struct block * lightrec_find_block(struct blockcache *cache, u32 pc)
@@ -94,6 +127,315 @@ void lightrec_unregister_block(struct blockcache *cache, struct block *block)
 	pr_err("Block at PC 0x%x is not in cache\n", block->pc);
 }
 
+static inline void ir_cache_lock(struct blockcache *cache)
+{
+#if ENABLE_THREADED_COMPILER
+	pthread_mutex_lock(&cache->ir_mutex);
+#endif
+}
+
+static inline void ir_cache_unlock(struct blockcache *cache)
+{
+#if ENABLE_THREADED_COMPILER
+	pthread_mutex_unlock(&cache->ir_mutex);
+#endif
+}
+
+static void ir_cache_free_entry(struct blockcache *cache,
+				struct ir_cache_entry *entry)
+{
+	lightrec_free(cache->state, MEM_FOR_IR, sizeof(*entry) +
+		      entry->nb_list * sizeof(entry->ops[0]), entry);
+}
+
+/* Replaces the entry of the same PC, if any. Called with the lock held. */
+static void ir_cache_insert(struct blockcache *cache,
+			    struct ir_cache_entry *entry)
+{
+	struct ir_cache_entry **elm;
+	u32 pc = entry->pc;
+
+	for (elm = &cache->ir_lut[(pc >> 2) & (LUT_SIZE - 1)];
+	     *elm; elm = &(*elm)->next) {
+		if ((*elm)->pc == pc) {
+			struct ir_cache_entry *old = *elm;
+
+			entry->next = old->next;
+			*elm = entry;
+			ir_cache_free_entry(cache, old);
+			return;
+		}
+	}
+
+	entry->next = NULL;
+	*elm = entry;
+	cache->nb_ir_entries++;
+}
+
+static void ir_cache_clear(struct blockcache *cache)
+{
+	struct ir_cache_entry *entry, *next;
+	unsigned int i;
+
+	for (i = 0; i < LUT_SIZE; i++) {
+		for (entry = cache->ir_lut[i]; entry; entry = next) {
+			next = entry->next;
+			ir_cache_free_entry(cache, entry);
+		}
+
+		cache->ir_lut[i] = NULL;
+	}
+
+	cache->nb_ir_entries = 0;
+}
+
+void lightrec_ir_cache_store(struct blockcache *cache,
+			     const struct block *block)
+{
+	struct ir_cache_entry *entry;
+	const struct opcode *op;
+	unsigned int nb_list = 0;
+
+	if (!cache->ir_cache_enabled || !block->opcode_list)
+		return;
+
+	for (op = block->opcode_list; op; op = op->next)
+		nb_list++;
+
+	entry = lightrec_malloc(cache->state, MEM_FOR_IR, sizeof(*entry) +
+				nb_list * sizeof(entry->ops[0]));
+	if (!entry)
+		return;
+
+	entry->pc = kunseg(block->pc);
+	entry->hash = block->hash;
+	entry->nb_ops = block->nb_ops;
+	entry->nb_list = nb_list;
+
+	for (op = block->opcode_list, nb_list = 0; op; op = op->next) {
+		entry->ops[nb_list].opcode = op->opcode;
+		entry->ops[nb_list].flags = op->flags;
+		entry->ops[nb_list++].offset = op->offset;
+	}
+
+	ir_cache_lock(cache);
+	ir_cache_insert(cache, entry);
+	ir_cache_unlock(cache);
+}
+
+struct opcode * lightrec_ir_cache_load(struct blockcache *cache,
+				       struct block *block)
+{
+	const struct lightrec_mem_map *map = block->map;
+	struct ir_cache_entry *entry;
+	struct opcode *list = NULL, *curr, *last = NULL;
+	u32 pc = kunseg(block->pc);
+	unsigned int i;
+
+	if (!cache->ir_cache_enabled)
+		return NULL;
+
+	ir_cache_lock(cache);
+
+	for (entry = cache->ir_lut[(pc >> 2) & (LUT_SIZE - 1)];
+	     entry; entry = entry->next)
+		if (entry->pc == pc)
+			break;
+
+	/* The code must still be the one the IR was generated from */
+	if (!entry || pc - map->pc + entry->nb_ops * sizeof(u32) > map->length)
+		goto out_unlock;
+
+	block->nb_ops = entry->nb_ops;
+	if (lightrec_calculate_block_hash(block) != entry->hash)
+		goto out_unlock;
+
+	for (i = 0; i < entry->nb_list; i++, last = curr) {
+		curr = lightrec_malloc(cache->state, MEM_FOR_IR, sizeof(*curr));
+		if (!curr) {
+			lightrec_free_opcode_list(cache->state, list);
+			list = NULL;
+			goto out_unlock;
+		}
+
+		curr->opcode = entry->ops[i].opcode;
+		curr->flags = entry->ops[i].flags;
+		curr->offset = entry->ops[i].offset;
+		curr->next = NULL;
+
+		if (last)
+			last->next = curr;
+		else
+			list = curr;
+	}
+
+	block->hash = entry->hash;
+
+out_unlock:
+	ir_cache_unlock(cache);
+	return list;
+}
+
+void lightrec_set_ir_cache(struct lightrec_state *state, _Bool enable)
+{
+	struct blockcache *cache = state->block_cache;
+
+	cache->ir_cache_enabled = enable;
+
+	if (!enable) {
+		ir_cache_lock(cache);
+		ir_cache_clear(cache);
+		ir_cache_unlock(cache);
+	}
+}
+
+void * lightrec_export_ir_cache(struct lightrec_state *state, size_t *size)
+{
+	struct blockcache *cache = state->block_cache;
+	struct ir_cache_entry *entry;
+	unsigned int i;
+	size_t len = 3 * sizeof(u32);
+	u8 *data, *ptr;
+
+	ir_cache_lock(cache);
+
+	for (i = 0; i < LUT_SIZE; i++)
+		for (entry = cache->ir_lut[i]; entry; entry = entry->next)
+			len += 3 * sizeof(u32) +
+				entry->nb_list * sizeof(entry->ops[0]);
+
+	data = malloc(len);
+	if (!data) {
+		ir_cache_unlock(cache);
+		return NULL;
+	}
+
+	ptr = data;
+	*(u32 *)ptr = IR_CACHE_MAGIC;
+	*(u32 *)(ptr + 4) = LIGHTREC_IR_CACHE_VERSION;
+	*(u32 *)(ptr + 8) = cache->nb_ir_entries;
+	ptr += 3 * sizeof(u32);
+
+	for (i = 0; i < LUT_SIZE; i++) {
+		for (entry = cache->ir_lut[i]; entry; entry = entry->next) {
+			*(u32 *)ptr = entry->pc;
+			*(u32 *)(ptr + 4) = entry->hash;
+			*(u16 *)(ptr + 8) = entry->nb_ops;
+			*(u16 *)(ptr + 10) = entry->nb_list;
+			ptr += 3 * sizeof(u32);
+
+			memcpy(ptr, entry->ops,
+			       entry->nb_list * sizeof(entry->ops[0]));
+			ptr += entry->nb_list * sizeof(entry->ops[0]);
+		}
+	}
+
+	ir_cache_unlock(cache);
+
+	*size = len;
+	return data;
+}
+
+int lightrec_import_ir_cache(struct lightrec_state *state,
+			     const void *data, size_t size)
+{
+	struct blockcache *cache = state->block_cache;
+	struct ir_cache_entry *entry;
+	const u8 *ptr = data, *end = ptr + size;
+	unsigned int i, nb_entries;
+	u16 nb_list;
+
+	if (size < 3 * sizeof(u32) ||
+	    *(const u32 *)ptr != IR_CACHE_MAGIC ||
+	    *(const u32 *)(ptr + 4) != LIGHTREC_IR_CACHE_VERSION)
+		return -EINVAL;
+
+	nb_entries = *(const u32 *)(ptr + 8);
+	ptr += 3 * sizeof(u32);
+
+	ir_cache_lock(cache);
+
+	for (i = 0; i < nb_entries; i++) {
+		if (end - ptr < 3 * sizeof(u32))
+			break;
+
+		nb_list = *(const u16 *)(ptr + 10);
+		if (!nb_list || end - ptr < 3 * sizeof(u32) +
+		    nb_list * sizeof(entry->ops[0]))
+			break;
+
+		entry = lightrec_malloc(state, MEM_FOR_IR, sizeof(*entry) +
+					nb_list * sizeof(entry->ops[0]));
+		if (!entry)
+			break;
+
+		entry->pc = *(const u32 *)ptr;
+		entry->hash = *(const u32 *)(ptr + 4);
+		entry->nb_ops = *(const u16 *)(ptr + 8);
+		entry->nb_list = nb_list;
+		ptr += 3 * sizeof(u32);
+
+		memcpy(entry->ops, ptr, nb_list * sizeof(entry->ops[0]));
+		ptr += nb_list * sizeof(entry->ops[0]);
+
+		ir_cache_insert(cache, entry);
+	}
+
+	ir_cache_unlock(cache);
+
+	pr_debug("Imported %u IR cache entries\n", i);
+
+	return i == nb_entries ? 0 : -EINVAL;
+}
+
+void lightrec_reset_block_stats(struct blockcache *cache)
+{
+	struct block *block;
+	unsigned int i;
+
+	for (i = 0; i < LUT_SIZE; i++) {
+		for (block = cache->lut[i]; block; block = block->next) {
+			block->hits = 0;
+			block->interpreted = 0;
+			block->compile_time = 0;
+			block->compilations = 0;
+			block->invalidations = 0;
+		}
+	}
+}
+
+unsigned int lightrec_get_block_stats(struct lightrec_state *state,
+				      struct lightrec_block_stats *stats,
+				      unsigned int nb)
+{
+	struct blockcache *cache = state->block_cache;
+	struct block *block;
+	unsigned int i, count = 0;
+
+	/* The compiler thread updates the blocks it compiles */
+	if (ENABLE_THREADED_COMPILER)
+		lightrec_recompiler_flush(state->rec);
+
+	for (i = 0; i < LUT_SIZE; i++) {
+		for (block = cache->lut[i]; block; block = block->next) {
+			if (count < nb) {
+				stats[count].pc = block->pc;
+				stats[count].nb_ops = block->nb_ops;
+				stats[count].hits = block->hits;
+				stats[count].cycles = block->cycles;
+				stats[count].interpreted = block->interpreted;
+				stats[count].compilations = block->compilations;
+				stats[count].compile_time = block->compile_time;
+				stats[count].invalidations = block->invalidations;
+			}
+
+			count++;
+		}
+	}
+
+	return count;
+}
+
 void lightrec_free_block_cache(struct blockcache *cache)
 {
 	struct block *block, *next;
@@ -106,6 +448,11 @@ void lightrec_free_block_cache(struct blockcache *cache)
 		}
 	}
 
+	ir_cache_clear(cache);
+#if ENABLE_THREADED_COMPILER
+	pthread_mutex_destroy(&cache->ir_mutex);
+#endif
+
 	lightrec_free(cache->state, MEM_FOR_LIGHTREC, sizeof(*cache), cache);
 }
 
@@ -118,6 +465,9 @@ struct blockcache * lightrec_blockcache_init(struct lightrec_state *state)
 		return NULL;
 
 	cache->state = state;
+#if ENABLE_THREADED_COMPILER
+	pthread_mutex_init(&cache->ir_mutex, NULL);
+#endif
 
 	return cache;
 }
@@ -27,6 +27,13 @@ struct blockcache * lightrec_blockcache_init(struct lightrec_state *state);
 void lightrec_free_block_cache(struct blockcache *cache);
 
 u32 lightrec_calculate_block_hash(const struct block *block);
+
+void lightrec_ir_cache_store(struct blockcache *cache,
+			     const struct block *block);
+struct opcode * lightrec_ir_cache_load(struct blockcache *cache,
+				       struct block *block);
 _Bool lightrec_block_is_outdated(struct block *block);
 
+void lightrec_reset_block_stats(struct blockcache *cache);
+
 #endif /* __BLOCKCACHE_H__ */
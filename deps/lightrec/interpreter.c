@@ -1124,6 +1124,8 @@ u32 lightrec_emulate_block(struct block *block, u32 pc)
 	u32 offset = (kunseg(pc) - kunseg(block->pc)) >> 2;
 	struct opcode *op;
 
+	block->interpreted++;
+
 	for (op = block->opcode_list;
 	     op && (op->offset < offset); op = op->next);
 	if (op)
@@ -51,6 +51,7 @@
 #define BLOCK_SHOULD_RECOMPILE	BIT(1)
 #define BLOCK_FULLY_TAGGED	BIT(2)
 #define BLOCK_IS_DEAD		BIT(3)
+#define BLOCK_IR_CACHED		BIT(4)
 
 #define RAM_SIZE	0x200000
 #define BIOS_SIZE	0x80000
@@ -82,6 +83,12 @@ struct block {
 	unsigned int code_size;
 	u16 flags;
 	u16 nb_ops;
+	u32 hits;
+	u32 cycles;
+	u32 interpreted;
+	u32 compile_time;
+	u16 compilations;
+	u16 invalidations;
 	const struct lightrec_mem_map *map;
 	struct block *next;
 };
@@ -128,6 +135,9 @@ struct lightrec_state {
 	uintptr_t offset_ram, offset_bios, offset_scratch;
 	_Bool mirrors_mapped;
 	_Bool invalidate_from_dma_only;
+	_Bool threaded_compiler;
+	_Bool stats_enabled;
+	u64 stats[LIGHTREC_STAT_END];
 	void *code_lut[];
 };
 
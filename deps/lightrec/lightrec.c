@@ -34,6 +34,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include <time.h>
 #if ENABLE_TINYMM
 #include <tinymm.h>
 #endif
@@ -317,6 +318,7 @@ static void lightrec_rw_helper(struct lightrec_state *state,
 
 static void lightrec_rw_cb(struct lightrec_state *state, union code op)
 {
+	state->stats[LIGHTREC_STAT_RW]++;
 	lightrec_rw_helper(state, op, NULL);
 }
 
@@ -325,6 +327,7 @@ static void lightrec_rw_generic_cb(struct lightrec_state *state,
 {
 	bool was_tagged = op->flags & (LIGHTREC_HW_IO | LIGHTREC_DIRECT_IO);
 
+	state->stats[LIGHTREC_STAT_RW_GENERIC]++;
 	lightrec_rw_helper(state, op->c, &op->flags);
 
 	if (!was_tagged) {
@@ -360,6 +363,8 @@ static void lightrec_mfc_cb(struct lightrec_state *state, union code op)
 {
 	u32 rt = lightrec_mfc(state, op);
 
+	state->stats[LIGHTREC_STAT_MFC]++;
+
 	if (op.r.rt)
 		state->native_reg_cache[op.r.rt] = rt;
 }
@@ -386,6 +391,7 @@ void lightrec_mtc(struct lightrec_state *state, union code op, u32 data)
 
 static void lightrec_mtc_cb(struct lightrec_state *state, union code op)
 {
+	state->stats[LIGHTREC_STAT_MTC]++;
 	lightrec_mtc(state, op, state->native_reg_cache[op.r.rt]);
 }
 
@@ -393,6 +399,8 @@ static void lightrec_rfe_cb(struct lightrec_state *state, union code op)
 {
 	u32 status;
 
+	state->stats[LIGHTREC_STAT_RFE]++;
+
 	/* Read CP0 Status register (r12) */
 	status = state->ops.cop0_ops.mfc(state, op.opcode, 12);
 
@@ -407,6 +415,8 @@ static void lightrec_cp_cb(struct lightrec_state *state, union code op)
 {
 	void (*func)(struct lightrec_state *, u32);
 
+	state->stats[LIGHTREC_STAT_CP]++;
+
 	if ((op.opcode >> 25) & 1)
 		func = state->ops.cop2_ops.op;
 	else
@@ -428,10 +438,13 @@ static void lightrec_break_cb(struct lightrec_state *state, union code op)
 struct block * lightrec_get_block(struct lightrec_state *state, u32 pc)
 {
 	struct block *block = lightrec_find_block(state->block_cache, pc);
+	unsigned int invalidations = 0;
 
 	if (block && lightrec_block_is_outdated(block)) {
 		pr_debug("Block at PC 0x%08x is outdated!\n", block->pc);
 
+		invalidations = block->invalidations + 1;
+
 		/* Make sure the recompiler isn't processing the block we'll
 		 * destroy */
 		if (ENABLE_THREADED_COMPILER)
@@ -451,6 +464,7 @@ struct block * lightrec_get_block(struct lightrec_state *state, u32 pc)
 			return NULL;
 		}
 
+		block->invalidations = invalidations;
 		lightrec_register_block(state->block_cache, block);
 	}
 
@@ -461,6 +475,7 @@ static void * get_next_block_func(struct lightrec_state *state, u32 pc)
 {
 	struct block *block;
 	bool should_recompile;
+	bool threaded = ENABLE_THREADED_COMPILER && state->threaded_compiler;
 	void *func;
 
 	for (;;) {
@@ -468,6 +483,8 @@ static void * get_next_block_func(struct lightrec_state *state, u32 pc)
 		if (func && func != state->get_next_block)
 			return func;
 
+		state->stats[LIGHTREC_STAT_LOOKUP]++;
+
 		block = lightrec_get_block(state, pc);
 
 		if (unlikely(!block))
@@ -481,13 +498,20 @@ static void * get_next_block_func(struct lightrec_state *state, u32 pc)
 
 			lightrec_unregister(MEM_FOR_CODE, block->code_size);
 
-			if (ENABLE_THREADED_COMPILER)
+			if (threaded)
 				lightrec_recompiler_add(state->rec, block);
 			else
 				lightrec_compile_block(block);
 		}
 
-		if (ENABLE_THREADED_COMPILER && likely(!should_recompile))
+		/* A block with cached IR is already tagged, no need to
+		 * profile it first - start compiling it right away */
+		if (threaded && !block->function &&
+		    (block->flags & BLOCK_IR_CACHED) &&
+		    !(block->flags & BLOCK_NEVER_COMPILE))
+			lightrec_recompiler_add(state->rec, block);
+
+		if (threaded && likely(!should_recompile))
 			func = lightrec_recompiler_run_first_pass(block, &pc);
 		else
 			func = block->function;
@@ -496,14 +520,15 @@ static void * get_next_block_func(struct lightrec_state *state, u32 pc)
 			return func;
 
 		/* Block wasn't compiled yet - run the interpreter */
-		if (!ENABLE_THREADED_COMPILER &&
-		    ((ENABLE_FIRST_PASS && likely(!should_recompile)) ||
+		if (!threaded &&
+		    ((ENABLE_FIRST_PASS && likely(!should_recompile) &&
+		      !(block->flags & BLOCK_IR_CACHED)) ||
 		     unlikely(block->flags & BLOCK_NEVER_COMPILE)))
 			pc = lightrec_emulate_block(block, pc);
 
 		if (likely(!(block->flags & BLOCK_NEVER_COMPILE))) {
 			/* Then compile it using the profiled data */
-			if (ENABLE_THREADED_COMPILER)
+			if (threaded)
 				lightrec_recompiler_add(state->rec, block);
 			else
 				lightrec_compile_block(block);
@@ -829,27 +854,41 @@ static struct block * lightrec_precompile_block(struct lightrec_state *state,
 		return NULL;
 	}
 
-	list = lightrec_disassemble(state, code, &length);
-	if (!list) {
-		lightrec_free(state, MEM_FOR_IR, sizeof(*block), block);
-		return NULL;
-	}
-
 	block->pc = pc;
 	block->state = state;
 	block->_jit = NULL;
 	block->function = NULL;
-	block->opcode_list = list;
 	block->map = map;
 	block->next = NULL;
 	block->flags = 0;
 	block->code_size = 0;
+	block->hits = 0;
+	block->cycles = 0;
+	block->interpreted = 0;
+	block->compile_time = 0;
+	block->compilations = 0;
+	block->invalidations = 0;
 #if ENABLE_THREADED_COMPILER
 	block->op_list_freed = (atomic_flag)ATOMIC_FLAG_INIT;
 #endif
-	block->nb_ops = length / sizeof(u32);
 
-	lightrec_optimize(block);
+	/* Reuse the IR of a previous compilation of the same code */
+	list = lightrec_ir_cache_load(state->block_cache, block);
+	if (list) {
+		block->opcode_list = list;
+		block->flags |= BLOCK_IR_CACHED;
+	} else {
+		list = lightrec_disassemble(state, code, &length);
+		if (!list) {
+			lightrec_free(state, MEM_FOR_IR, sizeof(*block), block);
+			return NULL;
+		}
+
+		block->opcode_list = list;
+		block->nb_ops = length / sizeof(u32);
+
+		lightrec_optimize(block);
+	}
 
 	length = block->nb_ops * sizeof(u32);
 
@@ -867,7 +906,8 @@ static struct block * lightrec_precompile_block(struct lightrec_state *state,
 	if (list->flags & LIGHTREC_EMULATE_BRANCH)
 		block->flags |= BLOCK_NEVER_COMPILE;
 
-	block->hash = lightrec_calculate_block_hash(block);
+	if (!(block->flags & BLOCK_IR_CACHED))
+		block->hash = lightrec_calculate_block_hash(block);
 
 	pr_debug("Recompile count: %u\n", state->nb_precompile++);
 
@@ -921,6 +961,19 @@ static void lightrec_reap_jit(void *data)
 	_jit_destroy_state(data);
 }
 
+static u64 lightrec_get_time_us(void)
+{
+#if defined(_WIN32) && !defined(__MINGW32__)
+	return (u64)clock() * 1000000 / CLOCKS_PER_SEC;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (u64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
 int lightrec_compile_block(struct block *block)
 {
 	struct lightrec_state *state = block->state;
@@ -934,6 +987,12 @@ int lightrec_compile_block(struct block *block)
 	jit_word_t code_size;
 	unsigned int i, j;
 	u32 next_pc, offset;
+	bool stats = state->stats_enabled;
+	u64 start_time = 0;
+	u8 tmp;
+
+	if (stats)
+		start_time = lightrec_get_time_us();
 
 	fully_tagged = lightrec_block_is_fully_tagged(block);
 	if (fully_tagged)
@@ -957,6 +1016,16 @@ int lightrec_compile_block(struct block *block)
 
 	start_of_block = jit_label();
 
+	if (stats) {
+		/* All the registers are stored back when branching to the
+		 * start of the block, so a temporary can be used here */
+		tmp = lightrec_alloc_reg_temp(state->reg_cache, _jit);
+		jit_ldi_i(tmp, &block->hits);
+		jit_addi(tmp, tmp, 1);
+		jit_sti_i(&block->hits, tmp);
+		lightrec_free_reg(state->reg_cache, tmp);
+	}
+
 	for (elm = block->opcode_list; elm; elm = elm->next) {
 		next_pc = block->pc + elm->offset * sizeof(u32);
 
@@ -1022,6 +1091,7 @@ int lightrec_compile_block(struct block *block)
 
 	block->function = jit_emit();
 	block->flags &= ~BLOCK_SHOULD_RECOMPILE;
+	block->cycles = state->cycles;
 
 	/* Add compiled function to the LUT */
 	state->code_lut[lut_offset(block->pc)] = block->function;
@@ -1079,6 +1149,12 @@ int lightrec_compile_block(struct block *block)
 
 	jit_clear_state();
 
+	lightrec_ir_cache_store(state->block_cache, block);
+
+	block->compilations++;
+	if (stats)
+		block->compile_time += lightrec_get_time_us() - start_time;
+
 #if ENABLE_THREADED_COMPILER
 	if (fully_tagged)
 		op_list_freed = atomic_flag_test_and_set(&block->op_list_freed);
@@ -1127,6 +1203,19 @@ u32 lightrec_execute(struct lightrec_state *state, u32 pc, u32 target_cycle)
 		state->current_cycle = state->target_cycle - cycles_delta;
 	}
 
+	if (state->exit_flags == LIGHTREC_EXIT_NORMAL) {
+		state->stats[LIGHTREC_STAT_EXIT_CYCLES]++;
+	} else {
+		if (state->exit_flags & LIGHTREC_EXIT_SYSCALL)
+			state->stats[LIGHTREC_STAT_EXIT_SYSCALL]++;
+		if (state->exit_flags & LIGHTREC_EXIT_BREAK)
+			state->stats[LIGHTREC_STAT_EXIT_BREAK]++;
+		if (state->exit_flags & LIGHTREC_EXIT_CHECK_INTERRUPT)
+			state->stats[LIGHTREC_STAT_EXIT_CHECK_INTERRUPT]++;
+		if (state->exit_flags & LIGHTREC_EXIT_SEGFAULT)
+			state->stats[LIGHTREC_STAT_EXIT_SEGFAULT]++;
+	}
+
 	if (ENABLE_THREADED_COMPILER)
 		lightrec_reaper_reap(state->reaper);
 
@@ -1213,6 +1302,7 @@ struct lightrec_state * lightrec_init(char *argv0,
 
 	state->nb_maps = nb;
 	state->maps = map;
+	state->threaded_compiler = ENABLE_THREADED_COMPILER;
 
 	memcpy(&state->ops, ops, sizeof(*ops));
 
@@ -1383,6 +1473,38 @@ void lightrec_set_invalidate_mode(struct lightrec_state *state, bool dma_only)
 	state->invalidate_from_dma_only = dma_only;
 }
 
+/* With the threaded compiler, blocks are compiled by a separate thread
+ * and run by the interpreter until their code is ready; otherwise the
+ * emulation stops until the block is compiled. */
+void lightrec_set_threaded_compiler(struct lightrec_state *state, bool enable)
+{
+	if (!ENABLE_THREADED_COMPILER || state->threaded_compiler == enable)
+		return;
+
+	/* Blocks queued for the thread must not be compiled twice */
+	if (!enable)
+		lightrec_recompiler_flush(state->rec);
+
+	state->threaded_compiler = enable;
+}
+
+void lightrec_set_stats(struct lightrec_state *state, bool enable)
+{
+	state->stats_enabled = enable;
+}
+
+void lightrec_reset_stats(struct lightrec_state *state)
+{
+	memset(state->stats, 0, sizeof(state->stats));
+	lightrec_reset_block_stats(state->block_cache);
+}
+
+void lightrec_get_stats(struct lightrec_state *state,
+			u64 counters[LIGHTREC_STAT_END])
+{
+	memcpy(counters, state->stats, sizeof(state->stats));
+}
+
 void lightrec_set_exit_flags(struct lightrec_state *state, u32 flags)
 {
 	if (flags != LIGHTREC_EXIT_NORMAL) {
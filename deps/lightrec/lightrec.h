@@ -57,6 +57,42 @@ struct lightrec_mem_map;
 #define LIGHTREC_EXIT_CHECK_INTERRUPT	(1 << 2)
 #define LIGHTREC_EXIT_SEGFAULT	(1 << 3)
 
+/* Counters for lightrec_get_stats(): why lightrec_execute() returned, and
+ * the calls from the generated code to C */
+enum lightrec_stat {
+	LIGHTREC_STAT_EXIT_CYCLES,	/* Target cycle count reached */
+	LIGHTREC_STAT_EXIT_SYSCALL,
+	LIGHTREC_STAT_EXIT_BREAK,
+	LIGHTREC_STAT_EXIT_CHECK_INTERRUPT,
+	LIGHTREC_STAT_EXIT_SEGFAULT,
+	LIGHTREC_STAT_LOOKUP,		/* Block not found in the code LUT */
+	LIGHTREC_STAT_RW,		/* Access through the memory map ops */
+	LIGHTREC_STAT_RW_GENERIC,	/* Access not tagged yet */
+	LIGHTREC_STAT_MFC,
+	LIGHTREC_STAT_MTC,
+	LIGHTREC_STAT_RFE,
+	LIGHTREC_STAT_CP,
+	LIGHTREC_STAT_END,
+};
+
+struct lightrec_block_stats {
+	u32 pc;
+	u32 nb_ops;
+	/* Entries into the native code of the block, including loops back
+	 * to its first opcode. Only counted for blocks compiled while the
+	 * statistics are enabled. */
+	u32 hits;
+	/* Cycles of a pass through the whole block */
+	u32 cycles;
+	/* Passes run by the interpreter */
+	u32 interpreted;
+	u32 compilations;
+	/* Time spent compiling the block, in microseconds */
+	u32 compile_time;
+	/* How many times the code at this PC was modified */
+	u32 invalidations;
+};
+
 enum psx_map {
 	PSX_MAP_KERNEL_USER_RAM,
 	PSX_MAP_BIOS,
@@ -127,6 +163,9 @@ __api void lightrec_invalidate_all(struct lightrec_state *state);
 __api void lightrec_set_invalidate_mode(struct lightrec_state *state,
 					_Bool dma_only);
 
+__api void lightrec_set_threaded_compiler(struct lightrec_state *state,
+					  _Bool enable);
+
 __api void lightrec_set_exit_flags(struct lightrec_state *state, u32 flags);
 __api u32 lightrec_exit_flags(struct lightrec_state *state);
 
@@ -139,6 +178,30 @@ __api void lightrec_reset_cycle_count(struct lightrec_state *state, u32 cycles);
 __api void lightrec_set_target_cycle_count(struct lightrec_state *state,
 					   u32 cycles);
 
+/* IR cache: the optimized and tagged opcode lists of the compiled blocks
+ * are kept, and reused instead of disassembling, optimizing and profiling
+ * again a block whose code matches. The cache can be exported to persist
+ * it across sessions; the buffer returned is to be freed with free().
+ * LIGHTREC_IR_CACHE_VERSION changes whenever the exported layout does. */
+#define LIGHTREC_IR_CACHE_VERSION 1
+
+__api void lightrec_set_ir_cache(struct lightrec_state *state, _Bool enable);
+__api void * lightrec_export_ir_cache(struct lightrec_state *state,
+				      size_t *size);
+__api int lightrec_import_ir_cache(struct lightrec_state *state,
+				   const void *data, size_t size);
+
+/* Statistics: the counters of enum lightrec_stat are always updated, the
+ * per-block hit counters and compile times only while enabled. */
+__api void lightrec_set_stats(struct lightrec_state *state, _Bool enable);
+__api void lightrec_reset_stats(struct lightrec_state *state);
+__api void lightrec_get_stats(struct lightrec_state *state,
+			      u64 counters[LIGHTREC_STAT_END]);
+/* Fills up to nb entries, returns the number of blocks */
+__api unsigned int lightrec_get_block_stats(struct lightrec_state *state,
+					    struct lightrec_block_stats *stats,
+					    unsigned int nb);
+
 __api unsigned int lightrec_get_mem_usage(enum mem_type type);
 __api unsigned int lightrec_get_total_mem_usage(void);
 __api float lightrec_get_average_ipi(void);
@@ -249,6 +249,17 @@ void lightrec_recompiler_remove(struct recompiler *rec, struct block *block)
 	pthread_mutex_unlock(&rec->mutex);
 }
 
+/* Waits until all the blocks in the queue have been compiled */
+void lightrec_recompiler_flush(struct recompiler *rec)
+{
+	pthread_mutex_lock(&rec->mutex);
+
+	while (!slist_empty(&rec->slist))
+		pthread_cond_wait(&rec->cond, &rec->mutex);
+
+	pthread_mutex_unlock(&rec->mutex);
+}
+
 void * lightrec_recompiler_run_first_pass(struct block *block, u32 *pc)
 {
 	bool freed;
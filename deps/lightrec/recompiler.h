@@ -23,6 +23,7 @@ struct recompiler *lightrec_recompiler_init(struct lightrec_state *state);
 void lightrec_free_recompiler(struct recompiler *rec);
 int lightrec_recompiler_add(struct recompiler *rec, struct block *block);
 void lightrec_recompiler_remove(struct recompiler *rec, struct block *block);
+void lightrec_recompiler_flush(struct recompiler *rec);
 
 void * lightrec_recompiler_run_first_pass(struct block *block, u32 *pc);
 
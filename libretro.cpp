@@ -13,11 +13,13 @@
 #include <streams/file_stream.h>
 #include <string/stdstring.h>
 #include <rhash.h>
+#include <zlib.h>
 #include "ugui_tools.h"
 #include "rsx/rsx_intf.h"
 #include "libretro_cbs.h"
 #include "beetle_psx_globals.h"
 #include "libretro_options.h"
+#include "libretro_ext.h"
 #include "input.h"
 
 #include "parallel-psx/custom-textures/dbg_input_callback.h"
@@ -27,6 +29,7 @@ retro_input_state_t dbg_input_state_cb = 0;
 #include "mednafen/mednafen-types.h"
 #include "mednafen/psx/psx.h"
 #include "mednafen/error.h"
+#include "mednafen/state_async.h"
 
 #include "pgxp/pgxp_main.h"
 
@@ -69,6 +72,7 @@ static retro_input_state_t input_state_cb;
 static unsigned frame_count = 0;
 static unsigned internal_frame_count = 0;
 static bool display_internal_framerate = false;
+static unsigned profiler_frame_count = 0;
 static bool allow_frame_duping = false;
 static bool failed_init = false;
 static unsigned image_offset = 0;
@@ -92,6 +96,8 @@ unsigned cd_2x_speedup = 1;
 bool cd_async = false;
 bool cd_warned_slow = false;
 int64 cd_slow_timeout = 8000; // microseconds
+uint32_t cd_chd_cache_size = 4 * 1024 * 1024; // decompressed CHD hunks, bytes
+bool cd_pbp_disk_cache = false;
 
 // If true, PAL games will run at 60fps
 bool fast_pal = false;
@@ -99,6 +105,9 @@ bool fast_pal = false;
 #ifdef HAVE_LIGHTREC
 enum DYNAREC psx_dynarec;
 bool psx_dynarec_invalidate;
+bool psx_dynarec_block_cache;
+bool psx_dynarec_threaded_compiler;
+bool psx_dynarec_stats;
 uint8 psx_mmap = 0;
 uint8 *psx_mem = NULL;
 uint8 *psx_bios = NULL;
@@ -124,6 +133,7 @@ static int psx_skipbios;
 
 bool psx_gte_overclock;
 enum dither_mode psx_gpu_dither_mode;
+static unsigned psx_gpu_threads;
 
 //iCB: PGXP options
 unsigned int psx_pgxp_mode;
@@ -318,6 +328,7 @@ static void extract_directory(char *buf, const char *path, size_t size)
 #include "mednafen/psx/sio.h"
 #include "mednafen/psx/cdc.h"
 #include "mednafen/psx/spu.h"
+#include "mednafen/psx/profiler.h"
 #include "mednafen/mempatcher.h"
 
 #include <stdarg.h>
@@ -629,19 +640,29 @@ bool MDFN_FASTCALL PSX_EventHandler(const int32_t timestamp)
          default:
             abort();
          case PSX_EVENT_GPU:
+            PSX_PROFILE_ENTER(PSX_PROF_GPU);
             nt = GPU_Update(e->event_time);
+            PSX_PROFILE_LEAVE();
             break;
          case PSX_EVENT_CDC:
+            PSX_PROFILE_ENTER(PSX_PROF_CDC);
             nt = PSX_CDC->Update(e->event_time);
+            PSX_PROFILE_LEAVE();
             break;
          case PSX_EVENT_TIMER:
+            PSX_PROFILE_ENTER(PSX_PROF_TIMER);
             nt = TIMER_Update(e->event_time);
+            PSX_PROFILE_LEAVE();
             break;
          case PSX_EVENT_DMA:
+            PSX_PROFILE_ENTER(PSX_PROF_DMA);
             nt = DMA_Update(e->event_time);
+            PSX_PROFILE_LEAVE();
             break;
          case PSX_EVENT_FIO:
+            PSX_PROFILE_ENTER(PSX_PROF_FIO);
             nt = PSX_FIO->Update(e->event_time);
+            PSX_PROFILE_LEAVE();
             break;
       }
 
@@ -1283,6 +1304,22 @@ void PSX_GPULineHook(const int32_t timestamp, const int32_t line_timestamp, bool
    PSX_FIO->GPULineHook(timestamp, line_timestamp, vsync, pixels, format, width, pix_clock_offset, pix_clock, pix_clock_divider, surf_pitchinpix, upscale_factor);
 }
 
+bool PSX_GPULineHookWantsPixels(void)
+{
+   // Only the light guns need every frame
+   return PSX_FIO->RequireNoFrameskip();
+}
+
+static void update_gpu_thread(void)
+{
+   /* The hardware renderers are fed on the emulation thread, and PGXP
+    * vertices have to be looked up when the command is received. */
+   if (rsx_intf_is_type() == RSX_SOFTWARE && !PGXP_enabled())
+      GPU_SetThreaded(psx_gpu_threads);
+   else
+      GPU_SetThreaded(0);
+}
+
 static bool TestMagic(const char *name, RFILE *fp, int64_t size)
 {
    uint8_t header[8];
@@ -2422,7 +2459,7 @@ extern "C" int StateAction(StateMem *sm, int load, int data_only)
    {
       SFVAR(CD_TrayOpen),
       SFVAR(CD_SelectedDisc),
-      SFARRAYN(MainRAM->data8, 1024 * 2048, "MainRAM.data8"),
+      SFPAGEDARRAYN(MainRAM->data8, 1024 * 2048, "MainRAM.data8"),
       SFARRAY32(SysControl.Regs, 9),
       SFVAR(PSX_PRNG.lcgo),
       SFVAR(PSX_PRNG.x),
@@ -2734,13 +2771,23 @@ static double last_sound_rate;
 #ifdef NEED_DEINTERLACER
 static bool PrevInterlaced;
 static Deinterlacer deint;
+
+static void deinterlace_part(void *data, unsigned index, unsigned count)
+{
+   deint.ProcessPart(index, count);
+}
 #endif
 
 static MDFN_Surface *surf = NULL;
 
 static void alloc_surface(void)
 {
+#if defined(WANT_16BPP)
+   MDFN_PixelFormat pix_fmt(MDFN_COLORSPACE_RGB, 11, 5, 0, 16);
+   pix_fmt.bpp = 16;
+#else
    MDFN_PixelFormat pix_fmt(MDFN_COLORSPACE_RGB, 16, 8, 0, 24);
+#endif
    uint32_t width  = MEDNAFEN_CORE_GEOMETRY_MAX_W;
    uint32_t height = content_is_pal ? MEDNAFEN_CORE_GEOMETRY_MAX_H  : 480;
 
@@ -3065,6 +3112,18 @@ static void check_variables(bool startup)
    }
 #endif
 
+#ifdef HAVE_CHD
+   var.key = BEETLE_OPT(chd_cache_size);
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      cd_chd_cache_size = atoi(var.value) * 1024 * 1024;
+#endif
+
+   var.key = BEETLE_OPT(pbp_disk_cache);
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      cd_pbp_disk_cache = !strcmp(var.value, "enabled");
+   else
+      cd_pbp_disk_cache = false;
+
 #ifdef HAVE_LIGHTREC
    var.key = BEETLE_OPT(cpu_dynarec);
 
@@ -3094,6 +3153,27 @@ static void check_variables(bool startup)
    else
       psx_dynarec_invalidate = false;
 
+   var.key = BEETLE_OPT(dynarec_block_cache);
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      psx_dynarec_block_cache = !strcmp(var.value, "enabled");
+   else
+      psx_dynarec_block_cache = false;
+
+   var.key = BEETLE_OPT(dynarec_threaded_compiler);
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      psx_dynarec_threaded_compiler = !!strcmp(var.value, "disabled");
+   else
+      psx_dynarec_threaded_compiler = true;
+
+   var.key = BEETLE_OPT(dynarec_stats);
+
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+      psx_dynarec_stats = !strcmp(var.value, "enabled");
+   else
+      psx_dynarec_stats = false;
+
    var.key = BEETLE_OPT(dynarec_eventcycles);
 
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
@@ -3342,6 +3422,34 @@ static void check_variables(bool startup)
    else
       psx_gpu_dither_mode = DITHER_NATIVE;
 
+#ifdef NEED_DEINTERLACER
+   var.key = BEETLE_OPT(deinterlacer);
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "bob"))
+         deint.SetType(Deinterlacer::DEINT_BOB);
+      else if (!strcmp(var.value, "blend"))
+         deint.SetType(Deinterlacer::DEINT_BLEND);
+      else
+         deint.SetType(Deinterlacer::DEINT_WEAVE);
+   }
+   else
+      deint.SetType(Deinterlacer::DEINT_WEAVE);
+#endif
+
+   var.key = BEETLE_OPT(gpu_thread);
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      if (!strcmp(var.value, "disabled"))
+         psx_gpu_threads = 0;
+      else if (!strcmp(var.value, "enabled"))
+         psx_gpu_threads = 1;
+      else
+         psx_gpu_threads = atoi(var.value);
+   }
+   else
+      psx_gpu_threads = 0;
+
    // iCB: PGXP settings
    var.key = BEETLE_OPT(pgxp_mode);
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
@@ -3637,6 +3745,41 @@ static void check_variables(bool startup)
    else
       display_internal_framerate = false;
 
+   var.key = BEETLE_OPT(profiler);
+   if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+   {
+      unsigned mode = 0;
+
+      if (!strcmp(var.value, "overlay"))
+         mode = PSX_PROFILER_OVERLAY;
+      else if (!strcmp(var.value, "csv"))
+         mode = PSX_PROFILER_CSV;
+      else if (!strcmp(var.value, "overlay_csv"))
+         mode = PSX_PROFILER_OVERLAY | PSX_PROFILER_CSV;
+
+      if ((mode & PSX_PROFILER_CSV) && !(psx_profiler_mode & PSX_PROFILER_CSV))
+      {
+         char path[4096];
+         int r = snprintf(path, sizeof(path), "%s%c%s.profile.csv",
+               retro_save_directory, retro_slash,
+               retro_cd_base_name[0] ? retro_cd_base_name : "beetle_psx");
+
+         if (r < 0 || r >= (int)sizeof(path) || !PSX_Profiler_OpenLog(path))
+         {
+            log_cb(RETRO_LOG_ERROR, "Failed to open profiler log \"%s\"\n", path);
+            mode &= ~PSX_PROFILER_CSV;
+         }
+         else
+            log_cb(RETRO_LOG_INFO, "Writing per-frame profile to \"%s\"\n", path);
+      }
+      else if (!(mode & PSX_PROFILER_CSV))
+         PSX_Profiler_CloseLog();
+
+      psx_profiler_mode = mode;
+   }
+   else
+      psx_profiler_mode = 0;
+
    var.key = BEETLE_OPT(crop_overscan);
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
    {
@@ -3916,6 +4059,34 @@ error:
    return false;
 }
 
+#ifdef HAVE_LIGHTREC
+/* The dynarec block cache is only valid for the BIOS and disc it was
+ * built with, identify them by the CRC of the BIOS and of the TOC. */
+static uint32 dynarec_cache_key(void)
+{
+   uint32 key = crc32(0, BIOSROM->data8, 512 * 1024);
+
+   if (CDInterfaces.size())
+   {
+      TOC toc;
+
+      TOC_Clear(&toc);
+      CDInterfaces[0]->ReadTOC(&toc);
+      key = crc32(key, (const Bytef*)&toc, sizeof(toc));
+   }
+
+   return key;
+}
+
+static bool dynarec_cache_path(char *path, size_t size)
+{
+   int r = snprintf(path, size, "%s%c%s.lrcache", retro_save_directory,
+         retro_slash, retro_cd_base_name);
+
+   return r >= 0 && r < (int)size;
+}
+#endif
+
 bool retro_load_game(const struct retro_game_info *info)
 {
    char tocbasepath[4096];
@@ -3925,7 +4096,11 @@ bool retro_load_game(const struct retro_game_info *info)
 
    input_init_env(environ_cb);
 
+#if defined(WANT_16BPP)
+   enum retro_pixel_format fmt = RETRO_PIXEL_FORMAT_RGB565;
+#else
    enum retro_pixel_format fmt = RETRO_PIXEL_FORMAT_XRGB8888;
+#endif
    if (!environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &fmt))
       return false;
 
@@ -3988,6 +4163,19 @@ bool retro_load_game(const struct retro_game_info *info)
 
    bool ret = rsx_intf_open(content_is_pal, force_software_renderer);
 
+   update_gpu_thread();
+
+#ifdef HAVE_LIGHTREC
+   if (psx_dynarec_block_cache && firmware_found)
+   {
+      char path[4096];
+
+      if (dynarec_cache_path(path, sizeof(path)) &&
+            PSX_CPU->LoadDynarecCache(path, dynarec_cache_key()))
+         log_cb(RETRO_LOG_INFO, "Loaded dynarec block cache \"%s\"\n", path);
+   }
+#endif
+
    /* Hide irrelevant core options */
    switch (rsx_intf_is_type())
    {
@@ -4107,6 +4295,17 @@ void retro_unload_game(void)
 
    rsx_intf_close();
 
+#ifdef HAVE_LIGHTREC
+   if (psx_dynarec_block_cache && firmware_found)
+   {
+      char path[4096];
+
+      if (!dynarec_cache_path(path, sizeof(path)) ||
+            !PSX_CPU->SaveDynarecCache(path, dynarec_cache_key()))
+         log_cb(RETRO_LOG_WARN, "Failed to save dynarec block cache \"%s\"\n", path);
+   }
+#endif
+
    MDFN_FlushGameCheats(0);
 
    CloseGame();
@@ -4127,6 +4326,10 @@ void retro_unload_game(void)
    retro_cd_base_directory[0] = '\0';
    retro_cd_path[0]           = '\0';
    retro_cd_base_name[0]      = '\0';
+
+   PSX_Profiler_CloseLog();
+   MDFNSS_ResetDelta();
+   MDFNSS_AsyncShutdown();
 }
 
 static uint64_t video_frames, audio_frames;
@@ -4150,9 +4353,12 @@ void retro_run(void)
    if (gui_show && gui_inited && frame_width > 0 && frame_height > 0)
    {
       gui_draw();
-      video_cb(gui_get_framebuffer(), frame_width, frame_height, frame_width * sizeof(unsigned));
+      video_cb(gui_get_framebuffer(), frame_width, frame_height, frame_width * sizeof(MDFN_Pixel));
    }
 
+   if (psx_profiler_mode)
+      PSX_Profiler_BeginFrame();
+
    rsx_intf_prepare_frame();
 
    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &updated) && updated)
@@ -4220,6 +4426,7 @@ void retro_run(void)
                                 MDFN_GetSettingI(content_is_pal ? "psx.slendp" : "psx.slend"));
 
       PGXP_SetModes(psx_pgxp_mode | psx_pgxp_vertex_caching | psx_pgxp_texture_correction | psx_pgxp_nclip);
+      update_gpu_thread();
 
       // Reload memory cards if they were changed
       if (use_mednafen_memcard0_method &&
@@ -4318,6 +4525,25 @@ void retro_run(void)
       internal_frame_count = 0;
    }
 
+   if (psx_profiler_mode & PSX_PROFILER_OVERLAY)
+   {
+      profiler_frame_count++;
+
+      if (profiler_frame_count % INTERNAL_FPS_SAMPLE_PERIOD == 0)
+      {
+         char msg_buffer[256];
+
+         PSX_Profiler_FormatSummary(msg_buffer, sizeof(msg_buffer));
+
+         if (msg_buffer[0])
+            MDFND_DispMessage(1, RETRO_LOG_INFO,
+                  RETRO_MESSAGE_TARGET_OSD, RETRO_MESSAGE_TYPE_STATUS,
+                  msg_buffer);
+      }
+   }
+   else
+      profiler_frame_count = 0;
+
    if (setting_apply_analog_toggle)
    {
       PSX_FIO->SetAMCT(setting_psx_analog_toggle);
@@ -4364,11 +4590,24 @@ void retro_run(void)
    GPU_StartFrame(espec);
 
    Running = -1;
+#ifdef HAVE_LIGHTREC
+   const unsigned cpu_zone = psx_dynarec != DYNAREC_DISABLED ? PSX_PROF_DYNAREC : PSX_PROF_CPU;
+#else
+   const unsigned cpu_zone = PSX_PROF_CPU;
+#endif
+   PSX_PROFILE_ENTER(cpu_zone);
    timestamp = PSX_CPU->Run(timestamp, false, false);
+   PSX_PROFILE_LEAVE();
+
+   if (psx_profiler_mode)
+      PSX_Profiler_AddCycles(cpu_zone, timestamp);
 
    assert(timestamp);
 
    ForceEventUpdates(timestamp);
+
+   // The frontend gets the surface once the render thread scanned it out
+   GPU_Sync();
 #if 0
    if(GPU_GetScanlineNum() < 100)
       PSX_DBG(PSX_DBG_ERROR, "[BUUUUUUUG] Frame timing end glitch; scanline=%u, st=%u\n", GPU_GetScanlineNum(), timestamp);
@@ -4476,7 +4715,11 @@ void retro_run(void)
          if (!PrevInterlaced)
             deint.ClearState();
 
-         deint.Process(surf, spec.DisplayRect, rects, spec.InterlaceField);
+         // Shared between the render threads, if any
+         deint.Begin(surf, spec.DisplayRect, rects, spec.InterlaceField,
+               upscale_shift);
+         GPU_RunOnThreads(deinterlace_part, NULL);
+         deint.End();
 
          PrevInterlaced = true;
 
@@ -4493,7 +4736,7 @@ void retro_run(void)
       //fprintf(stderr, "(%u x %u)\n", width, height);
 
       // PSX core inserts padding on left and right (overscan). Optionally crop this.
-      const uint32_t *pix = surf->pixels;
+      const MDFN_Pixel *pix = (const MDFN_Pixel*)surf->pixels;
       unsigned pix_offset = 0;
 
       if (crop_overscan)
@@ -4557,7 +4800,7 @@ void retro_run(void)
          frame_width = width;
          frame_height = height;
 
-         gui_init(frame_width, frame_height, sizeof(unsigned));
+         gui_init(frame_width, frame_height, sizeof(MDFN_Pixel));
          gui_set_window_title("Error");
          gui_inited = true;
       }
@@ -4572,7 +4815,7 @@ void retro_run(void)
    else
    {
       rsx_intf_finalize_frame(fb, width, height,
-            MEDNAFEN_CORE_GEOMETRY_MAX_W << (2 + upscale_shift));
+            (MEDNAFEN_CORE_GEOMETRY_MAX_W << upscale_shift) * sizeof(MDFN_Pixel));
    }
 
    video_frames++;
@@ -4580,6 +4823,9 @@ void retro_run(void)
 
    audio_batch_cb(interbuf, spec.SoundBufSize);
 
+   if (psx_profiler_mode)
+      PSX_Profiler_EndFrame(espec->MasterCycles);
+
    if (GPU_get_display_possibly_dirty() || (GPU_get_display_change_count() != 0))
    {
       internal_frame_count++;
@@ -4635,6 +4881,8 @@ unsigned retro_api_version(void)
 
 #include "libretro_core_options.h"
 
+static retro_proc_address_t RETRO_CALLCONV get_proc_address(const char *sym);
+
 void retro_set_environment(retro_environment_t cb)
 {
    struct retro_vfs_interface_info vfs_iface_info;
@@ -4642,6 +4890,9 @@ void retro_set_environment(retro_environment_t cb)
 
    libretro_set_core_options(environ_cb);
 
+   static const struct retro_get_proc_address_interface proc_address_iface = { get_proc_address };
+   environ_cb(RETRO_ENVIRONMENT_SET_PROC_ADDRESS_CALLBACK, (void*)&proc_address_iface);
+
    vfs_iface_info.required_interface_version = 1;
    vfs_iface_info.iface                      = NULL;
    if (environ_cb(RETRO_ENVIRONMENT_GET_VFS_INTERFACE, &vfs_iface_info))
@@ -4729,7 +4980,7 @@ bool retro_serialize(void *data, size_t size)
 
       //fast save states are at least 20% faster
       FastSaveStates = UsingFastSavestates();
-      ret = MDFNSS_SaveSM(&st, 0, 0, NULL, NULL, NULL);
+      ret = MDFNSS_SaveBaseSM(&st);
    }
    else
    {
@@ -4753,7 +5004,7 @@ bool retro_serialize(void *data, size_t size)
       }
 
       FastSaveStates = UsingFastSavestates();
-      ret = MDFNSS_SaveSM(&st, 0, 0, NULL, NULL, NULL);
+      ret = MDFNSS_SaveBaseSM(&st);
 
       memcpy(data, st.data, size);
       free(st.data);
@@ -4764,6 +5015,97 @@ bool retro_serialize(void *data, size_t size)
    return ret;
 }
 
+static bool beetle_psx_serialize_delta(void *data, size_t size, size_t *written)
+{
+   /* Kept around between calls, deltas are small but frequent */
+   static StateMem st;
+   bool ret;
+
+   st.loc = 0;
+   st.len = 0;
+
+   /* The base must only move to a delta the frontend gets */
+   ret = MDFNSS_SaveDeltaSM(&st, size < 0xFFFFFFFF ? (uint32)size : 0xFFFFFFFF);
+
+   if (!ret)
+      return false;
+
+   memcpy(data, st.data, st.len);
+   *written = st.len;
+
+   return true;
+}
+
+static void beetle_psx_reset_delta(void)
+{
+   MDFNSS_ResetDelta();
+}
+
+static void *beetle_psx_serialize_async(unsigned compression, int level)
+{
+   MDFNSS_AsyncJob *job;
+
+   FastSaveStates = UsingFastSavestates();
+   job            = MDFNSS_SaveAsync(compression, level);
+   FastSaveStates = false;
+
+   return job;
+}
+
+static bool beetle_psx_async_state_ready(void *state)
+{
+   return MDFNSS_AsyncDone((MDFNSS_AsyncJob*)state);
+}
+
+static bool beetle_psx_async_state_wait(void *state,
+      struct beetle_psx_async_state *info)
+{
+   return MDFNSS_AsyncWait((MDFNSS_AsyncJob*)state, &info->data,
+         &info->size, &info->state_size, &info->sha256);
+}
+
+static void beetle_psx_async_state_free(void *state)
+{
+   MDFNSS_AsyncRelease((MDFNSS_AsyncJob*)state);
+}
+
+#ifdef HAVE_LIGHTREC
+static void beetle_psx_dump_dynarec_stats(void)
+{
+   if (PSX_CPU)
+      PSX_CPU->DumpDynarecStats();
+}
+#endif
+
+static void beetle_psx_dump_gpu_stats(void)
+{
+   GPU_DumpCommandStats();
+}
+
+static retro_proc_address_t RETRO_CALLCONV get_proc_address(const char *sym)
+{
+   if (!strcmp(sym, "beetle_psx_serialize_delta"))
+      return (retro_proc_address_t)beetle_psx_serialize_delta;
+   if (!strcmp(sym, "beetle_psx_reset_delta"))
+      return (retro_proc_address_t)beetle_psx_reset_delta;
+   if (!strcmp(sym, "beetle_psx_serialize_async"))
+      return (retro_proc_address_t)beetle_psx_serialize_async;
+   if (!strcmp(sym, "beetle_psx_async_state_ready"))
+      return (retro_proc_address_t)beetle_psx_async_state_ready;
+   if (!strcmp(sym, "beetle_psx_async_state_wait"))
+      return (retro_proc_address_t)beetle_psx_async_state_wait;
+   if (!strcmp(sym, "beetle_psx_async_state_free"))
+      return (retro_proc_address_t)beetle_psx_async_state_free;
+#ifdef HAVE_LIGHTREC
+   if (!strcmp(sym, "beetle_psx_dump_dynarec_stats"))
+      return (retro_proc_address_t)beetle_psx_dump_dynarec_stats;
+#endif
+   if (!strcmp(sym, "beetle_psx_dump_gpu_stats"))
+      return (retro_proc_address_t)beetle_psx_dump_gpu_stats;
+
+   return NULL;
+}
+
 bool retro_unserialize(const void *data, size_t size)
 {
    StateMem st;
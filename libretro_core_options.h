@@ -109,6 +109,36 @@ struct retro_core_option_definition option_defs_us[] = {
    },
    // Sort of, it's more like 15-bit high color and 24-bit true color for visible output. The alpha channel is used for mask bit. Vulkan renderer uses ABGR1555_555 for 31 bits internal? FMVs are always 24-bit on all renderers like original hardware (BGR888, no alpha)
 #endif
+   {
+      BEETLE_OPT(gpu_thread),
+      "Software Renderer Threads",
+      "Rasterize on separate threads when using the software renderer, so that drawing at increased internal resolutions runs in parallel with the rest of the emulation. With more than one thread, each one draws its own bands of lines. Has no effect with the hardware renderers or when PGXP is enabled.",
+      {
+         { "disabled", NULL },
+         { "1",        NULL },
+         { "2",        NULL },
+         { "3",        NULL },
+         { "4",        NULL },
+         { "6",        NULL },
+         { "8",        NULL },
+         { "12",       NULL },
+         { "16",       NULL },
+         { NULL, NULL },
+      },
+      "disabled"
+   },
+   {
+      BEETLE_OPT(deinterlacer),
+      "Deinterlacing Method",
+      "How the software renderer shows interlaced (480i) video. 'Weave' shows both fields together, which is sharpest on still pictures but combs on motion. 'Bob' doubles the lines of the current field. 'Blend' weaves where the picture is still and interpolates the current field where it moves.",
+      {
+         { "weave", "Weave" },
+         { "bob",   "Bob" },
+         { "blend", "Blend" },
+         { NULL, NULL },
+      },
+      "weave"
+   },
    {
       BEETLE_OPT(dither_mode),
       "Dithering Pattern",
@@ -364,6 +394,19 @@ struct retro_core_option_definition option_defs_us[] = {
       },
       "disabled"
    },
+   {
+      BEETLE_OPT(profiler),
+      "Subsystem Profiler",
+      "Measure how much host time is spent emulating each part of the console (CPU, GPU, CD-ROM, SPU, timers, DMA, controllers). 'Overlay' periodically displays the breakdown as an onscreen notification, 'CSV Log' writes a per-frame breakdown to a .profile.csv file in the save directory. Adds a small overhead when enabled.",
+      {
+         { "disabled",    NULL },
+         { "overlay",     "Overlay" },
+         { "csv",         "CSV Log" },
+         { "overlay_csv", "Overlay + CSV Log" },
+         { NULL, NULL },
+      },
+      "disabled"
+   },
    {
       BEETLE_OPT(line_render),
       "Line-to-Quad Hack",
@@ -412,6 +455,39 @@ struct retro_core_option_definition option_defs_us[] = {
       },
       "full"
    },
+   {
+      BEETLE_OPT(dynarec_block_cache),
+      "Dynarec Block Cache",
+      "Keep the analysis of recompiled code in a file in the save directory, so that code seen in previous sessions is compiled faster and without profiling. Reduces stutter when booting and loading levels.",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL },
+      },
+      "disabled"
+   },
+   {
+      BEETLE_OPT(dynarec_threaded_compiler),
+      "Dynarec Compiler Thread",
+      "Compile new code on a separate thread, and run it with the Lightrec interpreter until it is ready. Avoids stutter when new code is loaded on hosts with more than one core. Only available in builds with the threaded recompiler.",
+      {
+         { "enabled",  NULL },
+         { "disabled", NULL },
+         { NULL, NULL },
+      },
+      "enabled"
+   },
+   {
+      BEETLE_OPT(dynarec_stats),
+      "Dynarec Statistics",
+      "Count how often each recompiled block runs and how long it took to compile, along with the reasons the recompiled code returns to the emulator. The report is written to the log when the game is closed. Slightly slows down the recompiled code.",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL },
+      },
+      "disabled"
+   },
    {
       BEETLE_OPT(dynarec_eventcycles),
       "Dynarec DMA/GPU Event Cycles",
@@ -978,6 +1054,32 @@ struct retro_core_option_definition option_defs_us[] = {
       "sync"
    },
 #endif
+#ifdef HAVE_CHD
+   {
+      BEETLE_OPT(chd_cache_size),
+      "CHD Cache Size (Restart)",
+      "Memory used to keep decompressed parts of CHD disk images. A larger cache avoids decompressing the same data again when a game goes back and forth between areas of the disk, like streamed audio and level data.",
+      {
+         { "2MB",  "2 MB" },
+         { "4MB",  "4 MB" },
+         { "16MB", "16 MB" },
+         { "64MB", "64 MB" },
+         { NULL, NULL },
+      },
+      "4MB"
+   },
+#endif
+   {
+      BEETLE_OPT(pbp_disk_cache),
+      "PBP Decompressed Cache (Restart)",
+      "Keep the decompressed data of PBP (EBOOT) disk images in a file in the save directory, so that parts of the disk already read in previous sessions are loaded without decompressing them again. The file grows up to the uncompressed size of the disk, about 700 MB.",
+      {
+         { "disabled", NULL },
+         { "enabled",  NULL },
+         { NULL, NULL },
+      },
+      "disabled"
+   },
    {
       BEETLE_OPT(cd_fastload),
       "CD Loading Speed",
@@ -0,0 +1,91 @@
+#ifndef __LIBRETRO_EXT_H
+#define __LIBRETRO_EXT_H
+
+#include <stddef.h>
+#include <boolean.h>
+
+/* Beetle PSX specific entry points, not part of the libretro API.
+ * Frontends look them up by name through the get_proc_address()
+ * interface the core registers with
+ * RETRO_ENVIRONMENT_SET_PROC_ADDRESS_CALLBACK, and cast the result
+ * to the matching type below. */
+
+/* "beetle_psx_serialize_delta"
+ *
+ * Like retro_serialize(), but only stores the pages of main RAM, VRAM,
+ * SPU RAM and scratchpad that changed since the previous snapshot (state
+ * saved or loaded by any means). *written receives the size of the state,
+ * which is usually a few KB. The result is only valid for this process
+ * and is loaded with retro_unserialize(), which accepts it on top of the
+ * state it was based on, or when it is the most recent snapshot. A chain
+ * of delta states therefore has to be loaded in order starting from a
+ * full state. */
+typedef bool (*beetle_psx_serialize_delta_t)(void *data, size_t size,
+      size_t *written);
+
+/* "beetle_psx_reset_delta"
+ *
+ * Stops tracking pages and frees the reference copies used to compute
+ * delta states. The next delta state holds every page. */
+typedef void (*beetle_psx_reset_delta_t)(void);
+
+#define BEETLE_PSX_STATE_UNCOMPRESSED 0
+/* zlib stream, inflate with uncompress() */
+#define BEETLE_PSX_STATE_ZLIB         1
+/* The 5 LZMA properties bytes followed by the LZMA stream, decompress
+ * with LzmaUncompress(). Not available in builds without CHD support. */
+#define BEETLE_PSX_STATE_LZMA         2
+
+struct beetle_psx_async_state
+{
+   /* Compressed state, valid until the state is freed */
+   const void *data;
+   size_t size;
+   /* Size of the state once decompressed */
+   size_t state_size;
+   /* Hex SHA-256 of data */
+   const char *sha256;
+};
+
+/* "beetle_psx_serialize_async"
+ *
+ * Saves the same state as retro_serialize() into an internal buffer and
+ * returns at once, compression and hashing are done on a worker thread.
+ * level is the compression level, -1 for the default one. Returns NULL
+ * on failure. Every state returned has to be freed with
+ * beetle_psx_async_state_free(), its buffers are then reused. */
+typedef void *(*beetle_psx_serialize_async_t)(unsigned compression,
+      int level);
+
+/* "beetle_psx_async_state_ready"
+ *
+ * Returns true once the state is compressed, without blocking. */
+typedef bool (*beetle_psx_async_state_ready_t)(void *state);
+
+/* "beetle_psx_async_state_wait"
+ *
+ * Waits for the state to be compressed and fills info. Returns false
+ * if compression failed. */
+typedef bool (*beetle_psx_async_state_wait_t)(void *state,
+      struct beetle_psx_async_state *info);
+
+/* "beetle_psx_async_state_free" */
+typedef void (*beetle_psx_async_state_free_t)(void *state);
+
+/* "beetle_psx_dump_dynarec_stats"
+ *
+ * Writes the dynarec statistics collected so far to the log: the blocks
+ * the most time is spent in, their compile times and invalidations, and
+ * why the recompiled code returned to the emulator. The per-block
+ * counters need the "Dynarec Statistics" core option. */
+typedef void (*beetle_psx_dump_dynarec_stats_t)(void);
+
+/* "beetle_psx_dump_gpu_stats"
+ *
+ * Writes to the log how many times each variant of the GPU drawing
+ * commands (blend mode, texture depth and mask evaluation) ran since the
+ * game was loaded, most used first, in the format of the list of
+ * specialized variants of mednafen/psx/gpu_hot_commands.h. */
+typedef void (*beetle_psx_dump_gpu_stats_t)(void);
+
+#endif
@@ -0,0 +1,218 @@
+/* Mednafen - Multi-system Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "mednafen.h"
+#include "error.h"
+#include "FileStream.h"
+#include "MemoryStream.h"
+#include "MappedFileStream.h"
+
+#include <string.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define MAPPEDFILE_MMAP
+#elif defined(_WIN32) && !defined(_XBOX) && !defined(__WINRT__)
+#include <windows.h>
+#include <encodings/utf.h>
+#define MAPPEDFILE_WIN32
+#endif
+
+MappedFileStream::MappedFileStream(const char *path, bool *success) : map_ptr(NULL), map_size(0), position(0)
+#if defined(_WIN32)
+   , map_handle(NULL)
+#endif
+{
+   *success = false;
+
+#if defined(MAPPEDFILE_MMAP)
+   {
+      struct stat st;
+      void *ptr;
+      int fd = open(path, O_RDONLY);
+
+      if (fd < 0)
+         return;
+
+      if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+            (uint64_t)st.st_size > SIZE_MAX)
+      {
+         ::close(fd);
+         return;
+      }
+
+      // The mapping keeps the file referenced
+      ptr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      ::close(fd);
+
+      if (ptr == MAP_FAILED)
+         return;
+
+#ifdef MADV_WILLNEED
+      // Start reading the image in the background, like the whole image was
+      // loaded before but without waiting for it
+      madvise(ptr, (size_t)st.st_size, MADV_WILLNEED);
+#endif
+
+      map_ptr  = (const uint8_t*)ptr;
+      map_size = st.st_size;
+   }
+#elif defined(MAPPEDFILE_WIN32)
+   {
+      LARGE_INTEGER file_size;
+      HANDLE file;
+      HANDLE mapping;
+      void *ptr;
+      wchar_t *path_w = utf8_to_utf16_string_alloc(path);
+
+      if (!path_w)
+         return;
+
+      file = CreateFileW(path_w, GENERIC_READ, FILE_SHARE_READ, NULL,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+      free(path_w);
+
+      if (file == INVALID_HANDLE_VALUE)
+         return;
+
+      if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart <= 0 ||
+            (uint64_t)file_size.QuadPart > SIZE_MAX)
+      {
+         CloseHandle(file);
+         return;
+      }
+
+      mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+      CloseHandle(file);
+
+      if (!mapping)
+         return;
+
+      ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+      if (!ptr)
+      {
+         CloseHandle(mapping);
+         return;
+      }
+
+      map_ptr    = (const uint8_t*)ptr;
+      map_size   = file_size.QuadPart;
+      map_handle = mapping;
+   }
+#else
+   return;
+#endif
+
+   *success = true;
+}
+
+MappedFileStream::~MappedFileStream()
+{
+   close();
+}
+
+Stream *MappedFileStream::OpenOrLoad(const char *path)
+{
+   bool success;
+   MappedFileStream *ret = new MappedFileStream(path, &success);
+
+   if (success)
+      return ret;
+
+   delete ret;
+
+   return new MemoryStream(new FileStream(path, MODE_READ));
+}
+
+const uint8_t *MappedFileStream::mapped_data(void)
+{
+   return map_ptr;
+}
+
+uint64_t MappedFileStream::read(void *data, uint64_t count, bool error_on_eos)
+{
+   if (position >= map_size)
+      return 0;
+
+   if (count > map_size - position)
+      count = map_size - position;
+
+   memcpy(data, map_ptr + position, (size_t)count);
+   position += count;
+
+   return count;
+}
+
+void MappedFileStream::write(const void *data, uint64_t count)
+{
+   MDFN_Error(0, "Write to a read-only mapped file.");
+}
+
+void MappedFileStream::seek(int64_t offset, int whence)
+{
+   int64_t new_position = position;
+
+   switch (whence)
+   {
+      case SEEK_SET:
+         new_position = offset;
+         break;
+      case SEEK_CUR:
+         new_position = position + offset;
+         break;
+      case SEEK_END:
+         new_position = map_size + offset;
+         break;
+   }
+
+   if (new_position < 0)
+      return;
+
+   position = new_position;
+}
+
+uint64_t MappedFileStream::tell(void)
+{
+   return position;
+}
+
+uint64_t MappedFileStream::size(void)
+{
+   return map_size;
+}
+
+void MappedFileStream::close(void)
+{
+   if (!map_ptr)
+      return;
+
+#if defined(MAPPEDFILE_MMAP)
+   munmap((void*)map_ptr, (size_t)map_size);
+#elif defined(MAPPEDFILE_WIN32)
+   UnmapViewOfFile(map_ptr);
+   CloseHandle((HANDLE)map_handle);
+   map_handle = NULL;
+#endif
+
+   map_ptr  = NULL;
+   map_size = 0;
+   position = 0;
+}
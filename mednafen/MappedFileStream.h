@@ -0,0 +1,56 @@
+/* Mednafen - Multi-system Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __MDFN_MAPPEDFILESTREAM_H
+#define __MDFN_MAPPEDFILESTREAM_H
+
+#include "Stream.h"
+
+// Read-only stream over a file mapped in memory. Pages are read from the
+// file as they're first accessed and are shared with the system's page
+// cache, so opening is immediate and several processes using the same
+// image don't each keep their own copy.
+class MappedFileStream : public Stream
+{
+   public:
+      // *success is false when the file can't be mapped(not a local file,
+      // no mmap on this platform, ...), nothing is logged.
+      MappedFileStream(const char *path, bool *success);
+      virtual ~MappedFileStream();
+
+      // Maps the file when possible, otherwise reads it in a MemoryStream.
+      static Stream *OpenOrLoad(const char *path);
+
+      virtual const uint8_t *mapped_data(void);
+
+      virtual uint64_t read(void *data, uint64_t count, bool error_on_eos = true);
+      virtual void write(const void *data, uint64_t count);
+      virtual void seek(int64_t offset, int whence);
+      virtual uint64_t tell(void);
+      virtual uint64_t size(void);
+      virtual void close(void);
+
+   private:
+      const uint8_t *map_ptr;
+      uint64_t map_size;
+      uint64_t position;
+#if defined(_WIN32)
+      void *map_handle;
+#endif
+};
+
+#endif
@@ -78,6 +78,11 @@ void MemoryStream::unmap(void)
 
 }
 
+const uint8 *MemoryStream::mapped_data(void)
+{
+ return data_buffer;
+}
+
 
 INLINE void MemoryStream::grow_if_necessary(uint64 new_required_size)
 {
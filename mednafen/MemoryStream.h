@@ -40,6 +40,8 @@ class MemoryStream : public Stream
  virtual uint8 *map(void);
  virtual void unmap(void);
 
+ virtual const uint8 *mapped_data(void);
+
  virtual uint64 read(void *data, uint64 count, bool error_on_eos = true);
  virtual void write(const void *data, uint64 count);
  virtual void seek(int64 offset, int whence);
@@ -30,6 +30,11 @@ Stream::~Stream()
 
 }
 
+const uint8_t *Stream::mapped_data(void)
+{
+   return NULL;
+}
+
 int Stream::get_line(std::string &str)
 {
    uint8_t c;
@@ -28,6 +28,10 @@ class Stream
       virtual void seek(int64_t offset, int whence) = 0;
       virtual uint64_t tell(void) = 0;
       virtual uint64_t size(void) = 0;
+      // Whole contents of the stream when they're directly addressable in
+      // memory, NULL otherwise. Valid until the stream is written to or closed.
+      virtual const uint8_t *mapped_data(void);
+
       virtual void close(void) = 0;	// Flushes(in the case of writeable streams) and closes the stream.
       // Necessary since this operation can fail(running out of disk space, for instance),
       // and throw an exception in the destructor would be a Bad Idea(TM).
@@ -249,12 +249,11 @@ bool CDAccess_CCD::Load(const char *path, bool image_memcache)
    /* Open image stream. */
    {
       std::string image_path = MDFN_EvalFIP(dir_path, file_base + std::string(".") + std::string(img_extsd), true);
-      FileStream *str        = new FileStream(image_path.c_str(), MODE_READ);
 
       if(image_memcache)
-         img_stream = new MemoryStream(str);
+         img_stream = MappedFileStream::OpenOrLoad(image_path.c_str());
       else
-         img_stream = str;
+         img_stream = new FileStream(image_path.c_str(), MODE_READ);
 
       int64 ss = img_stream->size();
 
@@ -270,12 +269,11 @@ bool CDAccess_CCD::Load(const char *path, bool image_memcache)
    {
       /* Open subchannel stream */
       std::string sub_path = MDFN_EvalFIP(dir_path, file_base + std::string(".") + std::string(sub_extsd), true);
-      FileStream *str      = new FileStream(sub_path.c_str(), MODE_READ);
 
       if(image_memcache)
-         sub_stream = new MemoryStream(str);
+         sub_stream = MappedFileStream::OpenOrLoad(sub_path.c_str());
       else
-         sub_stream = str;
+         sub_stream = new FileStream(sub_path.c_str(), MODE_READ);
 
       if(sub_stream->size() != (int64)img_numsectors * 96)
       {
@@ -394,7 +392,7 @@ CDAccess_CCD::~CDAccess_CCD()
 
 bool CDAccess_CCD::Read_Raw_Sector(uint8 *buf, int32 lba)
 {
-   uint8_t sub_buf[96];
+   const uint8_t *img = img_stream->mapped_data();
 
    if(lba < 0 || (size_t)lba >= img_numsectors)
    {
@@ -402,31 +400,46 @@ bool CDAccess_CCD::Read_Raw_Sector(uint8 *buf, int32 lba)
       return false;
    }
 
-   img_stream->seek(lba * 2352, SEEK_SET);
-   img_stream->read(buf, 2352);
-
-   sub_stream->seek(lba * 96, SEEK_SET);
-   sub_stream->read(sub_buf, 96);
+   // The image size was checked against img_numsectors when loading it
+   if(img)
+      memcpy(buf, img + (size_t)lba * 2352, 2352);
+   else
+   {
+      img_stream->seek(lba * 2352, SEEK_SET);
+      img_stream->read(buf, 2352);
+   }
 
-   subpw_interleave(sub_buf, buf + 2352);
+   ReadSubPW(buf + 2352, lba);
 
    return true;
 }
 
-bool CDAccess_CCD::Read_Raw_PW(uint8_t *buf, int32_t lba)
+void CDAccess_CCD::ReadSubPW(uint8_t *buf, int32_t lba)
 {
+   const uint8_t *sub = sub_stream->mapped_data();
    uint8_t sub_buf[96];
 
-   if(lba < 0 || (size_t)lba >= img_numsectors)
+   if(sub)
    {
-      MDFN_Error(0, "LBA out of range.");
-      return false;
+      subpw_interleave(sub + (size_t)lba * 96, buf);
+      return;
    }
 
    sub_stream->seek(lba * 96, SEEK_SET);
    sub_stream->read(sub_buf, 96);
 
    subpw_interleave(sub_buf, buf);
+}
+
+bool CDAccess_CCD::Read_Raw_PW(uint8_t *buf, int32_t lba)
+{
+   if(lba < 0 || (size_t)lba >= img_numsectors)
+   {
+      MDFN_Error(0, "LBA out of range.");
+      return false;
+   }
+
+   ReadSubPW(buf, lba);
 
    return true;
 }
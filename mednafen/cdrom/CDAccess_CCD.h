@@ -20,6 +20,7 @@
 
 #include "../FileStream.h"
 #include "../MemoryStream.h"
+#include "../MappedFileStream.h"
 #include "CDAccess.h"
 
 #include <vector>
@@ -46,6 +47,9 @@ class CDAccess_CCD : public CDAccess
 
  bool CheckSubQSanity(void);
 
+ // Reads the P-W subchannel data of a sector, interleaved
+ void ReadSubPW(uint8_t *buf, int32_t lba);
+
  Stream* img_stream;
  Stream* sub_stream;
  size_t img_numsectors;
@@ -20,10 +20,23 @@
 #include <mednafen/mednafen-endian.h>
 #include <mednafen/FileStream.h>
 
+#include <algorithm>
+
 #include "CDAccess_CHD.h"
 
 extern retro_log_printf_t log_cb;
 
+// Hunks decompressed in advance of the one being read
+#define CHD_PREFETCH_HUNKS 4
+
+#ifdef HAVE_THREADS
+#define CHD_LOCK()   slock_lock(HunkLock)
+#define CHD_UNLOCK() slock_unlock(HunkLock)
+#else
+#define CHD_LOCK()
+#define CHD_UNLOCK()
+#endif
+
 
 // Disk-image(rip) track/sector formats
 enum
@@ -63,12 +76,25 @@ bool CDAccess_CHD::ImageOpen(const char *path, bool image_memcache)
          return false;
    }
 
-   /* allocate storage for sector reads */
+   /* hunk cache, buffers are allocated on first use */
    const chd_header *head = chd_get_header(chd);
-   hunkmem = (uint8_t*)malloc(head->hunkbytes);
-   oldhunk = -1;
+   size_t hunk_slots = cd_chd_cache_size / head->hunkbytes;
+
+   // Leave room for the prefetched hunks besides the one being read
+   if (hunk_slots < CHD_PREFETCH_HUNKS * 2)
+      hunk_slots = CHD_PREFETCH_HUNKS * 2;
+
+   HunkSlots.resize(hunk_slots);
+   for (size_t i = 0; i < hunk_slots; i++)
+   {
+      HunkSlots[i].hunknum  = -1;
+      HunkSlots[i].last_use = 0;
+      HunkSlots[i].pending  = false;
+      HunkSlots[i].data     = NULL;
+   }
+   HunkSlotIndex.assign(head->totalhunks, -1);
    
-   log_cb(RETRO_LOG_INFO, "chd_load '%s' hunkbytes=%d\n", path, head->hunkbytes);
+   log_cb(RETRO_LOG_INFO, "chd_load '%s' hunkbytes=%d cached hunks=%u\n", path, head->hunkbytes, (unsigned)hunk_slots);
 
    int plba = -150;
    uint32_t fileOffset = 0;
@@ -197,21 +223,312 @@ bool CDAccess_CHD::ImageOpen(const char *path, bool image_memcache)
    }
    sbi_path = MDFN_EvalFIP(base_dir, file_base + std::string(".") + std::string(sbi_ext), true);
 
+#ifdef HAVE_THREADS
+   StartWorkers(path);
+#endif
+
    return true;
 }
 
 void CDAccess_CHD::Cleanup(void)
 {
+#ifdef HAVE_THREADS
+   StopWorkers();
+
+   if (ReadyCond)
+      scond_free(ReadyCond);
+   if (WorkCond)
+      scond_free(WorkCond);
+   if (HunkLock)
+      slock_free(HunkLock);
+#endif
+
+   for (size_t i = 0; i < HunkSlots.size(); i++)
+      free(HunkSlots[i].data);
+   HunkSlots.clear();
+
    if(chd != NULL)
       chd_close(chd);
+}
+
+#ifdef HAVE_THREADS
+void CDAccess_CHD::WorkerEntry(void *arg)
+{
+   CHD_Worker *w = (CHD_Worker*)arg;
 
-   if (hunkmem != NULL)
-      free(hunkmem);
+   w->cda->WorkerLoop(w->chd);
+}
+
+void CDAccess_CHD::WorkerLoop(chd_file *wchd)
+{
+   CHD_LOCK();
+
+   for (;;)
+   {
+      CHD_Hunk_Slot *s;
+      int32_t hunknum;
+      chd_error err;
+
+      while (!WorkersExit && WorkQueue.empty())
+         scond_wait(WorkCond, HunkLock);
+
+      if (WorkersExit)
+         break;
+
+      s = &HunkSlots[WorkQueue.front()];
+      WorkQueue.erase(WorkQueue.begin());
+      hunknum = s->hunknum;
+
+      // The slot can't be reused while it's pending
+      CHD_UNLOCK();
+      err = chd_read(wchd, hunknum, s->data);
+      CHD_LOCK();
+
+      s->pending = false;
+      if (err != CHDERR_NONE)
+      {
+         HunkSlotIndex[hunknum] = -1;
+         s->hunknum = -1;
+      }
+
+      scond_broadcast(ReadyCond);
+   }
+
+   CHD_UNLOCK();
+}
+
+void CDAccess_CHD::StartWorkers(const char *path)
+{
+   for (unsigned i = 0; i < WorkerCount; i++)
+   {
+      if (chd_open(path, CHD_OPEN_READ, NULL, &Workers[i].chd) != CHDERR_NONE)
+      {
+         Workers[i].chd = NULL;
+         break;
+      }
+
+      Workers[i].cda    = this;
+      Workers[i].thread = sthread_create(WorkerEntry, &Workers[i]);
+
+      if (!Workers[i].thread)
+      {
+         chd_close(Workers[i].chd);
+         Workers[i].chd = NULL;
+         break;
+      }
+   }
+}
+
+void CDAccess_CHD::StopWorkers(void)
+{
+   CHD_LOCK();
+   WorkersExit = true;
+   scond_broadcast(WorkCond);
+   CHD_UNLOCK();
+
+   for (unsigned i = 0; i < WorkerCount; i++)
+   {
+      if (Workers[i].thread)
+         sthread_join(Workers[i].thread);
+      if (Workers[i].chd)
+         chd_close(Workers[i].chd);
+
+      Workers[i].thread = NULL;
+      Workers[i].chd    = NULL;
+   }
+
+   WorkQueue.clear();
+}
+#endif
+
+// Returns a free or the least recently used slot for hunknum, called with
+// HunkLock held.
+int32_t CDAccess_CHD::AllocHunkSlot(uint32_t hunknum)
+{
+   CHD_Hunk_Slot *s;
+   int32_t ret = -1;
+
+   for (size_t i = 0; i < HunkSlots.size(); i++)
+   {
+      s = &HunkSlots[i];
+
+      if (s->pending)
+         continue;
+
+      if (s->hunknum < 0)
+      {
+         ret = i;
+         break;
+      }
+
+      if (ret < 0 || (HunkClock - s->last_use) > (HunkClock - HunkSlots[ret].last_use))
+         ret = i;
+   }
+
+   if (ret < 0)
+      return -1;
+
+   s = &HunkSlots[ret];
+
+   if (!s->data && !(s->data = (uint8_t*)malloc(chd_get_header(chd)->hunkbytes)))
+      return -1;
+
+   if (s->hunknum >= 0)
+      HunkSlotIndex[s->hunknum] = -1;
+
+   s->hunknum              = hunknum;
+   s->last_use             = HunkClock;
+   HunkSlotIndex[hunknum]  = ret;
+
+   return ret;
+}
+
+// Queues the hunks following hunknum for the workers, called with HunkLock
+// held.
+void CDAccess_CHD::PrefetchHunks(uint32_t hunknum)
+{
+#ifdef HAVE_THREADS
+   bool queued = false;
+
+   if (!Workers[0].thread)
+      return;
+
+   for (uint32_t next = hunknum + 1; next <= hunknum + CHD_PREFETCH_HUNKS; next++)
+   {
+      int32_t idx;
+
+      if (next >= HunkSlotIndex.size())
+         break;
+
+      if (HunkSlotIndex[next] >= 0)
+         continue;
+
+      if ((idx = AllocHunkSlot(next)) < 0)
+         break;
+
+      // Older than the hunk being read, so that it's not evicted first
+      HunkSlots[idx].last_use = HunkClock - 1;
+      HunkSlots[idx].pending  = true;
+      WorkQueue.push_back(idx);
+      queued = true;
+   }
+
+   if (queued)
+      scond_broadcast(WorkCond);
+#endif
+}
+
+// Drops the queued prefetches, called with HunkLock held.
+void CDAccess_CHD::CancelPrefetches(void)
+{
+#ifdef HAVE_THREADS
+   for (size_t i = 0; i < WorkQueue.size(); i++)
+   {
+      CHD_Hunk_Slot *s = &HunkSlots[WorkQueue[i]];
+
+      HunkSlotIndex[s->hunknum] = -1;
+      s->hunknum = -1;
+      s->pending = false;
+   }
+
+   WorkQueue.clear();
+#endif
+}
+
+// Returns the decompressed hunk, NULL on error. The data stays valid until
+// the next call.
+const uint8_t *CDAccess_CHD::ReadHunk(uint32_t hunknum)
+{
+   CHD_Hunk_Slot *s;
+   int32_t idx;
+   chd_error err;
+
+   if (hunknum >= HunkSlotIndex.size())
+      return NULL;
+
+   CHD_LOCK();
+
+   HunkClock++;
+   idx = HunkSlotIndex[hunknum];
+
+#ifdef HAVE_THREADS
+   if (idx >= 0 && HunkSlots[idx].pending)
+   {
+      std::vector<int32_t>::iterator queued = std::find(WorkQueue.begin(), WorkQueue.end(), idx);
+
+      // Not started yet, it's quicker to read it here than to wait for the
+      // prefetches queued before it
+      if (queued != WorkQueue.end())
+         WorkQueue.erase(queued);
+      else
+      {
+         // Prefetched, wait for the worker to be done with it
+         while (idx >= 0 && HunkSlots[idx].pending)
+         {
+            scond_wait(ReadyCond, HunkLock);
+            idx = HunkSlotIndex[hunknum];
+         }
+      }
+   }
+#endif
+
+   if (idx >= 0 && !HunkSlots[idx].pending)
+   {
+      s           = &HunkSlots[idx];
+      s->last_use = HunkClock;
+      PrefetchHunks(hunknum);
+      CHD_UNLOCK();
+
+      return s->data;
+   }
+
+   if (idx < 0)
+   {
+      // Seeking elsewhere, the prefetches not started yet are of no use
+      CancelPrefetches();
+
+      if ((idx = AllocHunkSlot(hunknum)) < 0)
+      {
+         CHD_UNLOCK();
+         return NULL;
+      }
+   }
+
+   s           = &HunkSlots[idx];
+   s->last_use = HunkClock;
+   s->pending  = true;
+   PrefetchHunks(hunknum);
+   CHD_UNLOCK();
+
+   err = chd_read(chd, hunknum, s->data);
+
+   CHD_LOCK();
+   s->pending = false;
+   if (err != CHDERR_NONE)
+   {
+      HunkSlotIndex[hunknum] = -1;
+      s->hunknum = -1;
+      s = NULL;
+   }
+   CHD_UNLOCK();
+
+   return s ? s->data : NULL;
 }
 
 CDAccess_CHD::CDAccess_CHD(const char *path, bool image_memcache)
 {
    chd = NULL;
+   HunkClock = 0;
+   oldhunk = -1;
+   oldhunkmem = NULL;
+
+#ifdef HAVE_THREADS
+   memset(Workers, 0, sizeof(Workers));
+   WorkersExit = false;
+   HunkLock    = slock_new();
+   WorkCond    = scond_new();
+   ReadyCond   = scond_new();
+#endif
 
    NumTracks = 0;
    total_sectors = 0;
@@ -423,19 +740,24 @@ bool CDAccess_CHD::Read_Raw_Sector(uint8 *buf, int32 lba)
       int sph = head->hunkbytes / (2352 + 96);
       int hunknum = cad / sph; //(cad * head->unitbytes) / head->hunkbytes;
       int hunkofs = cad % sph; //(cad * head->unitbytes) % head->hunkbytes;
-      int err = CHDERR_NONE;
 
       /* each hunk holds ~8 sectors, optimize when reading contiguous sectors */
       if (hunknum != oldhunk)
       {
-         err = chd_read(chd, hunknum, hunkmem);
-         if (err != CHDERR_NONE)
-            log_cb(RETRO_LOG_ERROR, "chd_read_sector failed lba=%d error=%d\n", lba, err);
+         oldhunkmem = ReadHunk(hunknum);
+         if (!oldhunkmem)
+         {
+            log_cb(RETRO_LOG_ERROR, "chd_read_sector failed lba=%d\n", lba);
+            oldhunk = -1;
+         }
          else
             oldhunk = hunknum;
       }
 
-      memcpy(buf, hunkmem + hunkofs * (2352 + 96), 2352);
+      if (oldhunkmem)
+         memcpy(buf, oldhunkmem + hunkofs * (2352 + 96), 2352);
+      else
+         memset(buf, 0, 2352);
 
       if (ct->DIFormat == DI_FORMAT_AUDIO && ct->RawAudioMSBFirst)
          Endian_A16_Swap(buf, 588 * 2);
@@ -6,6 +6,23 @@
 
 #include "chd.h"
 
+#include <vector>
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+// Memory used for decompressed hunks, set from the core options
+extern uint32_t cd_chd_cache_size;
+
+struct CHD_Hunk_Slot
+{
+   int32_t hunknum;     // -1 when free
+   uint32_t last_use;
+   bool pending;        // Queued or being decompressed by a worker
+   uint8_t *data;
+};
+
 class CDAccess_CHD : public CDAccess
 {
    public:
@@ -23,10 +40,40 @@ class CDAccess_CHD : public CDAccess
 
    private:
       chd_file *chd;
-      /* hunk data cache */
-      uint8_t *hunkmem;
-      /* last hunknum read */
+
+      /* LRU cache of decompressed hunks, the next hunks are decompressed
+       * in advance by worker threads when available */
+      std::vector<CHD_Hunk_Slot> HunkSlots;
+      std::vector<int32_t> HunkSlotIndex;   /* By hunk number, -1 if not cached */
+      uint32_t HunkClock;
+      /* last hunk read and its data */
       int oldhunk;
+      const uint8_t *oldhunkmem;
+
+      const uint8_t *ReadHunk(uint32_t hunknum);
+      int32_t AllocHunkSlot(uint32_t hunknum);
+      void PrefetchHunks(uint32_t hunknum);
+      void CancelPrefetches(void);
+
+#ifdef HAVE_THREADS
+      enum { WorkerCount = 2 };
+      struct CHD_Worker
+      {
+         CDAccess_CHD *cda;
+         chd_file *chd;     /* Own handle, chd_read() isn't reentrant */
+         sthread_t *thread;
+      } Workers[WorkerCount];
+      slock_t *HunkLock;
+      scond_t *WorkCond;    /* Prefetch queued, or exiting */
+      scond_t *ReadyCond;   /* Prefetched hunk ready */
+      std::vector<int32_t> WorkQueue;   /* Slots to decompress */
+      bool WorkersExit;
+
+      static void WorkerEntry(void *arg);
+      void WorkerLoop(chd_file *wchd);
+      void StartWorkers(const char *path);
+      void StopWorkers(void);
+#endif
 
       int32_t NumTracks;
       int32_t FirstTrack;
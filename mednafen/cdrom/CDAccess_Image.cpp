@@ -45,6 +45,7 @@
 #include "../general.h"
 #include "../FileStream.h"
 #include "../MemoryStream.h"
+#include "../MappedFileStream.h"
 
 #include "CDAccess.h"
 #include "CDAccess_Image.h"
@@ -89,6 +90,31 @@ static const int32 DI_Size_Table[7] =
    2352
 };
 
+// Reads from the file of a track, straight from memory when the file is
+// mapped or loaded(image_memcache) instead of through seek() and read()
+static void ReadTrackFile(Stream *fp, uint64 pos, uint8 *buf, uint32 count)
+{
+   const uint8 *mem = fp->mapped_data();
+
+   if(mem)
+   {
+      uint64 size  = fp->size();
+      uint64 avail = (pos < size) ? (size - pos) : 0;
+
+      if(avail < count)
+      {
+         memset(buf + avail, 0, count - avail);
+         count = avail;
+      }
+
+      memcpy(buf, mem + pos, count);
+      return;
+   }
+
+   fp->seek(pos, SEEK_SET);
+   fp->read(buf, count);
+}
+
 static const char *DI_CDRDAO_Strings[7] = 
 {
    "AUDIO",
@@ -244,7 +270,7 @@ bool CDAccess_Image::ParseTOCFileLineInfo(CDRFILE_TRACK_INFO *track, const int t
       efn = MDFN_EvalFIP(base_dir, filename, false);
 
       if(image_memcache)
-         track->fp = new MemoryStream(new FileStream(efn.c_str(), MODE_READ));
+         track->fp = MappedFileStream::OpenOrLoad(efn.c_str());
       else
          track->fp = new FileStream(efn.c_str(), MODE_READ);
 
@@ -649,7 +675,11 @@ bool CDAccess_Image::ImageOpen(const char *path, bool image_memcache)
                return false;
 
             if(image_memcache)
-               TmpTrack.fp = new MemoryStream(TmpTrack.fp);
+            {
+               TmpTrack.fp->close();
+               delete TmpTrack.fp;
+               TmpTrack.fp = MappedFileStream::OpenOrLoad(efn.c_str());
+            }
 
             if(!strcasecmp(args[1].c_str(), "BINARY"))
             {
@@ -1028,29 +1058,27 @@ bool CDAccess_Image::Read_Raw_Sector(uint8 *buf, int32 lba)
                if(ct->SubchannelMode)
                   SeekPos += 96 * (lba - ct->LBA);
 
-               ct->fp->seek(SeekPos, SEEK_SET);
-
                switch(ct->DIFormat)
                {
                   case DI_FORMAT_AUDIO:
-                     ct->fp->read(buf, 2352);
+                     ReadTrackFile(ct->fp, SeekPos, buf, 2352);
 
                      if(ct->RawAudioMSBFirst)
                         Endian_A16_Swap(buf, 588 * 2);
                      break;
 
                   case DI_FORMAT_MODE1:
-                     ct->fp->read(buf + 12 + 3 + 1, 2048);
+                     ReadTrackFile(ct->fp, SeekPos, buf + 12 + 3 + 1, 2048);
                      encode_mode1_sector(lba + 150, buf);
                      break;
 
                   case DI_FORMAT_MODE1_RAW:
                   case DI_FORMAT_MODE2_RAW:
-                     ct->fp->read(buf, 2352);
+                     ReadTrackFile(ct->fp, SeekPos, buf, 2352);
                      break;
 
                   case DI_FORMAT_MODE2:
-                     ct->fp->read(buf + 16, 2336);
+                     ReadTrackFile(ct->fp, SeekPos, buf + 16, 2336);
                      encode_mode2_sector(lba + 150, buf);
                      break;
 
@@ -1058,19 +1086,19 @@ bool CDAccess_Image::Read_Raw_Sector(uint8 *buf, int32 lba)
                      // FIXME: M2F1, M2F2, does sub-header come before or after user data(standards say before, but I wonder
                      // about cdrdao...).
                   case DI_FORMAT_MODE2_FORM1:
-                     ct->fp->read(buf + 24, 2048);
+                     ReadTrackFile(ct->fp, SeekPos, buf + 24, 2048);
                      //encode_mode2_form1_sector(lba + 150, buf);
                      break;
 
                   case DI_FORMAT_MODE2_FORM2:
-                     ct->fp->read(buf + 24, 2324);
+                     ReadTrackFile(ct->fp, SeekPos, buf + 24, 2324);
                      //encode_mode2_form2_sector(lba + 150, buf);
                      break;
 
                }
 
                if(ct->SubchannelMode)
-                  ct->fp->read(buf + 2352, 96);
+                  ReadTrackFile(ct->fp, SeekPos + DI_Size_Table[ct->DIFormat], buf + 2352, 96);
             }
          } // end if audible part of audio track read.
          break;
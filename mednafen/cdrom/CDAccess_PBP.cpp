@@ -28,7 +28,10 @@
 
 #include "../general.h"
 #include "../FileStream.h"
-#include "../MemoryStream.h"
+#include "../MappedFileStream.h"
+#include "../mednafen-endian.h"
+
+#include <algorithm>
 
 #include "CDAccess.h"
 #include "CDAccess_PBP.h"
@@ -47,6 +50,28 @@ extern "C" {
 }
 
 extern retro_log_printf_t log_cb;
+extern char retro_save_directory[4096];
+
+// Decompressed blocks kept in memory, 16 sectors each
+#define PBP_CACHE_BLOCKS 32
+// Blocks decompressed in advance of the one being read
+#define PBP_PREFETCH_BLOCKS 2
+#define PBP_BLOCK_SIZE (2352 * 16)
+
+#define PBP_DISK_CACHE_VERSION 1
+#define PBP_DISK_CACHE_HEADER 24
+
+#ifdef HAVE_THREADS
+#define PBP_LOCK()         slock_lock(BlockLock)
+#define PBP_UNLOCK()       slock_unlock(BlockLock)
+#define DISK_CACHE_LOCK()   slock_lock(DiskCacheLock)
+#define DISK_CACHE_UNLOCK() slock_unlock(DiskCacheLock)
+#else
+#define PBP_LOCK()
+#define PBP_UNLOCK()
+#define DISK_CACHE_LOCK()
+#define DISK_CACHE_UNLOCK()
+#endif
 
 // very hacky but currently the only way to update the disc start offset class variable from libretro.cpp
 extern int CD_SelectedDisc;
@@ -111,7 +136,7 @@ bool CDAccess_PBP::ImageOpen(const char *path, bool image_memcache)
    MDFN_GetFilePathComponents(path, &base_dir, &file_base, &file_ext);
 
    if(image_memcache)
-      fp = new MemoryStream(new FileStream(path, MODE_READ));
+      fp = MappedFileStream::OpenOrLoad(path);
    else
       fp = new FileStream(path, MODE_READ);
 
@@ -205,11 +230,51 @@ bool CDAccess_PBP::ImageOpen(const char *path, bool image_memcache)
       sbi_path.insert(sbi_path.length()-4, "_x");
    }
 
+   disk_cache_base = MDFN_EvalFIP(retro_save_directory, file_base, true);
+
+   // blocks are read from memory when the image is mapped or loaded
+   if (!InitDecoder(&MainDecoder, fp->mapped_data() ? NULL : fp))
+      return false;
+
+   BlockSlots.resize(PBP_CACHE_BLOCKS);
+   for (size_t i = 0; i < BlockSlots.size(); i++)
+   {
+      BlockSlots[i].block    = -1;
+      BlockSlots[i].last_use = 0;
+      BlockSlots[i].pending  = false;
+      BlockSlots[i].data     = NULL;
+   }
+
+#ifdef HAVE_THREADS
+   image_path = path;
+   StartWorker();
+#endif
+
    return true;
 }
 
 void CDAccess_PBP::Cleanup(void)
 {
+#ifdef HAVE_THREADS
+   StopWorker();
+
+   if (ReadyCond)
+      scond_free(ReadyCond);
+   if (WorkCond)
+      scond_free(WorkCond);
+   if (DiskCacheLock)
+      slock_free(DiskCacheLock);
+   if (BlockLock)
+      slock_free(BlockLock);
+#endif
+
+   CloseDiskCache();
+   FreeDecoder(&MainDecoder);
+
+   for (size_t i = 0; i < BlockSlots.size(); i++)
+      free(BlockSlots[i].data);
+   BlockSlots.clear();
+
    if(fp != NULL)
    {
       fp->close();   // need to manually close for FileStreams?
@@ -223,7 +288,24 @@ CDAccess_PBP::CDAccess_PBP(const char *path, bool image_memcache) : NumTracks(0)
 {
    is_official = false;
    index_table = NULL;
+   index_len = 0;
    fp = NULL;
+   BlockClock = 0;
+   oldblock = -1;
+   oldblockmem = NULL;
+   DiskCache = NULL;
+   memset(&MainDecoder, 0, sizeof(MainDecoder));
+
+#ifdef HAVE_THREADS
+   memset(&WorkerDecoder, 0, sizeof(WorkerDecoder));
+   Worker        = NULL;
+   WorkerExit    = false;
+   BlockLock     = slock_new();
+   DiskCacheLock = slock_new();
+   WorkCond      = scond_new();
+   ReadyCond     = scond_new();
+#endif
+
    kirk_init();
    if (!ImageOpen(path, image_memcache))
    {
@@ -348,112 +430,589 @@ bool CDAccess_PBP::Read_Raw_PW(uint8_t *buf, int32_t lba)
 }
 
 
-int CDAccess_PBP::decompress2(void *out, uint32_t *out_size, void *in, uint32_t in_size)
+int CDAccess_PBP::decompress2(struct z_stream_s *z, void *out, uint32_t *out_size, void *in, uint32_t in_size)
 {
-   static z_stream z;
-   int ret = 0;
-
-   if (z.zalloc == NULL) {
-      z.next_in = Z_NULL;
-      z.avail_in = 0;
-      z.zalloc = Z_NULL;
-      z.zfree = Z_NULL;
-      z.opaque = Z_NULL;
-      ret = inflateInit2(&z, -15);
-   }
-   else
-      ret = inflateReset(&z);
+   int ret = inflateReset(z);
 
    if (ret != Z_OK)
       return ret;
 
-   z.next_in = (Bytef*)in;
-   z.avail_in = in_size;
-   z.next_out = (Bytef*)out;
-   z.avail_out = *out_size;
+   z->next_in = (Bytef*)in;
+   z->avail_in = in_size;
+   z->next_out = (Bytef*)out;
+   z->avail_out = *out_size;
 
-   ret = inflate(&z, Z_FINISH);
+   ret = inflate(z, Z_FINISH);
 
-   *out_size -= z.avail_out;
+   *out_size -= z->avail_out;
    return ret == 1 ? 0 : ret;
 }
 
-bool CDAccess_PBP::Read_Raw_Sector(uint8 *buf, int32 lba)
+bool CDAccess_PBP::InitDecoder(PBP_Decoder *dec, Stream *stream)
 {
-   uint8_t SimuQ[0xC];
+   dec->fp = stream;
+   dec->z  = (z_stream*)calloc(1, sizeof(z_stream));
 
-   int32_t block = lba >> 4;
-   sector_in_blk = lba & 0xf;
+   if (!dec->z)
+      return false;
 
-   memset(buf + 2352, 0, 96);
-   MakeSubPQ(lba, buf + 2352);
-   subq_deinterleave(buf + 2352, SimuQ);
+   if (inflateInit2(dec->z, -15) != Z_OK)
+   {
+      free(dec->z);
+      dec->z = NULL;
+      return false;
+   }
+
+   return true;
+}
 
-   if (block != current_block)
+void CDAccess_PBP::FreeDecoder(PBP_Decoder *dec)
+{
+   if (dec->z)
    {
-      uint32_t start_byte = index_table[block];
-      uint32_t size = index_table[block+1] - start_byte;
-      bool is_compressed = true;
+      inflateEnd(dec->z);
+      free(dec->z);
+   }
 
-      if (lba >= index_len * 16)
+   dec->z = NULL;
+}
+
+// Reads and decompresses a block, called from the emulation or the worker
+// thread with their own decoder.
+bool CDAccess_PBP::FillBlock(PBP_Decoder *dec, int32_t block, uint8_t *out)
+{
+   const uint8_t *mem = fp->mapped_data();
+   uint32_t start_byte = index_table[block];
+   uint32_t size = index_table[block+1] - start_byte;
+   bool is_compressed = true;
+
+   if (ReadDiskCache(block, out))
+      return true;
+
+   if (size > sizeof(dec->compressed))
+   {
+      log_cb(RETRO_LOG_ERROR, "[PBP] block %d is too large (%u)\n", block, size);
+      return false;
+   }
+   else if(size == sizeof(dec->compressed))
+      is_compressed = false;  // should be the case here?
+
+   if (mem)
+   {
+      if ((uint64_t)start_byte + size > fp->size())
       {
-         log_cb(RETRO_LOG_ERROR, "[PBP] sector %d is past img end\n", lba);
+         log_cb(RETRO_LOG_ERROR, "[PBP] block %d is past the end of the file\n", block);
          return false;
       }
 
-      if (size > sizeof(buff_compressed))
+      memcpy(is_compressed ? dec->compressed : out, mem + start_byte, size);
+   }
+   else
+   {
+      dec->fp->seek(start_byte, SEEK_SET);
+      if (dec->fp->read(is_compressed ? dec->compressed : out, size, false) != size)
       {
-         log_cb(RETRO_LOG_ERROR, "[PBP] %u: block %d is too large (%u)\n", lba, block, size);
+         log_cb(RETRO_LOG_ERROR, "[PBP] unable to read block %d\n", block);
          return false;
       }
-      else if(size == sizeof(buff_compressed))
-         is_compressed = false;  // should be the case here?
-
-      fp->seek(start_byte, SEEK_SET);
-      fp->read(is_compressed ? buff_compressed : buff_raw[0], size);
+   }
 
-//log_cb(RETRO_LOG_DEBUG, "lba = %d, block = %u, start_byte = %#x, index_table[%i] = %#x\n", lba, block, start_byte, block, index_table[block]);
+//log_cb(RETRO_LOG_DEBUG, "block = %d, start_byte = %#x, index_table[%i] = %#x\n", block, start_byte, block, index_table[block]);
 
-      if (is_compressed)
+   if (is_compressed)
+   {
+      if(is_official)
+         decompress(out, dec->compressed, sizeof(dec->compressed));
+      else
       {
-         if(is_official)
+         uint32_t cdbuffer_size_expect = PBP_BLOCK_SIZE;
+         uint32_t cdbuffer_size = cdbuffer_size_expect;
+         int ret = decompress2(dec->z, out, &cdbuffer_size, dec->compressed, size);
+         if (ret != 0)
          {
-            decompress(buff_raw[0], buff_compressed, sizeof(buff_compressed));
-            fixed_sectors = 0;
+            log_cb(RETRO_LOG_ERROR, "[PBP] uncompress failed with %d for block %d (%u)\n", ret, block, size);
+            return false;
          }
-         else
+         if (cdbuffer_size != cdbuffer_size_expect)
          {
-            uint32_t cdbuffer_size_expect = sizeof(buff_raw[0]) << 4;
-            uint32_t cdbuffer_size = cdbuffer_size_expect;
-            int ret = decompress2(buff_raw[0], &cdbuffer_size, buff_compressed, size);
-            if (ret != 0)
-            {
-               log_cb(RETRO_LOG_ERROR, "[PBP] uncompress failed with %d for block %d, sector %d (%u)\n", ret, block, lba, size);
-               return false;
-            }
-            if (cdbuffer_size != cdbuffer_size_expect)
-            {
-               log_cb(RETRO_LOG_WARN, "[PBP] cdbuffer_size: %lu != %lu, sector %d\n", cdbuffer_size, cdbuffer_size_expect, lba);
-               return false;
-            }
+            log_cb(RETRO_LOG_WARN, "[PBP] cdbuffer_size: %lu != %lu, block %d\n", cdbuffer_size, cdbuffer_size_expect, block);
+            return false;
          }
       }
-      current_block = block;
    }
 
    if(is_official)
    {
-      // this will probably rarely get caught but better than trying to do it every time I guess...
-      if(!(fixed_sectors & (0x1 << sector_in_blk)))
+      for (int i = 0; i < 16; i++)
       {
-         if(fix_sector(buff_raw[sector_in_blk], lba) != 0)
-            log_cb(RETRO_LOG_WARN, "[PBP] Failed to fix sector %d\n", lba);
-         else
-            fixed_sectors |= (0x1 << sector_in_blk);
+         if(fix_sector(out + i * 2352, block * 16 + i) != 0)
+            log_cb(RETRO_LOG_WARN, "[PBP] Failed to fix sector %d\n", block * 16 + i);
       }
    }
 
-   memcpy(buf, buff_raw[sector_in_blk], 2352);
+   WriteDiskCache(block, out);
+
+   return true;
+}
+
+#ifdef HAVE_THREADS
+void CDAccess_PBP::WorkerEntry(void *arg)
+{
+   ((CDAccess_PBP*)arg)->WorkerLoop();
+}
+
+void CDAccess_PBP::WorkerLoop(void)
+{
+   PBP_LOCK();
+
+   for (;;)
+   {
+      PBP_Block_Slot *s;
+      int32_t block;
+      bool ok;
+
+      while (!WorkerExit && WorkQueue.empty())
+         scond_wait(WorkCond, BlockLock);
+
+      if (WorkerExit)
+         break;
+
+      s = &BlockSlots[WorkQueue.front()];
+      WorkQueue.erase(WorkQueue.begin());
+      block = s->block;
+
+      // The slot can't be reused while it's pending
+      PBP_UNLOCK();
+      ok = FillBlock(&WorkerDecoder, block, s->data);
+      PBP_LOCK();
+
+      s->pending = false;
+      if (!ok)
+      {
+         BlockSlotIndex[block] = -1;
+         s->block = -1;
+      }
+
+      scond_broadcast(ReadyCond);
+   }
+
+   PBP_UNLOCK();
+}
+
+void CDAccess_PBP::StartWorker(void)
+{
+   Stream *stream = NULL;
+
+   // The file position can't be shared with the emulation thread
+   if (MainDecoder.fp)
+      stream = new FileStream(image_path.c_str(), MODE_READ);
+
+   if (!InitDecoder(&WorkerDecoder, stream))
+   {
+      delete stream;
+      return;
+   }
+
+   if (!(Worker = sthread_create(WorkerEntry, this)))
+   {
+      FreeDecoder(&WorkerDecoder);
+      delete stream;
+      WorkerDecoder.fp = NULL;
+   }
+}
+
+void CDAccess_PBP::StopWorker(void)
+{
+   if (!Worker)
+      return;
+
+   PBP_LOCK();
+   WorkerExit = true;
+   scond_broadcast(WorkCond);
+   PBP_UNLOCK();
+
+   sthread_join(Worker);
+   Worker = NULL;
+
+   FreeDecoder(&WorkerDecoder);
+   delete WorkerDecoder.fp;
+   WorkerDecoder.fp = NULL;
+
+   WorkQueue.clear();
+}
+#endif
+
+// Returns a free or the least recently used slot for block, called with
+// BlockLock held.
+int32_t CDAccess_PBP::AllocBlockSlot(int32_t block)
+{
+   PBP_Block_Slot *s;
+   int32_t ret = -1;
+
+   for (size_t i = 0; i < BlockSlots.size(); i++)
+   {
+      s = &BlockSlots[i];
+
+      if (s->pending)
+         continue;
+
+      if (s->block < 0)
+      {
+         ret = i;
+         break;
+      }
+
+      if (ret < 0 || (BlockClock - s->last_use) > (BlockClock - BlockSlots[ret].last_use))
+         ret = i;
+   }
+
+   if (ret < 0)
+      return -1;
+
+   s = &BlockSlots[ret];
+
+   if (!s->data && !(s->data = (uint8_t*)malloc(PBP_BLOCK_SIZE)))
+      return -1;
+
+   if (s->block >= 0)
+      BlockSlotIndex[s->block] = -1;
+
+   s->block             = block;
+   s->last_use          = BlockClock;
+   BlockSlotIndex[block] = ret;
+
+   return ret;
+}
+
+// Queues the blocks following block for the worker, called with BlockLock
+// held.
+void CDAccess_PBP::PrefetchBlocks(int32_t block)
+{
+#ifdef HAVE_THREADS
+   bool queued = false;
+
+   if (!Worker)
+      return;
+
+   for (int32_t next = block + 1; next <= block + PBP_PREFETCH_BLOCKS; next++)
+   {
+      int32_t idx;
+
+      if (next >= (int32_t)index_len)
+         break;
+
+      if (BlockSlotIndex[next] >= 0)
+         continue;
+
+      if ((idx = AllocBlockSlot(next)) < 0)
+         break;
+
+      // Older than the block being read, so that it's not evicted first
+      BlockSlots[idx].last_use = BlockClock - 1;
+      BlockSlots[idx].pending  = true;
+      WorkQueue.push_back(idx);
+      queued = true;
+   }
+
+   if (queued)
+      scond_broadcast(WorkCond);
+#endif
+}
+
+// Drops the queued prefetches, called with BlockLock held.
+void CDAccess_PBP::CancelPrefetches(void)
+{
+#ifdef HAVE_THREADS
+   for (size_t i = 0; i < WorkQueue.size(); i++)
+   {
+      PBP_Block_Slot *s = &BlockSlots[WorkQueue[i]];
+
+      BlockSlotIndex[s->block] = -1;
+      s->block   = -1;
+      s->pending = false;
+   }
+
+   WorkQueue.clear();
+#endif
+}
+
+// Empties the cache before the index table changes.
+void CDAccess_PBP::DropBlocks(void)
+{
+   PBP_LOCK();
+
+   CancelPrefetches();
+
+#ifdef HAVE_THREADS
+   // Wait for the block the worker is on
+   for (;;)
+   {
+      bool busy = false;
+
+      for (size_t i = 0; i < BlockSlots.size(); i++)
+         busy |= BlockSlots[i].pending;
+
+      if (!busy)
+         break;
+
+      scond_wait(ReadyCond, BlockLock);
+   }
+#endif
+
+   for (size_t i = 0; i < BlockSlots.size(); i++)
+      BlockSlots[i].block = -1;
+
+   BlockSlotIndex.clear();
+   oldblock    = -1;
+   oldblockmem = NULL;
+
+   PBP_UNLOCK();
+}
+
+// Returns the decompressed block, NULL on error. The data stays valid until
+// the next call.
+const uint8_t *CDAccess_PBP::ReadBlock(int32_t block)
+{
+   PBP_Block_Slot *s;
+   int32_t idx;
+   bool ok;
+
+   PBP_LOCK();
+
+   BlockClock++;
+   idx = BlockSlotIndex[block];
+
+#ifdef HAVE_THREADS
+   if (idx >= 0 && BlockSlots[idx].pending)
+   {
+      std::vector<int32_t>::iterator queued = std::find(WorkQueue.begin(), WorkQueue.end(), idx);
+
+      // Not started yet, it's quicker to read it here than to wait for the
+      // prefetches queued before it
+      if (queued != WorkQueue.end())
+         WorkQueue.erase(queued);
+      else
+      {
+         // Prefetched, wait for the worker to be done with it
+         while (idx >= 0 && BlockSlots[idx].pending)
+         {
+            scond_wait(ReadyCond, BlockLock);
+            idx = BlockSlotIndex[block];
+         }
+      }
+   }
+#endif
+
+   if (idx >= 0 && !BlockSlots[idx].pending)
+   {
+      s           = &BlockSlots[idx];
+      s->last_use = BlockClock;
+      PrefetchBlocks(block);
+      PBP_UNLOCK();
+
+      return s->data;
+   }
+
+   if (idx < 0)
+   {
+      // Seeking elsewhere, the prefetches not started yet are of no use
+      CancelPrefetches();
+
+      if ((idx = AllocBlockSlot(block)) < 0)
+      {
+         PBP_UNLOCK();
+         return NULL;
+      }
+   }
+
+   s           = &BlockSlots[idx];
+   s->last_use = BlockClock;
+   s->pending  = true;
+   PrefetchBlocks(block);
+   PBP_UNLOCK();
+
+   ok = FillBlock(&MainDecoder, block, s->data);
+
+   PBP_LOCK();
+   s->pending = false;
+   if (!ok)
+   {
+      BlockSlotIndex[block] = -1;
+      s->block = -1;
+      s = NULL;
+   }
+   PBP_UNLOCK();
+
+   return s ? s->data : NULL;
+}
+
+// Opens or starts the decompressed cache of the current disc. It's only
+// valid for the index table it was written with.
+void CDAccess_PBP::OpenDiskCache(void)
+{
+   uint8_t header[PBP_DISK_CACHE_HEADER];
+   std::string path = disk_cache_base;
+   uint32_t key;
+
+   if (index_len == 0)
+      return;
+
+   if (PBP_DiscCount > 1)
+   {
+      char disc[16];
+
+      snprintf(disc, sizeof(disc), "_%d", CD_SelectedDisc + 1);
+      path += disc;
+   }
+   path += ".pbpcache";
+
+   key = crc32(0, (const Bytef*)index_table, (index_len + 1) * sizeof(*index_table));
+   key = crc32(key, (const Bytef*)&is_official, sizeof(is_official));
+
+   DiskCacheValid.assign(index_len, 0);
+
+   DiskCache = filestream_open(path.c_str(),
+         RETRO_VFS_FILE_ACCESS_READ_WRITE | RETRO_VFS_FILE_ACCESS_UPDATE_EXISTING,
+         RETRO_VFS_FILE_ACCESS_HINT_NONE);
+
+   if (DiskCache &&
+         filestream_read(DiskCache, header, sizeof(header)) == sizeof(header) &&
+         !memcmp(header, "PBPCACHE", 8) &&
+         MDFN_de32lsb<false>(header + 8)  == PBP_DISK_CACHE_VERSION &&
+         MDFN_de32lsb<false>(header + 12) == index_len &&
+         MDFN_de32lsb<false>(header + 16) == key &&
+         filestream_read(DiskCache, &DiskCacheValid[0], index_len) == index_len)
+   {
+      log_cb(RETRO_LOG_INFO, "[PBP] Using decompressed cache %s\n", path.c_str());
+      return;
+   }
+
+   // Missing, or written for another image
+   if (DiskCache)
+      filestream_close(DiskCache);
+
+   DiskCacheValid.assign(index_len, 0);
+
+   DiskCache = filestream_open(path.c_str(), RETRO_VFS_FILE_ACCESS_READ_WRITE,
+         RETRO_VFS_FILE_ACCESS_HINT_NONE);
+
+   if (!DiskCache)
+   {
+      log_cb(RETRO_LOG_WARN, "[PBP] Unable to create decompressed cache %s\n", path.c_str());
+      return;
+   }
+
+   memset(header, 0, sizeof(header));
+   memcpy(header, "PBPCACHE", 8);
+   MDFN_en32lsb<false>(header + 8,  PBP_DISK_CACHE_VERSION);
+   MDFN_en32lsb<false>(header + 12, index_len);
+   MDFN_en32lsb<false>(header + 16, key);
+
+   if (filestream_write(DiskCache, header, sizeof(header)) != sizeof(header) ||
+         filestream_write(DiskCache, &DiskCacheValid[0], index_len) != index_len)
+   {
+      log_cb(RETRO_LOG_WARN, "[PBP] Unable to write decompressed cache %s\n", path.c_str());
+      CloseDiskCache();
+      return;
+   }
+
+   log_cb(RETRO_LOG_INFO, "[PBP] Created decompressed cache %s\n", path.c_str());
+}
+
+void CDAccess_PBP::CloseDiskCache(void)
+{
+   if (DiskCache)
+      filestream_close(DiskCache);
+
+   DiskCache = NULL;
+   DiskCacheValid.clear();
+}
+
+// Blocks are stored after the header and the written flags, one flag byte
+// per block.
+static int64_t DiskCacheBlockOffset(uint32_t index_len, int32_t block)
+{
+   int64_t data_start = (PBP_DISK_CACHE_HEADER + index_len + 4095) & ~4095;
+
+   return data_start + (int64_t)block * PBP_BLOCK_SIZE;
+}
+
+bool CDAccess_PBP::ReadDiskCache(int32_t block, uint8_t *out)
+{
+   bool ret = false;
+
+   DISK_CACHE_LOCK();
+
+   if (DiskCache && DiskCacheValid[block])
+   {
+      filestream_seek(DiskCache, DiskCacheBlockOffset(index_len, block), RETRO_VFS_SEEK_POSITION_START);
+      ret = filestream_read(DiskCache, out, PBP_BLOCK_SIZE) == PBP_BLOCK_SIZE;
+   }
+
+   DISK_CACHE_UNLOCK();
+
+   return ret;
+}
+
+void CDAccess_PBP::WriteDiskCache(int32_t block, const uint8_t *data)
+{
+   static const uint8_t written = 1;
+
+   DISK_CACHE_LOCK();
+
+   if (DiskCache && !DiskCacheValid[block])
+   {
+      // The data goes first, so that an interrupted write leaves the block
+      // marked as missing
+      filestream_seek(DiskCache, DiskCacheBlockOffset(index_len, block), RETRO_VFS_SEEK_POSITION_START);
+      if (filestream_write(DiskCache, data, PBP_BLOCK_SIZE) == PBP_BLOCK_SIZE)
+      {
+         filestream_seek(DiskCache, PBP_DISK_CACHE_HEADER + block, RETRO_VFS_SEEK_POSITION_START);
+         if (filestream_write(DiskCache, &written, 1) == 1)
+            DiskCacheValid[block] = 1;
+      }
+
+      if (!DiskCacheValid[block])
+      {
+         // Disk full or similar, stop there
+         log_cb(RETRO_LOG_WARN, "[PBP] Unable to write decompressed cache, disabling it\n");
+         CloseDiskCache();
+      }
+   }
+
+   DISK_CACHE_UNLOCK();
+}
+
+bool CDAccess_PBP::Read_Raw_Sector(uint8 *buf, int32 lba)
+{
+   uint8_t SimuQ[0xC];
+
+   int32_t block = lba >> 4;
+
+   memset(buf + 2352, 0, 96);
+   MakeSubPQ(lba, buf + 2352);
+   subq_deinterleave(buf + 2352, SimuQ);
+
+   if (lba < 0 || block >= (int32_t)index_len)
+   {
+      log_cb(RETRO_LOG_ERROR, "[PBP] sector %d is past img end\n", lba);
+      return false;
+   }
+
+   /* each block holds 16 sectors, optimize when reading contiguous sectors */
+   if (block != oldblock)
+   {
+      oldblockmem = ReadBlock(block);
+      if (!oldblockmem)
+      {
+         oldblock = -1;
+         return false;
+      }
+
+      oldblock = block;
+   }
+
+   memcpy(buf, oldblockmem + (lba & 0xf) * 2352, 2352);
 
    return true;
 }
@@ -496,6 +1055,11 @@ bool CDAccess_PBP::Read_TOC(TOC *toc)
    TOC_Clear(toc);
    memset(Tracks, 0, sizeof(Tracks));
 
+   // The blocks cached so far may be of another disc
+   DropBlocks();
+   CloseDiskCache();
+   index_len = 0;
+
    fp->seek(psisoimg_offset + 0x400, SEEK_SET);
    fp->read(iso_header, 0xB6600);
    if(iso_header[0] == 0 && iso_header[1] == 'P' && iso_header[2] == 'G' && iso_header[3] == 'D')
@@ -616,8 +1180,6 @@ bool CDAccess_PBP::Read_TOC(TOC *toc)
    read_offset = index_table_offset;
 
    // set class variables
-   fixed_sectors = 0;
-   current_block = (uint32_t)-1;
    index_len = 0xAFC80 / sizeof(index_entry);   // disc map table has a fixed size of 0xAFC80 (22500 entries)?
 
    if(index_table != NULL)
@@ -644,6 +1206,11 @@ bool CDAccess_PBP::Read_TOC(TOC *toc)
       index_table[i] = cdimg_base + index_entry.offset;
    }
    index_table[i] = cdimg_base + index_entry.offset + index_entry.size;
+   index_len = i;
+
+   BlockSlotIndex.assign(index_len, -1);
+   if (cd_pbp_disk_cache)
+      OpenDiskCache();
 
    toc->tracks[100].lba = total_sectors;
    toc->tracks[100].adr = ADR_CURPOS;
@@ -4,9 +4,37 @@
 #include <boolean.h>
 
 #include <map>
+#include <vector>
 #include "CDAccess_Image.h"
 
+#include <streams/file_stream.h>
+
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
 class Stream;
+struct z_stream_s;
+
+// Keep the decompressed blocks in a file in the save directory, set from the
+// core options
+extern bool cd_pbp_disk_cache;
+
+struct PBP_Block_Slot
+{
+   int32_t block;       // -1 when free
+   uint32_t last_use;
+   bool pending;        // Queued or being decompressed by the worker
+   uint8_t *data;       // 16 sectors
+};
+
+// What a thread needs to read and decompress blocks
+struct PBP_Decoder
+{
+   Stream *fp;          // NULL when the image is in memory
+   struct z_stream_s *z;
+   uint8_t compressed[2352 * 16];
+};
 
 class CDAccess_PBP : public CDAccess
 {
@@ -41,14 +69,57 @@ class CDAccess_PBP : public CDAccess
       uint32_t pbp_file_offsets[PBP_NUM_FILES];
 
       ////////////////
-      uint8_t buff_raw[16][2352];
-      uint8_t buff_compressed[2352 * 16];
       uint32_t *index_table;
       uint32_t index_len;
-      uint32_t current_block;
-      uint32_t sector_in_blk;
       ////////////////
 
+      /* LRU cache of decompressed blocks, the next blocks are decompressed
+       * in advance by a worker thread when available */
+      std::vector<PBP_Block_Slot> BlockSlots;
+      std::vector<int32_t> BlockSlotIndex;   /* By block, -1 if not cached */
+      uint32_t BlockClock;
+      PBP_Decoder MainDecoder;
+      /* last block read and its data */
+      int32_t oldblock;
+      const uint8_t *oldblockmem;
+
+      /* Decompressed blocks of the current disc on disk, and which of them
+       * were written */
+      RFILE *DiskCache;
+      std::vector<uint8_t> DiskCacheValid;
+      std::string disk_cache_base;   /* Path without the disc number and extension */
+
+      const uint8_t *ReadBlock(int32_t block);
+      bool FillBlock(PBP_Decoder *dec, int32_t block, uint8_t *out);
+      int32_t AllocBlockSlot(int32_t block);
+      void PrefetchBlocks(int32_t block);
+      void CancelPrefetches(void);
+      void DropBlocks(void);
+      bool InitDecoder(PBP_Decoder *dec, Stream *stream);
+      void FreeDecoder(PBP_Decoder *dec);
+
+      void OpenDiskCache(void);
+      void CloseDiskCache(void);
+      bool ReadDiskCache(int32_t block, uint8_t *out);
+      void WriteDiskCache(int32_t block, const uint8_t *data);
+
+#ifdef HAVE_THREADS
+      std::string image_path;
+      PBP_Decoder WorkerDecoder;
+      sthread_t *Worker;
+      slock_t *BlockLock;
+      slock_t *DiskCacheLock;
+      scond_t *WorkCond;    /* Prefetch queued, or exiting */
+      scond_t *ReadyCond;   /* Prefetched block ready */
+      std::vector<int32_t> WorkQueue;   /* Slots to fill */
+      bool WorkerExit;
+
+      static void WorkerEntry(void *arg);
+      void WorkerLoop(void);
+      void StartWorker(void);
+      void StopWorker(void);
+#endif
+
       int32_t NumTracks;
       int32_t FirstTrack;
       int32_t LastTrack;
@@ -59,7 +130,6 @@ class CDAccess_PBP : public CDAccess
       uint32_t discs_start_offset[5];
       uint32_t psisoimg_offset;
 
-      uint16_t fixed_sectors;
       bool is_official;    // TODO: find more consistent ways to check for used compression algorithm, compressed (and/or encrypted?) audio tracks and messed up sectors
 
       bool ImageOpen(const char *path, bool image_memcache);
@@ -74,7 +144,7 @@ class CDAccess_PBP : public CDAccess
       std::map<uint32, cpp11_array_doodad> SubQReplaceMap;
       void MakeSubPQ(int32 lba, uint8 *SubPWBuf);
 
-      int decompress2(void *out, uint32_t *out_size, void *in, uint32_t in_size);
+      int decompress2(struct z_stream_s *z, void *out, uint32_t *out_size, void *in, uint32_t in_size);
 
       int decode_range(unsigned int *range, unsigned int *code, unsigned char **src);
       int decode_bit(unsigned int *range, unsigned int *code, int *index, unsigned char **src, unsigned char *c);
@@ -28,10 +28,12 @@
 #include <boolean.h>
 #include <rthreads/rthreads.h>
 #include <retro_miscellaneous.h>
+#include <retro_timers.h>
 
 #include <libretro.h>
 
 extern retro_log_printf_t log_cb;
+extern struct retro_perf_callback perf_cb;
 
 enum
 {
@@ -42,7 +44,7 @@ enum
 
    // Command messages.
    CDIF_MSG_DIEDIEDIE,
-   CDIF_MSG_READ_SECTOR,
+   CDIF_MSG_HINTS,   // Wakes up the read thread to process HintRing
    CDIF_MSG_EJECT
 };
 
@@ -63,6 +65,36 @@ class CDIF_Message
 
 #if HAVE_THREADS
 
+// MemoryBarrier() comes with the windows.h/xtl.h retro_timers.h includes
+#ifdef _MSC_VER
+#define CDIF_Barrier() MemoryBarrier()
+#else
+#define CDIF_Barrier() __sync_synchronize()
+#endif
+
+// Words shared between the emu and read threads. std::atomic would need
+// C++11, which not every platform built with threads has, so they're
+// volatile and ordered with full barriers: a load is at least an acquire,
+// a store at least a release, and a store followed by a load of another
+// word is never reordered.
+template<typename T> static INLINE T CDIF_AtomicLoad(const volatile T *p)
+{
+   T v;
+
+   CDIF_Barrier();
+   v = *p;
+   CDIF_Barrier();
+
+   return v;
+}
+
+template<typename T> static INLINE void CDIF_AtomicStore(volatile T *p, T v)
+{
+   CDIF_Barrier();
+   *p = v;
+   CDIF_Barrier();
+}
+
 class CDIF_Queue
 {
    public:
@@ -81,14 +113,30 @@ class CDIF_Queue
 };
 
 
+// Sectors are only ever written by the read thread. seq is odd while it
+// fills the buffer and is bumped again once it's done, the emu thread
+// copies a sector out without locking and retries if seq changed meanwhile.
 typedef struct
 {
-   bool valid;
+   volatile uint32 seq;
+   volatile uint32 lba;   // ~0U when empty
    bool error;
-   uint32 lba;
    uint8 data[2352 + 96];
 } CDIF_Sector_Buffer;
 
+// A run of sectors being read ahead. Hints continuing a stream, possibly a
+// few sectors further, extend it and any other hint starts a new one in
+// place of the least recently used, so that a game streaming audio or video
+// from one place of the disc while loading data from another doesn't have
+// the read-ahead start over on every switch.
+typedef struct
+{
+   uint32 last_lba;   // Last sector hinted, ~0U when unused
+   uint32 ra_lba;     // Next sector to read
+   int ra_count;      // Sectors left to read
+   uint32 last_use;
+} CDIF_RA_Stream;
+
 /* TODO: prohibit copy constructor */
 class CDIF_MT : public CDIF
 {
@@ -98,6 +146,7 @@ class CDIF_MT : public CDIF
       virtual ~CDIF_MT();
 
       virtual void HintReadSector(uint32 lba);
+      virtual void HintSeek(uint32 lba);
       virtual bool ReadRawSector(uint8 *buf, uint32 lba, int64 timeout_us);
       virtual bool ReadRawSectorPWOnly(uint8 *buf, uint32 lba, bool hint_fullread);
 
@@ -120,22 +169,52 @@ class CDIF_MT : public CDIF
       CDIF_Queue EmuThreadQueue;
 
 
+      // Sector LBA is kept in SectorBuffers[LBA % SBSize]
       enum { SBSize = 256 };
       CDIF_Sector_Buffer SectorBuffers[SBSize];
 
-      uint32 SBWritePos;
-
+      // Only used by the emu thread to sleep on a sector not read yet
       slock_t *SBMutex;
       scond_t *SBCond;
+      volatile bool SBWaiting;
+
+      bool TryReadSector(uint8 *buf, uint32 lba, bool *error_condition);
+
+      // Sectors wanted by the emu thread, in order, for the read-ahead.
+      // Single producer (emu thread), single consumer (read thread).
+      enum { HintRingSize = 256 };
+      uint32 HintRing[HintRingSize];
+      volatile uint32 HintWritePos;
+      volatile uint32 HintReadPos;
+
+      // Set on the LBA of hints from HintSeek()
+      static const uint32 HintSeekFlag = 0x80000000U;
+
+      // Set by the read thread before it blocks on ReadThreadQueue
+      volatile bool RT_Idle;
+
+      void PushHint(uint32 lba);
 
       //
       // Read-thread-only:
       //
       bool RT_EjectDisc(bool eject_status, bool skip_actual_eject = false);
-
-      uint32 ra_lba;
-      int ra_count;
-      uint32 last_read_lba;
+      void RT_ClearSectors(void);
+      void RT_Hint(uint32 hint);
+      void RT_ReadSector(uint32 lba);
+
+      enum { RA_StreamCount = 4 };
+      CDIF_RA_Stream RA_Streams[RA_StreamCount];
+      uint32 RA_Clock;
+
+      // Average time Read_Raw_Sector() takes, in microseconds * 16
+      uint32 RA_ReadTime;
+
+      void RT_ResetStreams(void);
+      int RT_Window(void);
+      CDIF_RA_Stream *RT_FindStream(uint32 lba, int window);
+      CDIF_RA_Stream *RT_NewStream(uint32 lba);
+      CDIF_RA_Stream *RT_NextStream(void);
 };
 
 #endif /* HAVE_THREAD */
@@ -149,6 +228,7 @@ class CDIF_ST : public CDIF
       virtual ~CDIF_ST();
 
       virtual void HintReadSector(uint32 lba);
+      virtual void HintSeek(uint32 lba);
       virtual bool ReadRawSector(uint8 *buf, uint32 lba, int64 timeout_us);
       virtual bool ReadRawSectorPWOnly(uint8 *buf, uint32 lba, bool hint_fullread);
       virtual bool Eject(bool eject_status);
@@ -276,16 +356,217 @@ bool CDIF_MT::RT_EjectDisc(bool eject_status, bool skip_actual_eject)
          }
       }
 
-      SBWritePos = 0;
-      ra_lba = 0;
-      ra_count = 0;
-      last_read_lba = ~0U;
-      memset(SectorBuffers, 0, SBSize * sizeof(CDIF_Sector_Buffer));
+      RT_ResetStreams();
+      RT_ClearSectors();
    }
 
    return true;
 }
 
+// The emu thread waits for the eject to complete, no sector is being
+// read concurrently.
+void CDIF_MT::RT_ClearSectors(void)
+{
+   unsigned i;
+
+   for(i = 0; i < SBSize; i++)
+   {
+      SectorBuffers[i].lba   = ~0U;
+      SectorBuffers[i].error = false;
+   }
+}
+
+void CDIF_MT::RT_ResetStreams(void)
+{
+   unsigned i;
+
+   for(i = 0; i < RA_StreamCount; i++)
+   {
+      RA_Streams[i].last_lba = ~0U;
+      RA_Streams[i].ra_lba   = 0;
+      RA_Streams[i].ra_count = 0;
+      RA_Streams[i].last_use = 0;
+   }
+
+   RA_Clock = 0;
+}
+
+// How far ahead of the emu thread a stream is read. It grows by 16 sectors
+// for each millisecond a sector takes to read, so that slow storage (network
+// shares, spun down disks) still has enough sectors read in advance.
+int CDIF_MT::RT_Window(void)
+{
+   static const int min_ra = 16;
+   static const int max_ra = SBSize / 4 - 1;
+   int window = min_ra + (int)((RA_ReadTime >> 4) * min_ra / 1000);
+
+   return MIN(window, max_ra);
+}
+
+// Returns the stream lba continues, if any
+CDIF_RA_Stream *CDIF_MT::RT_FindStream(uint32 lba, int window)
+{
+   CDIF_RA_Stream *ret = NULL;
+   unsigned i;
+
+   for(i = 0; i < RA_StreamCount; i++)
+   {
+      CDIF_RA_Stream *s = &RA_Streams[i];
+
+      if(s->last_lba == ~0U || (lba - s->last_lba) > (uint32)window)
+         continue;
+
+      if(!ret || (lba - s->last_lba) < (lba - ret->last_lba))
+         ret = s;
+   }
+
+   return ret;
+}
+
+CDIF_RA_Stream *CDIF_MT::RT_NewStream(uint32 lba)
+{
+   CDIF_RA_Stream *ret = &RA_Streams[0];
+   unsigned i;
+
+   for(i = 1; i < RA_StreamCount && ret->last_lba != ~0U; i++)
+   {
+      CDIF_RA_Stream *s = &RA_Streams[i];
+
+      if(s->last_lba == ~0U || (RA_Clock - s->last_use) > (RA_Clock - ret->last_use))
+         ret = s;
+   }
+
+   ret->last_lba = lba;
+   ret->ra_lba   = lba;
+   ret->ra_count = 0;
+
+   return ret;
+}
+
+// Returns the stream to read the next sector of, the one the emu thread is
+// the closest to catching up with. NULL if there's nothing to read.
+CDIF_RA_Stream *CDIF_MT::RT_NextStream(void)
+{
+   CDIF_RA_Stream *ret = NULL;
+   unsigned i;
+
+   for(i = 0; i < RA_StreamCount; i++)
+   {
+      CDIF_RA_Stream *s = &RA_Streams[i];
+
+      // Don't read >= the "end" of the disc, silly snake.  Slither.
+      if(s->ra_count && s->ra_lba >= disc_toc.tracks[100].lba)
+         s->ra_count = 0;
+
+      if(!s->ra_count)
+         continue;
+
+      if(!ret || (s->ra_lba - s->last_lba) < (ret->ra_lba - ret->last_lba) ||
+            ((s->ra_lba - s->last_lba) == (ret->ra_lba - ret->last_lba) &&
+             (RA_Clock - s->last_use) < (RA_Clock - ret->last_use)))
+         ret = s;
+   }
+
+   return ret;
+}
+
+void CDIF_MT::RT_Hint(uint32 hint)
+{
+   static const int   initial_ra = 1;
+   static const int speedmult_ra = 2;
+   uint32 new_lba    = hint & ~HintSeekFlag;
+   int window        = RT_Window();
+   CDIF_RA_Stream *s = RT_FindStream(new_lba, window);
+
+   assert(window < (SBSize / 4));
+
+   RA_Clock++;
+
+   if(hint & HintSeekFlag)
+   {
+      // The drive will seek there, read the first sectors while it does
+      if(!s || (int32)(new_lba - (s->ra_lba + s->ra_count)) >= 0)
+      {
+         s = RT_NewStream(new_lba);
+         s->ra_count = window / 4;
+      }
+   }
+   else if(!s)
+   {
+      s = RT_NewStream(new_lba);
+      s->ra_count = initial_ra;
+   }
+   else if(new_lba != s->last_lba)
+   {
+      int how_far_ahead;
+
+      // Hints are processed in batches, the emu thread may have
+      // moved past the read-ahead position meanwhile.
+      if((int32)(s->ra_lba - new_lba) < 0)
+         s->ra_lba = new_lba;
+
+      how_far_ahead = s->ra_lba - new_lba;
+
+      if(how_far_ahead <= window)
+         s->ra_count = MIN(speedmult_ra, 1 + window - how_far_ahead);
+      else
+         s->ra_count++;
+
+      s->last_lba = new_lba;
+   }
+
+   // The sector may have been read already and replaced by one of another
+   // stream since, the emu thread would then wait on it forever.
+   if(!(hint & HintSeekFlag) && SectorBuffers[new_lba % SBSize].lba != new_lba &&
+         (new_lba - s->ra_lba) >= (uint32)s->ra_count)
+   {
+      s->ra_lba   = new_lba;
+      s->ra_count = MAX(s->ra_count, initial_ra);
+   }
+
+   s->last_use = RA_Clock;
+}
+
+void CDIF_MT::RT_ReadSector(uint32 lba)
+{
+   CDIF_Sector_Buffer *sb = &SectorBuffers[lba % SBSize];
+   uint32 seq             = sb->seq;
+
+   // Already read since the last seek away from it
+   if(sb->lba == lba && !sb->error)
+      return;
+
+   CDIF_AtomicStore(&sb->seq, seq + 1);
+
+   sb->lba   = lba;
+   sb->error = false;
+
+   // Without a timer the read-ahead window stays at its minimum
+   if(perf_cb.get_time_usec)
+   {
+      retro_time_t start = perf_cb.get_time_usec();
+      int64 us;
+
+      disc_cdaccess->Read_Raw_Sector(sb->data, lba);
+
+      us = perf_cb.get_time_usec() - start;
+      RA_ReadTime += (uint32)MIN(us, (int64)100000) - (RA_ReadTime >> 4);
+   }
+   else
+      disc_cdaccess->Read_Raw_Sector(sb->data, lba);
+
+   // Pairs with SBWaiting being set before the emu thread checks the
+   // sector one last time
+   CDIF_AtomicStore(&sb->seq, seq + 2);
+
+   if(CDIF_AtomicLoad(&SBWaiting))
+   {
+      slock_lock((slock_t*)SBMutex);
+      scond_signal((scond_t*)SBCond);
+      slock_unlock((slock_t*)SBMutex);
+   }
+}
+
 struct RTS_Args
 {
    CDIF_MT *cdif_ptr;
@@ -303,10 +584,8 @@ int CDIF_MT::ReadThreadStart()
    bool Running = true;
 
    DiscEjected = true;
-   SBWritePos = 0;
-   ra_lba = 0;
-   ra_count = 0;
-   last_read_lba = ~0U;
+   RA_ReadTime = 0;
+   RT_ResetStreams();
 
    RT_EjectDisc(false, true);
 
@@ -315,9 +594,31 @@ int CDIF_MT::ReadThreadStart()
    while(Running)
    {
       CDIF_Message msg;
+      CDIF_RA_Stream *s;
+      uint32 hint_pos = HintReadPos;
+      bool blocking;
+
+      while(hint_pos != CDIF_AtomicLoad(&HintWritePos))
+      {
+         RT_Hint(HintRing[hint_pos % HintRingSize]);
+         CDIF_AtomicStore(&HintReadPos, ++hint_pos);
+      }
 
       // Only do a blocking-wait for a message if we don't have any sectors to read-ahead.
-      if(ReadThreadQueue.Read(&msg, ra_count ? false : true))
+      blocking = !RT_NextStream();
+      if(blocking)
+      {
+         // Pairs with HintWritePos being updated before the emu thread
+         // checks RT_Idle
+         CDIF_AtomicStore(&RT_Idle, true);
+         if(hint_pos != CDIF_AtomicLoad(&HintWritePos))
+         {
+            CDIF_AtomicStore(&RT_Idle, false);
+            continue;
+         }
+      }
+
+      if(ReadThreadQueue.Read(&msg, blocking))
       {
          switch(msg.message)
          {
@@ -330,73 +631,38 @@ int CDIF_MT::ReadThreadStart()
                EmuThreadQueue.Write(CDIF_Message(CDIF_MSG_DONE));
                break;
 
-            case CDIF_MSG_READ_SECTOR:
-               {
-                  static const int       max_ra = 16;
-                  static const int   initial_ra = 1;
-                  static const int speedmult_ra = 2;
-                  uint32_t              new_lba = msg.args[0];
-
-                  assert((unsigned int)max_ra < (SBSize / 4));
-
-                  if(last_read_lba != ~0U && new_lba == (last_read_lba + 1))
-                  {
-                     int how_far_ahead = ra_lba - new_lba;
-
-                     if(how_far_ahead <= max_ra)
-                        ra_count = MIN(speedmult_ra, 1 + max_ra - how_far_ahead);
-                     else
-                        ra_count++;
-                  }
-                  else if(new_lba != last_read_lba)
-                  {
-                     ra_lba = new_lba;
-                     ra_count = initial_ra;
-                  }
-
-                  last_read_lba = new_lba;
-               }
+            case CDIF_MSG_HINTS:
                break;
          }
       }
 
-      // Don't read >= the "end" of the disc, silly snake.  Slither.
-      if(ra_count && ra_lba == disc_toc.tracks[100].lba)
-      {
-         ra_count = 0;
-         //printf("Ephemeral scarabs: %d!\n", ra_lba);
-      }
+      if(blocking)
+         CDIF_AtomicStore(&RT_Idle, false);
 
-      if(ra_count)
+      if((s = RT_NextStream()))
       {
-         uint8_t tmpbuf[2352 + 96];
-         bool error_condition = false;
-
-         disc_cdaccess->Read_Raw_Sector(tmpbuf, ra_lba);
-
-         slock_lock((slock_t*)SBMutex);
+         RT_ReadSector(s->ra_lba);
 
-         SectorBuffers[SBWritePos].lba = ra_lba;
-         memcpy(SectorBuffers[SBWritePos].data, tmpbuf, 2352 + 96);
-         SectorBuffers[SBWritePos].valid = true;
-         SectorBuffers[SBWritePos].error = error_condition;
-         SBWritePos = (SBWritePos + 1) % SBSize;
-
-         scond_signal((scond_t*)SBCond);
-         slock_unlock((slock_t*)SBMutex);
-
-         ra_lba++;
-         ra_count--;
+         s->ra_lba++;
+         s->ra_count--;
       }
    }
 
    return(1);
 }
 
-CDIF_MT::CDIF_MT(CDAccess *cda) : disc_cdaccess(cda), CDReadThread(NULL), SBMutex(NULL), SBCond(NULL)
+CDIF_MT::CDIF_MT(CDAccess *cda) : disc_cdaccess(cda), CDReadThread(NULL), SBMutex(NULL), SBCond(NULL),
+   SBWaiting(false), HintWritePos(0), HintReadPos(0), RT_Idle(false)
 {
    CDIF_Message msg;
    RTS_Args s;
+   unsigned i;
+
+   for(i = 0; i < SBSize; i++)
+   {
+      SectorBuffers[i].seq = 0;
+      SectorBuffers[i].lba = ~0U;
+   }
 
    SBMutex            = slock_new();
    SBCond             = scond_new();
@@ -431,9 +697,44 @@ CDIF_MT::~CDIF_MT()
    }
 }
 
+// Copies the sector out of SectorBuffers if the read thread has read it
+bool CDIF_MT::TryReadSector(uint8 *buf, uint32 lba, bool *error_condition)
+{
+   CDIF_Sector_Buffer *sb = &SectorBuffers[lba % SBSize];
+
+   for(;;)
+   {
+      uint32 seq = CDIF_AtomicLoad(&sb->seq);
+
+      if((seq & 1) || sb->lba != lba)
+         return false;
+
+      *error_condition = sb->error;
+      memcpy(buf, sb->data, 2352 + 96);
+
+      if(CDIF_AtomicLoad(&sb->seq) == seq)
+         return true;
+   }
+}
+
+void CDIF_MT::PushHint(uint32 lba)
+{
+   uint32 pos = HintWritePos;
+
+   // The read thread drains the ring between sectors, it can only be
+   // full if reading the disc stalls
+   while(pos - CDIF_AtomicLoad(&HintReadPos) >= HintRingSize)
+      retro_sleep(1);
+
+   HintRing[pos % HintRingSize] = lba;
+   CDIF_AtomicStore(&HintWritePos, pos + 1);
+
+   if(CDIF_AtomicLoad(&RT_Idle))
+      ReadThreadQueue.Write(CDIF_Message(CDIF_MSG_HINTS));
+}
+
 bool CDIF_MT::ReadRawSector(uint8 *buf, uint32 lba, int64 timeout_us)
 {
-   bool found = false;
    bool error_condition = false;
 
    if(UnrecoverableError)
@@ -450,38 +751,50 @@ bool CDIF_MT::ReadRawSector(uint8 *buf, uint32 lba, int64 timeout_us)
       return(false);
    }
 
-   ReadThreadQueue.Write(CDIF_Message(CDIF_MSG_READ_SECTOR, lba));
+   PushHint(lba);
+
+   if(TryReadSector(buf, lba, &error_condition))
+      return(!error_condition);
+
+   if(timeout_us == 0)
+   {
+      memset(buf, 0, 2352 + 96);
+      return(false);
+   }
 
    slock_lock((slock_t*)SBMutex);
 
-   do
+   // Pairs with the sequence number of the sector being updated before
+   // the read thread checks SBWaiting
+   CDIF_AtomicStore(&SBWaiting, true);
+
+   while(!TryReadSector(buf, lba, &error_condition))
    {
-      int i;
-      for(i = 0; i < SBSize; i++)
+      if (timeout_us >= 0)
       {
-         if(SectorBuffers[i].valid && SectorBuffers[i].lba == lba)
+         if (!scond_wait_timeout((scond_t*)SBCond, (slock_t*)SBMutex, timeout_us))
          {
-            error_condition = SectorBuffers[i].error;
-            memcpy(buf, SectorBuffers[i].data, 2352 + 96);
-            found = true;
+            error_condition = true;
+            memset(buf, 0, 2352 + 96);
+            break;
          }
       }
-
-      if(!found)
+      else
+         scond_wait((scond_t*)SBCond, (slock_t*)SBMutex);
+
+      // Another stream may have read a sector into the same buffer after
+      // this one was read but before it was copied out, and nothing would
+      // read it again. The read thread takes SBMutex to wake us up, so
+      // don't hold it while the hint ring may be full.
+      if(SectorBuffers[lba % SBSize].lba != lba)
       {
-         if (timeout_us >= 0)
-         {
-            if (!scond_wait_timeout((scond_t*)SBCond, (slock_t*)SBMutex, timeout_us))
-            {
-               error_condition = true;
-               memset(buf, 0, 2352 + 96);
-               break;
-            }
-         }
-         else
-            scond_wait((scond_t*)SBCond, (slock_t*)SBMutex);
+         slock_unlock((slock_t*)SBMutex);
+         PushHint(lba);
+         slock_lock((slock_t*)SBMutex);
       }
-   } while(!found);
+   }
+
+   CDIF_AtomicStore(&SBWaiting, false);
 
    slock_unlock((slock_t*)SBMutex);
 
@@ -518,7 +831,15 @@ void CDIF_MT::HintReadSector(uint32 lba)
    if(UnrecoverableError)
       return;
 
-   ReadThreadQueue.Write(CDIF_Message(CDIF_MSG_READ_SECTOR, lba));
+   PushHint(lba);
+}
+
+void CDIF_MT::HintSeek(uint32 lba)
+{
+   if(UnrecoverableError || lba >= disc_toc.tracks[100].lba)
+      return;
+
+   PushHint(lba | HintSeekFlag);
 }
 
 bool CDIF_MT::Eject(bool eject_status)
@@ -624,6 +945,10 @@ void CDIF_ST::HintReadSector(uint32 lba)
    /* TODO: disc_cdaccess seek hint? (probably not, would require asynchronousitycamel) */
 }
 
+void CDIF_ST::HintSeek(uint32 lba)
+{
+}
+
 bool CDIF_ST::ReadRawSector(uint8 *buf, uint32 lba, int64 timeout_us)
 {
    if(UnrecoverableError)
@@ -38,6 +38,8 @@ class CDIF
       }
 
       virtual void HintReadSector(uint32_t lba) = 0;
+      // The emulated drive is about to seek to lba, lets the read-ahead start early.
+      virtual void HintSeek(uint32_t lba) = 0;
       virtual bool ReadRawSector(uint8_t *buf, uint32_t lba, int64_t timeout_us = -1) = 0;
       virtual bool ReadRawSectorPWOnly(uint8_t *buf, uint32_t lba, bool hint_fullread) = 0;
 
@@ -0,0 +1,152 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+/* mremap() */
+#define _GNU_SOURCE
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "largemem.h"
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define LARGEMEM_MMAP
+#elif defined(_WIN32) && !defined(_XBOX) && !defined(__WINRT__)
+#include <windows.h>
+#define LARGEMEM_WIN32
+#endif
+
+#if defined(LARGEMEM_MMAP)
+/* Mappings are sized and aligned to the huge page size of x86 and arm64
+ * so that they can be fully backed by huge pages */
+#define LARGEMEM_ALIGN ((size_t)2 * 1024 * 1024)
+
+static size_t MappedSize(size_t size)
+{
+   return (size + LARGEMEM_ALIGN - 1) & ~(LARGEMEM_ALIGN - 1);
+}
+
+static void *MapAligned(size_t size, bool huge_pages)
+{
+   size_t len = MappedSize(size);
+   uint8_t *base;
+   uint8_t *aligned;
+   size_t head;
+
+   /* Over-allocate by the alignment and trim both ends */
+   base = (uint8_t*)mmap(NULL, len + LARGEMEM_ALIGN, PROT_READ | PROT_WRITE,
+         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (base == (uint8_t*)MAP_FAILED)
+      return NULL;
+
+   aligned = (uint8_t*)(((uintptr_t)base + LARGEMEM_ALIGN - 1)
+         & ~(uintptr_t)(LARGEMEM_ALIGN - 1));
+   head    = aligned - base;
+
+   if (head)
+      munmap(base, head);
+   munmap(aligned + len, LARGEMEM_ALIGN - head);
+
+#ifdef MADV_HUGEPAGE
+   if (huge_pages)
+      madvise(aligned, len, MADV_HUGEPAGE);
+#endif
+
+   return aligned;
+}
+#elif defined(LARGEMEM_WIN32)
+#define LARGEMEM_PAGE ((size_t)4096)
+#endif
+
+void *MDFN_LargeAlloc(size_t size, bool huge_pages)
+{
+#if defined(LARGEMEM_MMAP)
+   return MapAligned(size, huge_pages);
+#elif defined(LARGEMEM_WIN32)
+   return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+   return calloc(1, size);
+#endif
+}
+
+void *MDFN_LargeResize(void *ptr, size_t old_size, size_t new_size)
+{
+#if defined(LARGEMEM_MMAP)
+   size_t old_len = MappedSize(old_size);
+   size_t new_len = MappedSize(new_size);
+   void *new_ptr;
+
+   if (new_len == old_len)
+      return ptr;
+
+   if (new_len < old_len)
+   {
+      munmap((uint8_t*)ptr + new_len, old_len - new_len);
+      return ptr;
+   }
+
+#ifdef __linux__
+   /* Moves the pages instead of copying them, the mapping keeps its
+    * huge page advice */
+   new_ptr = mremap(ptr, old_len, new_len, MREMAP_MAYMOVE);
+   if (new_ptr == MAP_FAILED)
+      return NULL;
+#else
+   new_ptr = MapAligned(new_size, false);
+   if (!new_ptr)
+      return NULL;
+
+   memcpy(new_ptr, ptr, old_size);
+   munmap(ptr, old_len);
+#endif
+
+   return new_ptr;
+#elif defined(LARGEMEM_WIN32)
+   void *new_ptr;
+
+   if (new_size <= old_size)
+   {
+      size_t keep = (new_size + LARGEMEM_PAGE - 1) & ~(LARGEMEM_PAGE - 1);
+
+      if (keep < old_size)
+         VirtualFree((uint8_t*)ptr + keep, old_size - keep, MEM_DECOMMIT);
+      return ptr;
+   }
+
+   new_ptr = MDFN_LargeAlloc(new_size, false);
+   if (!new_ptr)
+      return NULL;
+
+   memcpy(new_ptr, ptr, old_size);
+   MDFN_LargeFree(ptr, old_size);
+
+   return new_ptr;
+#else
+   return realloc(ptr, new_size);
+#endif
+}
+
+void MDFN_LargeClear(void *ptr, size_t size)
+{
+#if defined(LARGEMEM_MMAP) && defined(__linux__)
+   /* Private anonymous pages read back as zero once dropped */
+   if (madvise(ptr, MappedSize(size), MADV_DONTNEED) == 0)
+      return;
+#endif
+   memset(ptr, 0, size);
+}
+
+void MDFN_LargeFree(void *ptr, size_t size)
+{
+   if (!ptr)
+      return;
+
+#if defined(LARGEMEM_MMAP)
+   munmap(ptr, MappedSize(size));
+#elif defined(LARGEMEM_WIN32)
+   VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+   free(ptr);
+#endif
+}
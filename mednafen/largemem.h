@@ -0,0 +1,36 @@
+#ifndef _LARGEMEM_H
+#define _LARGEMEM_H
+
+#include <stddef.h>
+#include <boolean.h>
+
+/* Allocator for the large zero filled buffers of the core (upscaled VRAM,
+ * video surface). Where the platform allows it they are mapped from the
+ * system directly: pages are only committed once written, buffers that are
+ * mostly written can be backed by transparent huge pages on Linux, and
+ * clearing or shrinking a buffer hands its memory back. Elsewhere this
+ * falls back to calloc(). */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Returns a zero filled buffer, NULL on failure. Huge pages save TLB misses
+ * on buffers accessed all over, but commit memory 2 MB at a time. */
+void *MDFN_LargeAlloc(size_t size, bool huge_pages);
+
+/* Grows or shrinks a buffer, possibly moving it without copying its pages.
+ * The contents past old_size are unspecified. Returns NULL on failure, the
+ * buffer is then left untouched. */
+void *MDFN_LargeResize(void *ptr, size_t old_size, size_t new_size);
+
+/* Zero fills a buffer, releasing its memory when possible */
+void MDFN_LargeClear(void *ptr, size_t size);
+
+void MDFN_LargeFree(void *ptr, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
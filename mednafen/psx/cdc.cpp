@@ -51,6 +51,7 @@
 #include "psx.h"
 #include "cdc.h"
 #include "spu.h"
+#include "profiler.h"
 
 #include "../mednafen-endian.h"
 #include "../state_helpers.h"
@@ -1356,7 +1357,12 @@ int32_t PS_CDC::Update(const int32_t timestamp)
          }
       }
 
+      PSX_PROFILE_ENTER(PSX_PROF_SPU);
       SPUCounter = PSX_SPU->UpdateFromCDC(chunk_clocks);
+      PSX_PROFILE_LEAVE();
+
+      if (psx_profiler_mode)
+         PSX_Profiler_AddCycles(PSX_PROF_SPU, chunk_clocks);
 
       clocks -= chunk_clocks;
    } // end while(clocks > 0)
@@ -1632,6 +1638,10 @@ int32 PS_CDC::Command_Setloc(const int arg_count, const uint8 *args)
    CommandLoc = f + 75 * s + 75 * 60 * m - 150;
    CommandLoc_Dirty = true;
 
+   // Most of the time a seek or read follows
+   if(Cur_CDIF && CommandLoc >= 0)
+      Cur_CDIF->HintSeek(CommandLoc);
+
    WriteResult(MakeStatus());
    WriteIRQ(CDCIRQ_ACKNOWLEDGE);
 
@@ -1696,6 +1706,8 @@ void PS_CDC::PreSeekHack(uint32 target)
    CurSector = target;	// If removing/changing this, take into account how it will affect ReadN/ReadS/Play/etc command calls that interrupt a seek.
    SeekRetryCounter = 128;
 
+   Cur_CDIF->HintSeek(target);
+
    // If removing this SubQ reading bit, think about how it will interact with a Read command of data(or audio :b) sectors when Mode bit0 is 1.
    do
    {
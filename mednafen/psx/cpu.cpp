@@ -41,11 +41,24 @@ int pgxpMode = PGXP_GetModes();
  #include <unistd.h>
  #include <signal.h>
 
+#include <streams/file_stream.h>
+
 enum DYNAREC prev_dynarec;
 bool prev_invalidate;
+bool prev_block_cache;
+bool prev_threaded_compiler;
+bool prev_stats;
 extern bool psx_dynarec_invalidate;
+extern bool psx_dynarec_block_cache;
+extern bool psx_dynarec_threaded_compiler;
+extern bool psx_dynarec_stats;
 extern uint8 psx_mmap;
 static struct lightrec_state *lightrec_state;
+
+// Block cache contents while lightrec isn't running, it is kept across
+// lightrec_plugin_init() and written back to disk on unload.
+static void *lightrec_ir;
+static size_t lightrec_ir_size;
 #endif
 
 extern bool psx_gte_overclock;
@@ -196,6 +209,9 @@ void PS_CPU::Power(void)
 #ifdef HAVE_LIGHTREC
  prev_dynarec = psx_dynarec;
  prev_invalidate = psx_dynarec_invalidate;
+ prev_block_cache = psx_dynarec_block_cache;
+ prev_threaded_compiler = psx_dynarec_threaded_compiler;
+ prev_stats = psx_dynarec_stats;
  pgxpMode = PGXP_GetModes();
  if(psx_dynarec != DYNAREC_DISABLED)
   lightrec_plugin_init();
@@ -245,7 +261,7 @@ int PS_CPU::StateAction(StateMem *sm, const unsigned load, const bool data_only)
   SFVAR(ReadAbsorbWhich),
   SFVAR(ReadFudge),
 
-  SFARRAYN(ScratchRAM->data8, 1024, "ScratchRAM.data8"),
+  SFPAGEDARRAYN(ScratchRAM->data8, 1024, "ScratchRAM.data8"),
 
   SFEND
  };
@@ -2708,7 +2724,10 @@ pscpu_timestamp_t PS_CPU::Run(pscpu_timestamp_t timestamp_in, bool BIOSPrintMode
 #ifdef HAVE_LIGHTREC
 //track options changing
  if(MDFN_UNLIKELY(psx_dynarec != prev_dynarec || pgxpMode != PGXP_GetModes()) ||
-    prev_invalidate != psx_dynarec_invalidate)
+    prev_invalidate != psx_dynarec_invalidate ||
+    prev_block_cache != psx_dynarec_block_cache ||
+    prev_threaded_compiler != psx_dynarec_threaded_compiler ||
+    prev_stats != psx_dynarec_stats)
  {
   //init lightrec when changing dynarec, invalidate, or PGXP option, cleans entire state if already running
   if(psx_dynarec != DYNAREC_DISABLED)
@@ -2718,6 +2737,9 @@ pscpu_timestamp_t PS_CPU::Run(pscpu_timestamp_t timestamp_in, bool BIOSPrintMode
   prev_dynarec = psx_dynarec;
   pgxpMode = PGXP_GetModes();
   prev_invalidate = psx_dynarec_invalidate;
+  prev_block_cache = psx_dynarec_block_cache;
+  prev_threaded_compiler = psx_dynarec_threaded_compiler;
+  prev_stats = psx_dynarec_stats;
  }
 
  if(psx_dynarec != DYNAREC_DISABLED)
@@ -3818,6 +3840,26 @@ struct lightrec_ops PS_CPU::pgxp_ops = {
 	},
 };
 
+/* Returns false if the IR cache could not be exported */
+static bool lightrec_plugin_export_ir(void)
+{
+	void *data;
+	size_t size;
+
+	if (!lightrec_state || !psx_dynarec_block_cache)
+		return true;
+
+	data = lightrec_export_ir_cache(lightrec_state, &size);
+	if (!data)
+		return false;
+
+	free(lightrec_ir);
+	lightrec_ir = data;
+	lightrec_ir_size = size;
+
+	return true;
+}
+
 int PS_CPU::lightrec_plugin_init()
 {
 	struct lightrec_ops *cop_ops;
@@ -3826,9 +3868,10 @@ int PS_CPU::lightrec_plugin_init()
 	uint8_t *psxH = (uint8_t *) ScratchRAM->data8;
 	uint8_t *psxP = (uint8_t *) PSX_LoadExpansion1();
 
-	if(lightrec_state)
+	if(lightrec_state) {
+		lightrec_plugin_export_ir();
 		lightrec_destroy(lightrec_state);
-	else{
+	} else {
 		log_cb(RETRO_LOG_INFO, "Lightrec map addresses: M=0x%lx, P=0x%lx, R=0x%lx, H=0x%lx\n",
 			(uintptr_t) psxM,
 			(uintptr_t) psxP,
@@ -3868,10 +3911,116 @@ int PS_CPU::lightrec_plugin_init()
 			lightrec_map, ARRAY_SIZE(lightrec_map), cop_ops);
 
 	lightrec_set_invalidate_mode(lightrec_state, psx_dynarec_invalidate);
+	lightrec_set_threaded_compiler(lightrec_state,
+			psx_dynarec_threaded_compiler);
+	lightrec_set_stats(lightrec_state, psx_dynarec_stats);
+
+	lightrec_set_ir_cache(lightrec_state, psx_dynarec_block_cache);
+	if (psx_dynarec_block_cache && lightrec_ir)
+		lightrec_import_ir_cache(lightrec_state, lightrec_ir,
+				lightrec_ir_size);
 
 	return 0;
 }
 
+/* The IR layout follows lightrec's internals, a cache written by
+ * another version of the core is never reused. */
+#ifdef GIT_VERSION
+#define DYNAREC_CACHE_BUILD GIT_VERSION
+#else
+#define DYNAREC_CACHE_BUILD ""
+#endif
+
+/* Header: BIOS/disc key, IR cache version, build id length, build id */
+#define DYNAREC_CACHE_HEADER_SIZE (12 + sizeof(DYNAREC_CACHE_BUILD))
+
+bool PS_CPU::LoadDynarecCache(const char *path, uint32 key)
+{
+	void *data;
+	int64_t len;
+	const uint8 *header;
+
+	if (!filestream_exists(path) ||
+	    !filestream_read_file(path, &data, &len))
+		return false;
+
+	header = (const uint8 *)data;
+
+	if (len < (int64_t)DYNAREC_CACHE_HEADER_SIZE ||
+	    MDFN_de32lsb<false>(header + 4) != LIGHTREC_IR_CACHE_VERSION ||
+	    MDFN_de32lsb<false>(header + 8) != sizeof(DYNAREC_CACHE_BUILD) ||
+	    memcmp(header + 12, DYNAREC_CACHE_BUILD,
+		   sizeof(DYNAREC_CACHE_BUILD))) {
+		log_cb(RETRO_LOG_INFO, "Dynarec block cache \"%s\" was written "
+				"by another version of the core, ignoring it\n", path);
+		free(data);
+		return false;
+	}
+
+	if (MDFN_de32lsb<false>(header) != key) {
+		log_cb(RETRO_LOG_INFO, "Dynarec block cache \"%s\" is for "
+				"another BIOS or disc, ignoring it\n", path);
+		free(data);
+		return false;
+	}
+
+	free(lightrec_ir);
+	lightrec_ir_size = len - DYNAREC_CACHE_HEADER_SIZE;
+	lightrec_ir = malloc(lightrec_ir_size);
+	if (!lightrec_ir) {
+		lightrec_ir_size = 0;
+		free(data);
+		return false;
+	}
+
+	memcpy(lightrec_ir, header + DYNAREC_CACHE_HEADER_SIZE,
+	       lightrec_ir_size);
+	free(data);
+
+	if (lightrec_state && psx_dynarec_block_cache &&
+	    lightrec_import_ir_cache(lightrec_state, lightrec_ir,
+				     lightrec_ir_size)) {
+		log_cb(RETRO_LOG_WARN, "Invalid dynarec block cache \"%s\"\n",
+				path);
+		return false;
+	}
+
+	return true;
+}
+
+bool PS_CPU::SaveDynarecCache(const char *path, uint32 key)
+{
+	uint8 *data;
+	bool ret;
+
+	if (!lightrec_plugin_export_ir())
+		return false;
+
+	/* Nothing compiled or loaded, nothing to save */
+	if (!lightrec_ir)
+		return true;
+
+	data = (uint8 *)malloc(DYNAREC_CACHE_HEADER_SIZE + lightrec_ir_size);
+	if (!data)
+		return false;
+
+	MDFN_en32lsb<false>(data, key);
+	MDFN_en32lsb<false>(data + 4, LIGHTREC_IR_CACHE_VERSION);
+	MDFN_en32lsb<false>(data + 8, sizeof(DYNAREC_CACHE_BUILD));
+	memcpy(data + 12, DYNAREC_CACHE_BUILD, sizeof(DYNAREC_CACHE_BUILD));
+	memcpy(data + DYNAREC_CACHE_HEADER_SIZE, lightrec_ir,
+	       lightrec_ir_size);
+	ret = filestream_write_file(path, data,
+			DYNAREC_CACHE_HEADER_SIZE + lightrec_ir_size);
+	free(data);
+
+	free(lightrec_ir);
+	lightrec_ir = NULL;
+	lightrec_ir_size = 0;
+
+	return ret;
+}
+
 int32_t PS_CPU::lightrec_plugin_execute(int32_t timestamp)
 {
 	uint32_t GPRL[34];
@@ -3944,8 +4093,77 @@ void PS_CPU::lightrec_plugin_clear(u32 addr, u32 size)
 		lightrec_invalidate(lightrec_state, addr, size * 4);
 }
 
+static int block_stats_cmp(const void *a, const void *b)
+{
+	const struct lightrec_block_stats *sa =
+		(const struct lightrec_block_stats *)a;
+	const struct lightrec_block_stats *sb =
+		(const struct lightrec_block_stats *)b;
+	u64 ca = (u64)sa->hits * sa->cycles;
+	u64 cb = (u64)sb->hits * sb->cycles;
+
+	return ca < cb ? 1 : ca > cb ? -1 : 0;
+}
+
+void PS_CPU::DumpDynarecStats(void)
+{
+	static const char *const names[LIGHTREC_STAT_END] = {
+		"exit: cycles", "exit: syscall", "exit: break",
+		"exit: interrupt", "exit: segfault", "block lookup",
+		"I/O access", "untagged access", "MFC", "MTC", "RFE", "CP",
+	};
+	struct lightrec_block_stats *stats;
+	u64 counters[LIGHTREC_STAT_END];
+	u64 compile_time = 0, invalidations = 0;
+	unsigned int i, nb;
+
+	if (!lightrec_state)
+		return;
+
+	lightrec_get_stats(lightrec_state, counters);
+
+	log_cb(RETRO_LOG_INFO, "Lightrec calls to C:\n");
+	for (i = 0; i < LIGHTREC_STAT_END; i++)
+		log_cb(RETRO_LOG_INFO, "  %-16s %llu\n", names[i],
+				(unsigned long long)counters[i]);
+
+	nb = lightrec_get_block_stats(lightrec_state, NULL, 0);
+	stats = (struct lightrec_block_stats *)malloc(nb * sizeof(*stats));
+	if (!stats)
+		return;
+
+	nb = lightrec_get_block_stats(lightrec_state, stats, nb);
+
+	for (i = 0; i < nb; i++) {
+		compile_time += stats[i].compile_time;
+		invalidations += stats[i].invalidations;
+	}
+
+	log_cb(RETRO_LOG_INFO, "Lightrec blocks: %u, compile time: %llu ms, "
+			"invalidations: %llu\n", nb,
+			(unsigned long long)compile_time / 1000,
+			(unsigned long long)invalidations);
+
+	/* The blocks the most cycles are spent in */
+	qsort(stats, nb, sizeof(*stats), block_stats_cmp);
+
+	log_cb(RETRO_LOG_INFO, "  PC         ops   hits       cycles  "
+			"interp  comp  time(us)  inval\n");
+	for (i = 0; i < nb && i < 32; i++)
+		log_cb(RETRO_LOG_INFO, "  0x%08x %5u %10u %6u %7u %5u %9u %6u\n",
+				stats[i].pc, stats[i].nb_ops, stats[i].hits,
+				stats[i].cycles, stats[i].interpreted,
+				stats[i].compilations, stats[i].compile_time,
+				stats[i].invalidations);
+
+	free(stats);
+}
+
 void PS_CPU::lightrec_plugin_shutdown(void)
 {
+	if (psx_dynarec_stats)
+		DumpDynarecStats();
+
 	log_cb(RETRO_LOG_INFO,"Lightrec memory usage: %u KiB, average IPI: %.2f\n",
 		lightrec_get_total_mem_usage()/1024,
 		lightrec_get_average_ipi());
@@ -108,6 +108,15 @@ class PS_CPU
  int StateAction(StateMem *sm, const unsigned load, const bool data_only);
 #ifdef HAVE_LIGHTREC
  void lightrec_plugin_clear(uint32 addr, uint32 size);
+
+ // Persistent dynarec block cache, see lightrec_set_ir_cache().
+ // key identifies the BIOS and disc the cache was built for. Saving
+ // only fails on an allocation or write error, not when it's empty.
+ bool LoadDynarecCache(const char *path, uint32 key);
+ bool SaveDynarecCache(const char *path, uint32 key);
+
+ // Logs the lightrec statistics, see lightrec_get_block_stats().
+ void DumpDynarecStats(void);
 #endif
 
  private:
@@ -102,8 +102,9 @@ static void crosshair_plot( uint32 *pixels,
 {
 	int r, g, b, a;
 	int nr, ng, nb;
+	MDFN_Pixel *pix = (MDFN_Pixel*)pixels;
 
-	format->DecodeColor(pixels[x], r, g, b, a);
+	format->DecodeColor(pix[x], r, g, b, a);
 
 	nr = (r + chair_r * 3) >> 2;
 	ng = (g + chair_g * 3) >> 2;
@@ -125,7 +126,7 @@ static void crosshair_plot( uint32 *pixels,
 		}
 	}
 
-	pixels[x] = MAKECOLOR(nr, ng, nb, a);
+	pix[x] = MAKECOLOR(nr, ng, nb, a);
 }
 
 INLINE void InputDevice::DrawCrosshairs(uint32 *pixels, const MDFN_PixelFormat* const format, const unsigned width, const unsigned pix_clock, const unsigned surf_pitchinpix, const unsigned upscale_factor)
@@ -18,9 +18,11 @@
 #include "psx.h"
 #include "timer.h"
 #include "FastFIFO.h"
+#include "profiler.h"
 
 #include "../math_ops.h"
 #include "../state_helpers.h"
+#include "../largemem.h"
 #include "../../rsx/rsx_intf.h"
 
 #include "../pgxp/pgxp_main.h"
@@ -29,6 +31,10 @@
 
 #include "gpu_common.h"
 
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
 #include "gpu_polygon.cpp"
 #include "gpu_sprite.cpp"
 #include "gpu_line.cpp"
@@ -73,14 +79,6 @@ extern bool fast_pal;
    */
 extern int32 EventCycles;
 
-static const int8 dither_table[4][4] =
-{
-   { -4,  0, -3,  1 },
-   {  2, -2,  3, -1 },
-   { -3,  1, -4,  0 },
-   {  3, -1,  2, -2 },
-};
-
 static FastFIFO<uint32, 0x20> GPU_BlitterFIFO; // 0x10 on an actual PS1 GPU, 0x20 here (see comment at top of gpu.h)
 
 struct CTEntry
@@ -93,6 +91,87 @@ struct CTEntry
 
 PS_GPU GPU;
 
+// Light guns need the pixels of each line as it is scanned out
+static bool scanout_sync = false;
+
+/* A line of the surface is not scanned out again when it would be read
+ * from the same VRAM line with the same settings as last frame and that
+ * VRAM line wasn't written since. Writes are tracked per VRAM line on the
+ * emulation thread, as commands are submitted. */
+struct ScanoutLineState
+{
+   // 0 when the line has to be scanned out
+   uint64 stamp;
+   uint32 fb_y;
+   int32 fb_x;
+   int32 dx_start;
+   int32 dx_end;
+   uint32 dmw;
+   bool bpp24;
+};
+
+#define SCANOUT_MAX_LINES 1024
+
+static ScanoutLineState scanout_lines[SCANOUT_MAX_LINES];
+static bool scanout_tracked        = false;
+static uint32_t *scanout_pixels    = NULL;
+static uint32 scanout_pitch32      = 0;
+// Incremented by each line scanned out, a line is up to date while the
+// VRAM line it was read from has a lower stamp than its own
+static uint64 scanout_stamp        = 1;
+static uint64 vram_line_stamp[512];
+static uint32 vram_marked_y        = 0;
+static uint32 vram_marked_h        = 0;
+static uint64 vram_marked_stamp    = 0;
+
+static void ScanoutInvalidate(void)
+{
+   memset(scanout_lines, 0, sizeof(scanout_lines));
+   scanout_tracked = false;
+}
+
+static INLINE void VRAMLinesWritten(uint32 y, uint32 h)
+{
+   uint32 i;
+
+   if (h >= 512)
+   {
+      y = 0;
+      h = 512;
+   }
+
+   // Drawing commands come in batches sharing the same clip area
+   if (vram_marked_stamp == scanout_stamp && vram_marked_y == y
+         && vram_marked_h == h)
+      return;
+
+   for (i = 0; i < h; i++)
+      vram_line_stamp[(y + i) & 511] = scanout_stamp;
+
+   vram_marked_y     = y;
+   vram_marked_h     = h;
+   vram_marked_stamp = scanout_stamp;
+}
+
+static void VRAMCommandWritten(uint32_t cc, const uint32 *cb)
+{
+   uint32 h;
+
+   if (cc == 0x02)
+      VRAMLinesWritten((cb[1] >> 16) & 0x3FF, (cb[2] >> 16) & 0x1FF);
+   else if (cc >= 0x20 && cc <= 0x7F)
+   {
+      // Everything drawn is clipped to the drawing area
+      if (GPU.ClipY1 >= GPU.ClipY0)
+         VRAMLinesWritten(GPU.ClipY0, GPU.ClipY1 - GPU.ClipY0 + 1);
+   }
+   else if (cc >= 0x80 && cc <= 0x9F)
+   {
+      h = (cb[3] >> 16) & 0x1FF;
+      VRAMLinesWritten((cb[2] >> 16) & 0x3FF, h ? h : 0x200);
+   }
+}
+
 /* Buffers used to hold data during upscale operations */
 uint32 TexCache_Tag[256];
 uint16 TexCache_Data[256][4];
@@ -191,6 +270,9 @@ static void Command_FBFill(PS_GPU* gpu, const uint32 *cb)
 
       gpu->DrawTimeAvail -= (width >> 3) + 9;
 
+      if(gpu->timing_only)
+         continue;
+
       for(x = 0; x < width; x++)
       {
          const int32 d_x = (x + destX) & 1023;
@@ -223,10 +305,13 @@ static void Command_FBCopy(PS_GPU* g, const uint32 *cb)
 
    g->DrawTimeAvail -= (width * height) * 2;
 
-   for(y = 0; y < height; y++)
+   for(y = 0; y < height && !g->timing_only; y++)
    {
       unsigned x;
 
+      if(BandSkipTest(g, (y + destY) & 511))
+         continue;
+
       for(x = 0; x < width; x += 128)
       {
          const int32 chunk_x_max = std::min<int32>(width - x, 128);
@@ -334,7 +419,7 @@ static void Command_DrawMode(PS_GPU* g, const uint32 *cb)
 
    if (g->dfe)
    {
-      GPU.display_possibly_dirty = true;
+      g->display_possibly_dirty = true;
       //printf("Display possibly dirty this frame\n");
    }
 
@@ -530,6 +615,130 @@ static CTEntry Commands[256] =
 
 };
 
+/* How many times each variant of the drawing commands (0x20-0x7F) ran,
+ * indexed like CTEntry::func */
+static uint32 DrawCommandCounts[0x60][4][8];
+
+static INLINE bool CommandTextured(unsigned cc)
+{
+   // Bit 2 of the line commands isn't a texture bit
+   return (cc < 0x40 || cc >= 0x60) && (cc & 0x4);
+}
+
+#ifdef GPU_TRIMMED_COMMANDS
+// Plugs a specialized variant in every table slot selecting it
+static void SetHotCommand(unsigned cc, unsigned abr, unsigned tex_mode,
+      unsigned mask_eval, void (*func)(PS_GPU* g, const uint32 *cb))
+{
+   unsigned a, t;
+
+   for (a = 0; a < 4; a++)
+   {
+      if ((cc & 0x2) && a != abr)
+         continue;
+
+      for (t = 0; t < 4; t++)
+      {
+         if (CommandTextured(cc) && std::min(t, 2U) != tex_mode)
+            continue;
+
+         Commands[cc].func[a][t | (mask_eval ? 0x4 : 0x0)] = func;
+      }
+   }
+}
+
+static void InitHotCommands(void)
+{
+#define GPU_HOT_POLY(cc, abr, tm, mam)   SetHotCommand(cc, abr, tm, mam, POLY_VARIANT(abr, cc, tm, mam));
+#define GPU_HOT_SPRITE(cc, abr, tm, mam) SetHotCommand(cc, abr, tm, mam, SPR_VARIANT(abr, cc, tm, mam));
+#define GPU_HOT_LINE(cc, abr, mam)       SetHotCommand(cc, abr, 0, mam, LINE_VARIANT(abr, cc, mam));
+#include "gpu_hot_commands.h"
+#undef GPU_HOT_POLY
+#undef GPU_HOT_SPRITE
+#undef GPU_HOT_LINE
+}
+#endif
+
+struct DrawCommandStat
+{
+   uint32 count;
+   uint8 cc;
+   uint8 abr;
+   uint8 tex_mode;
+   uint8 mask_eval;
+};
+
+static int DrawCommandStatCmp(const void *a, const void *b)
+{
+   uint32 count_a = ((const DrawCommandStat*)a)->count;
+   uint32 count_b = ((const DrawCommandStat*)b)->count;
+
+   return (count_a < count_b) - (count_a > count_b);
+}
+
+void GPU_DumpCommandStats(void)
+{
+   static const char *const kinds[3] = { "POLY", "LINE", "SPRITE" };
+   static DrawCommandStat stats[0x60 * 4 * 3 * 2];
+   unsigned nb = 0, cc, a, t, i;
+   uint64 total = 0;
+
+   memset(stats, 0, sizeof(stats));
+
+   /* Merge the slots that select the same variant */
+   for (cc = 0x20; cc < 0x80; cc++)
+   {
+      for (a = 0; a < 4; a++)
+      {
+         for (t = 0; t < 8; t++)
+         {
+            uint32 count = DrawCommandCounts[cc - 0x20][a][t];
+            unsigned abr, tex_mode, mask_eval;
+            DrawCommandStat *stat;
+
+            if (!count)
+               continue;
+
+            abr       = (cc & 0x2) ? a : 0;
+            tex_mode  = CommandTextured(cc) ? std::min(t & 0x3, 2U) : 0;
+            mask_eval = t >> 2;
+            stat      = &stats[(((cc - 0x20) * 4 + abr) * 3 + tex_mode) * 2 + mask_eval];
+
+            stat->count    += count;
+            stat->cc        = cc;
+            stat->abr       = abr;
+            stat->tex_mode  = tex_mode;
+            stat->mask_eval = mask_eval;
+            total          += count;
+         }
+      }
+   }
+
+   for (i = 0; i < sizeof(stats) / sizeof(stats[0]); i++)
+      if (stats[i].count)
+         stats[nb++] = stats[i];
+
+   qsort(stats, nb, sizeof(*stats), DrawCommandStatCmp);
+
+   log_cb(RETRO_LOG_INFO, "GPU drawing commands: %llu, %u variants used\n",
+         (unsigned long long)total, nb);
+
+   /* In the format of gpu_hot_commands.h */
+   for (i = 0; i < nb && i < 48; i++)
+   {
+      const DrawCommandStat *stat = &stats[i];
+      const char *kind            = kinds[(stat->cc - 0x20) >> 5];
+
+      if (stat->cc >= 0x40 && stat->cc < 0x60)
+         log_cb(RETRO_LOG_INFO, "GPU_HOT_%s(0x%02x, %u, %u) /* %u */\n",
+               kind, stat->cc, stat->abr, stat->mask_eval, stat->count);
+      else
+         log_cb(RETRO_LOG_INFO, "GPU_HOT_%s(0x%02x, %u, %u, %u) /* %u */\n",
+               kind, stat->cc, stat->abr, stat->tex_mode, stat->mask_eval,
+               stat->count);
+   }
+}
+
 static INLINE bool CalcFIFOReadyBit(void)
 {
    if(GPU.InCmd & (INCMD_PLINE | INCMD_QUAD))
@@ -624,19 +833,52 @@ static void RSX_UpdateDisplayMode(void)
 void GPU_RestoreStateP1(bool);
 void GPU_RestoreStateP2(bool);
 void GPU_RestoreStateP3();
+static void ThreadCopyState(void);
 
-/* Return a ptr to memory with enough space
- * for the VRAM, taking upscaling into account */
+static size_t VRAM_Size(uint8 upscale_shift)
+{
+   return ((size_t)(1024 * 512) << (upscale_shift * 2)) * sizeof(uint16_t);
+}
+
+/* Return a ptr to zeroed memory with enough space
+ * for the VRAM, taking upscaling into account. Its
+ * pages are only committed once drawn to, backed by
+ * huge pages as the rasterizer walks all over it. */
 static uint16_t *VRAM_Alloc(uint8 upscale_shift)
 {
-   unsigned width  = 1024 << upscale_shift;
-   unsigned height =  512 << upscale_shift;
-   unsigned size   = width * height;
+   return (uint16_t*)MDFN_LargeAlloc(VRAM_Size(upscale_shift), true);
+}
+
+/* Rescale the VRAM contents in place from src_shift to dst_shift,
+ * replicating pixels (nearest neighbour) when upscaling and keeping
+ * the top-left pixel of each block when downscaling. Lines are
+ * walked towards the end of the buffer when it shrinks and towards
+ * its start when it grows, so that no source pixel is overwritten
+ * before it is read. */
+static void VRAM_RescaleInPlace(uint16_t *vram, uint8 dst_shift, uint8 src_shift)
+{
+   const unsigned dst_upscale = 1U << dst_shift;
+   const unsigned dst_width   = 1024U << dst_shift;
+   const bool grow            = dst_shift > src_shift;
 
-   uint16_t *vram    = new uint16_t[size];
-   memset(vram, 0, size * sizeof(*vram));
+   for (unsigned i = 0; i < 512; i++)
+   {
+      const unsigned y    = grow ? 511 - i : i;
+      const uint16_t *src = vram + ((size_t)(y << src_shift) << (10 + src_shift));
+      uint16_t *dst       = vram + ((size_t)(y << dst_shift) << (10 + dst_shift));
+
+      for (unsigned j = 0; j < 1024; j++)
+      {
+         const unsigned x = grow ? 1023 - j : j;
+         const uint16_t v = src[x << src_shift];
 
-   return vram;
+         for (unsigned dx = 0; dx < dst_upscale; dx++)
+            dst[(x << dst_shift) + dx] = v;
+      }
+
+      for (unsigned dy = 1; dy < dst_upscale; dy++)
+         memcpy(dst + dy * dst_width, dst, dst_width * sizeof(*dst));
+   }
 }
 
 void GPU_Init(bool pal_clock_and_tv,
@@ -691,6 +933,12 @@ void GPU_Init(bool pal_clock_and_tv,
    GPU.dither_upscale_shift = 0;
 
    GPU.killQuadPart = 0;
+
+   memset(DrawCommandCounts, 0, sizeof(DrawCommandCounts));
+
+#ifdef GPU_TRIMMED_COMMANDS
+   InitHotCommands();
+#endif
 }
 
 void GPU_RecalcClockRatio(void) {
@@ -704,62 +952,53 @@ void GPU_RecalcClockRatio(void) {
 
 void GPU_Destroy(void)
 {
-   delete [] GPU.vram;
+   GPU_SetThreaded(0);
+   MDFN_LargeFree(GPU.vram, VRAM_Size(GPU.upscale_shift));
+   GPU.vram = NULL;
 }
 
-/* Rescale the GPU with a different upscale_shift 
- * 
- * We copy, if necessary, the current VRAM (GPU.vram) at 1x
- * to a buffer (vram_new). 
- * We allocate enough space for the rescaled VRAM 
- * and copy the buffer to it, taking the upscale factor into account 
- * 
+/* Rescale the GPU with a different upscale_shift
+ *
+ * The VRAM buffer is resized and its contents rescaled in place,
+ * taking the upscale factor into account. Resizing moves the pages
+ * of the buffer where the platform allows it, so only the new
+ * VRAM is ever resident.
  */
 void GPU_Rescale(uint8 ushift)
 {
-   if (GPU.upscale_shift == 0) 
+   uint16_t *vram;
+
+   GPU_Sync();
+
+   if (ushift == GPU.upscale_shift)
+      return;
+
+   if (ushift < GPU.upscale_shift)
    {
-      /* VRAM is already at 1x, make the buffer point to the old VRAM
-       * to avoid copying it */
-      vram_new = GPU.vram;  
-   }
+      VRAM_RescaleInPlace(GPU.vram, ushift, GPU.upscale_shift);
 
+      vram = (uint16_t*)MDFN_LargeResize(GPU.vram,
+            VRAM_Size(GPU.upscale_shift), VRAM_Size(ushift));
+      if (vram)
+         GPU.vram = vram;
+   }
    else
    {
-      /* Copy current VRAM to temp buffer at 1x */
-      vram_new = VRAM_Alloc(0);
+      vram = (uint16_t*)MDFN_LargeResize(GPU.vram,
+            VRAM_Size(GPU.upscale_shift), VRAM_Size(ushift));
 
-      for (unsigned y = 0; y < 512; y++)
-      {
-         for (unsigned x = 0; x < 1024; x++)
-            vram_new[y * 1024 + x] = texel_fetch(&GPU, x, y);
-      }
+      /* Out of memory, stay at the current internal resolution */
+      if (!vram)
+         return;
 
-      /* Cleanup the old VRAM */
-      delete [] GPU.vram;
+      GPU.vram = vram;
+      VRAM_RescaleInPlace(GPU.vram, ushift, GPU.upscale_shift);
    }
 
-   GPU.vram = NULL;
-
-   /* Change the state of the upscale shift right now
-    * or else texel_put won't use the new scaling factor
-    * resulting in corrupted VRAM */
    GPU_set_upscale_shift(ushift);
-   
-   GPU.vram = VRAM_Alloc(ushift);
-
-   /* Copy the temp buffer to the rescaled VRAM, taking the
-    * upscale factor into account (nearest neighbor upscaling) */
-   for (unsigned y = 0; y < 512; y++)
-   {
-      for (unsigned x = 0; x < 1024; x++)
-         texel_put(x, y, vram_new[y * 1024 + x]);
-   }
 
-   /* Cleanup the temporary buffer */
-   if (vram_new)
-      delete [] vram_new;
-   vram_new = NULL;
+   ScanoutInvalidate();
+   ThreadCopyState();
 }
 
 void GPU_FillVideoParams(MDFNGI* gi)
@@ -875,10 +1114,14 @@ void GPU_SoftReset(void) // Control command 0x00
 
 void GPU_Power(void)
 {
-   memset(GPU.vram, 0, 512 * 1024 * UPSCALE(&GPU) * UPSCALE(&GPU) * sizeof(*GPU.vram));
+   GPU_Sync();
+
+   MDFN_LargeClear(GPU.vram, VRAM_Size(GPU.upscale_shift));
+   ScanoutInvalidate();
 
    memset(GPU.CLUT_Cache, 0, sizeof(GPU.CLUT_Cache));
    GPU.CLUT_Cache_VB = ~0U;
+   GPU.CLUT_Gen      = 0;
 
    memset(GPU.TexCache, 0xFF, sizeof(GPU.TexCache));
 
@@ -971,6 +1214,8 @@ void GPU_Power(void)
 
    IRQ_Assert(IRQ_VBLANK, GPU.InVBlank);
    TIMER_SetVBlank(GPU.InVBlank);
+
+   ThreadCopyState();
 }
 
 void GPU_ResetTS(void)
@@ -979,6 +1224,770 @@ void GPU_ResetTS(void)
 }
 
 
+// Writes the two pixels of a word of FBWrite data
+static void FBWrite_Data(PS_GPU *g, uint32_t InData)
+{
+   unsigned i;
+   bool sw = rsx_intf_has_software_renderer();
+
+   if (g == &GPU)
+      VRAMLinesWritten(g->FBRW_CurY & 511, 2);
+
+   for(i = 0; i < 2; i++)
+   {
+      if (!g->timing_only && !BandSkipTest(g, g->FBRW_CurY & 511))
+      {
+         /* Cannot rely on mask bit if we don't have SW renderer, HW renderer will
+          * perform masking. */
+         bool fetch = false;
+         if (sw)
+            fetch = texel_fetch(g, g->FBRW_CurX & 1023, g->FBRW_CurY & 511) & g->MaskEvalAND;
+
+         if (!fetch)
+            texel_put(g->FBRW_CurX & 1023, g->FBRW_CurY & 511, InData | g->MaskSetOR);
+      }
+
+      g->FBRW_CurX++;
+      if(g->FBRW_CurX == (g->FBRW_X + g->FBRW_W))
+      {
+         g->FBRW_CurX = g->FBRW_X;
+         g->FBRW_CurY++;
+         if(g->FBRW_CurY == (g->FBRW_Y + g->FBRW_H))
+         {
+            /* Upload complete, send over to RSX */
+            rsx_intf_load_image(
+                  g->FBRW_X, g->FBRW_Y,
+                  g->FBRW_W, g->FBRW_H,
+                  g->vram,
+                  g->MaskEvalAND,
+                  g->MaskSetOR);
+            g->InCmd = INCMD_NONE;
+            break;   // Break out of the for() loop.
+         }
+      }
+      InData >>= 16;
+   }
+}
+
+static void ScanoutLine(MDFN_Pixel *dest, unsigned pitch32, uint32_t fb_y,
+      bool bpp24, int32 dx_start, int32 dx_end, int32 fb_x, uint32_t dmw);
+
+/* Render threads
+ *
+ * With the software renderer the GPU commands can be drawn on threads of
+ * their own. The emulation thread still runs every command, with
+ * GPU.timing_only set: DrawTimeAvail, the cache tags and the drawing state
+ * then evolve exactly like when drawing inline, so emulation doesn't
+ * depend on how far behind the render threads are. The commands are queued
+ * along with the display state they depend on, and each render thread runs
+ * all of them again on its own copy of the GPU state. Scanout goes through
+ * the queue as well, so the emulation thread only has to wait in
+ * GPU_Sync() when it needs VRAM or the surface.
+ *
+ * With several render threads, each one only draws the VRAM lines of its
+ * bands (see BandSkipTest()), and scans them out. A line is only ever
+ * written by one thread, in command order, so blending and mask bits work
+ * as usual. Reads from other lines (textures, CLUTs and FBCopy sources)
+ * need the other threads to be done with the commands before, and not to
+ * have started the ones after: the emulation thread keeps track of the
+ * VRAM areas read and written since the last barrier, and puts a new one
+ * in the queue when a command reads an area that was written or writes
+ * one that was read. The texture cache of each thread only holds the
+ * texels of its own lines, so a texture drawn to without the cache being
+ * invalidated may be sampled before its cached copy was updated. */
+#ifdef HAVE_THREADS
+
+#define GPU_THREAD_MAX       16
+#define GPU_THREAD_RING_SIZE 4096   /* Power of 2 */
+#define GPU_THREAD_BATCH     32     /* Commands queued before waking the threads */
+
+enum
+{
+   GPU_THREAD_COMMAND = 0,
+   GPU_THREAD_FBWRITE,
+   GPU_THREAD_SCANOUT,
+   GPU_THREAD_JOB
+};
+
+struct GPU_ThreadCmd
+{
+   uint8 type;
+   uint8 cc;
+   uint8 InCmd;
+   uint8 count;         // FBWrite data words
+   bool barrier;        // Wait for the other threads to get there first
+   bool serial;         // Drawn by the first thread only
+   bool set_tpage;
+   bool TexDisableAllowChange;
+   bool field_ram_readout;
+   uint32 DisplayMode;
+   uint32 DisplayFB_YStart;
+   void (*func)(PS_GPU* g, const uint32 *cb);
+
+   union
+   {
+      uint32 cb[0x10];
+
+      struct
+      {
+         MDFN_Pixel *dest;
+         unsigned pitch32;
+         uint32_t fb_y;
+         int32 dx_start;
+         int32 dx_end;
+         int32 fb_x;
+         uint32_t dmw;
+         bool bpp24;
+      } line;
+
+      struct
+      {
+         void (*func)(void *data, unsigned index, unsigned count);
+         void *data;
+      } job;
+   } u;
+};
+
+static PS_GPU GPU_Render[GPU_THREAD_MAX];
+
+static sthread_t *gpu_threads[GPU_THREAD_MAX];
+static unsigned gpu_thread_count      = 0;
+static slock_t *gpu_thread_lock       = NULL;
+static scond_t *gpu_thread_cond       = NULL;
+static GPU_ThreadCmd *gpu_thread_ring = NULL;
+
+// Only used by the emulation thread
+static unsigned gpu_thread_write      = 0;
+static unsigned gpu_thread_read_seen  = 0;
+static unsigned gpu_thread_synced     = 0;
+static bool gpu_thread_fbw_open       = false;
+static bool gpu_thread_barrier_next   = false;
+
+// VRAM areas read and written since the last barrier, in blocks of 64x16
+// pixels: bit x of row y is block (x, y)
+static uint16 gpu_thread_read_map[32];
+static uint16 gpu_thread_write_map[32];
+
+// Written under gpu_thread_lock
+static unsigned gpu_thread_published  = 0;
+static unsigned gpu_thread_read[GPU_THREAD_MAX];
+static bool gpu_thread_quit           = false;
+
+static void ThreadRun(PS_GPU *g, const GPU_ThreadCmd *cmd)
+{
+   unsigned i;
+
+   switch (cmd->type)
+   {
+      case GPU_THREAD_COMMAND:
+         g->InCmd                 = cmd->InCmd;
+         g->TexDisableAllowChange = cmd->TexDisableAllowChange;
+         g->field_ram_readout     = cmd->field_ram_readout;
+         g->DisplayMode           = cmd->DisplayMode;
+         g->DisplayFB_YStart      = cmd->DisplayFB_YStart;
+
+         if (cmd->set_tpage)
+            SetTPage(g, cmd->u.cb[4 + ((cmd->cc >> 4) & 0x1)] >> 16);
+
+         if (cmd->serial)
+         {
+            // The other threads only keep their state in step
+            uint8 band_count = g->band_count;
+
+            g->band_count  = 1;
+            g->timing_only = g->band_index != 0;
+            cmd->func(g, cmd->u.cb);
+            g->band_count  = band_count;
+
+            // The texels and CLUT weren't fetched
+            if (g->timing_only)
+               InvalidateCache(g);
+            g->timing_only = false;
+         }
+         else
+            cmd->func(g, cmd->u.cb);
+         break;
+      case GPU_THREAD_FBWRITE:
+         for (i = 0; i < cmd->count; i++)
+            FBWrite_Data(g, cmd->u.cb[i]);
+         break;
+      case GPU_THREAD_SCANOUT:
+         if (!BandSkipTest(g, cmd->u.line.fb_y))
+            ScanoutLine(cmd->u.line.dest, cmd->u.line.pitch32,
+                  cmd->u.line.fb_y, cmd->u.line.bpp24,
+                  cmd->u.line.dx_start, cmd->u.line.dx_end,
+                  cmd->u.line.fb_x, cmd->u.line.dmw);
+         break;
+      case GPU_THREAD_JOB:
+         cmd->u.job.func(cmd->u.job.data, g - GPU_Render, gpu_thread_count);
+         break;
+   }
+}
+
+// True once every render thread is done with the commands before pos
+static bool ThreadReached(unsigned pos)
+{
+   unsigned i;
+
+   for (i = 0; i < gpu_thread_count; i++)
+      if ((int)(gpu_thread_read[i] - pos) < 0)
+         return false;
+
+   return true;
+}
+
+static void ThreadMain(void *data)
+{
+   unsigned index = (unsigned)(uintptr_t)data;
+   PS_GPU *g      = &GPU_Render[index];
+
+   slock_lock(gpu_thread_lock);
+
+   for (;;)
+   {
+      unsigned pos, end;
+
+      while (gpu_thread_read[index] == gpu_thread_published && !gpu_thread_quit)
+         scond_wait(gpu_thread_cond, gpu_thread_lock);
+
+      if (gpu_thread_read[index] == gpu_thread_published)
+         break;
+
+      end = gpu_thread_published;
+      slock_unlock(gpu_thread_lock);
+
+      for (pos = gpu_thread_read[index]; pos != end; pos++)
+      {
+         const GPU_ThreadCmd *cmd = &gpu_thread_ring[pos & (GPU_THREAD_RING_SIZE - 1)];
+
+         if (cmd->barrier)
+         {
+            slock_lock(gpu_thread_lock);
+            gpu_thread_read[index] = pos;
+            scond_broadcast(gpu_thread_cond);
+            while (!ThreadReached(pos))
+               scond_wait(gpu_thread_cond, gpu_thread_lock);
+            slock_unlock(gpu_thread_lock);
+         }
+
+         ThreadRun(g, cmd);
+      }
+
+      slock_lock(gpu_thread_lock);
+      gpu_thread_read[index] = end;
+      scond_broadcast(gpu_thread_cond);
+   }
+
+   slock_unlock(gpu_thread_lock);
+}
+
+static void ThreadPublish(void)
+{
+   if (gpu_thread_fbw_open)
+   {
+      gpu_thread_fbw_open = false;
+      gpu_thread_write++;
+   }
+
+   if (gpu_thread_published == gpu_thread_write)
+      return;
+
+   slock_lock(gpu_thread_lock);
+   gpu_thread_published = gpu_thread_write;
+   scond_broadcast(gpu_thread_cond);
+   slock_unlock(gpu_thread_lock);
+}
+
+static void ThreadCommit(void)
+{
+   gpu_thread_fbw_open = false;
+   gpu_thread_write++;
+
+   if (gpu_thread_write - gpu_thread_published >= GPU_THREAD_BATCH)
+      ThreadPublish();
+}
+
+// True while a render thread hasn't got past the slot to be written
+static bool ThreadRingFull(void)
+{
+   unsigned i;
+
+   for (i = 0; i < gpu_thread_count; i++)
+      if (gpu_thread_write - gpu_thread_read[i] >= GPU_THREAD_RING_SIZE)
+         return true;
+
+   return false;
+}
+
+static GPU_ThreadCmd *ThreadAlloc(void)
+{
+   GPU_ThreadCmd *cmd;
+
+   if (gpu_thread_fbw_open)
+      ThreadCommit();
+
+   if (gpu_thread_write - gpu_thread_read_seen >= GPU_THREAD_RING_SIZE)
+   {
+      unsigned i;
+
+      ThreadPublish();
+
+      slock_lock(gpu_thread_lock);
+      while (ThreadRingFull())
+         scond_wait(gpu_thread_cond, gpu_thread_lock);
+      gpu_thread_read_seen = gpu_thread_read[0];
+      for (i = 1; i < gpu_thread_count; i++)
+         if ((int)(gpu_thread_read[i] - gpu_thread_read_seen) < 0)
+            gpu_thread_read_seen = gpu_thread_read[i];
+      slock_unlock(gpu_thread_lock);
+   }
+
+   cmd                     = &gpu_thread_ring[gpu_thread_write & (GPU_THREAD_RING_SIZE - 1)];
+   cmd->barrier            = gpu_thread_barrier_next;
+   cmd->serial             = false;
+   gpu_thread_barrier_next = false;
+
+   return cmd;
+}
+
+// Bits of the blocks of the w pixels wide area starting at x
+static uint16 RegionColumns(uint32 x, uint32 w)
+{
+   uint32 first = (x & 1023) >> 6;
+   uint32 count = ((x & 63) + w + 63) >> 6;
+   uint16 mask  = 0;
+   uint32 i;
+
+   if (count >= 16)
+      return 0xFFFF;
+
+   for (i = 0; i < count; i++)
+      mask |= 1 << ((first + i) & 15);
+
+   return mask;
+}
+
+static void RegionMark(uint16 *map, uint32 x, uint32 y, uint32 w, uint32 h)
+{
+   uint16 columns = RegionColumns(x, w);
+   uint32 first   = (y & 511) >> 4;
+   uint32 count   = std::min<uint32>(((y & 15) + h + 15) >> 4, 32);
+   uint32 i;
+
+   for (i = 0; i < count; i++)
+      map[(first + i) & 31] |= columns;
+}
+
+static bool RegionTest(const uint16 *map, uint32 x, uint32 y, uint32 w, uint32 h)
+{
+   uint16 columns = RegionColumns(x, w);
+   uint32 first   = (y & 511) >> 4;
+   uint32 count   = std::min<uint32>(((y & 15) + h + 15) >> 4, 32);
+   uint32 i;
+
+   for (i = 0; i < count; i++)
+      if (map[(first + i) & 31] & columns)
+         return true;
+
+   return false;
+}
+
+struct GPU_Region
+{
+   uint32 x, y, w, h;
+};
+
+/* Finds out whether the command has to wait for the render threads to be
+ * done with the commands before, and whether the first thread has to
+ * draw it alone. */
+static void ThreadDependencies(uint32_t cc, const uint32 *cb, bool *barrier,
+      bool *serial)
+{
+   GPU_Region reads[2], writes[1];
+   unsigned read_count  = 0;
+   unsigned write_count = 0;
+   unsigned i;
+
+   *barrier = false;
+   *serial  = false;
+
+   if (cc == 0x02)
+   {
+      writes[0].x = cb[1] & 0x3F0;
+      writes[0].y = (cb[1] >> 16) & 0x3FF;
+      writes[0].w = ((cb[2] & 0x3FF) + 0xF) & ~0xF;
+      writes[0].h = (cb[2] >> 16) & 0x1FF;
+      write_count = 1;
+   }
+   else if (cc >= 0x20 && cc <= 0x7F)
+   {
+      writes[0].x = GPU.ClipX0;
+      writes[0].y = GPU.ClipY0;
+      writes[0].w = std::max<int32>(GPU.ClipX1 - GPU.ClipX0 + 1, 0);
+      writes[0].h = std::max<int32>(GPU.ClipY1 - GPU.ClipY0 + 1, 0);
+      write_count = 1;
+
+      // Textured polygons and sprites
+      if ((cc < 0x40 || cc >= 0x60) && (cc & 0x4))
+      {
+         uint32 clut;
+
+         reads[0].x = GPU.TexPageX;
+         reads[0].y = GPU.TexPageY;
+         reads[0].w = GPU.TexMode == 0 ? 64 : GPU.TexMode == 1 ? 128 : 256;
+         reads[0].h = 256;
+         read_count = 1;
+
+         if (GPU.TexMode < 2)
+         {
+            if (GPU.InCmd == INCMD_QUAD)
+               clut = GPU.InQuad_clut >> 4;
+            else
+               clut = cb[2] >> 16;
+
+            reads[1].x = (clut & 0x3F) << 4;
+            reads[1].y = (clut >> 6) & 0x1FF;
+            reads[1].w = GPU.TexMode == 0 ? 16 : 256;
+            reads[1].h = 1;
+            read_count = 2;
+         }
+      }
+   }
+   else if (cc >= 0x80 && cc <= 0x9F)
+   {
+      reads[0].x  = cb[1] & 0x3FF;
+      reads[0].y  = (cb[1] >> 16) & 0x3FF;
+      writes[0].x = cb[2] & 0x3FF;
+      writes[0].y = (cb[2] >> 16) & 0x3FF;
+      reads[0].w  = writes[0].w = (cb[3] & 0x3FF) ? (cb[3] & 0x3FF) : 0x400;
+      reads[0].h  = writes[0].h = ((cb[3] >> 16) & 0x1FF) ? ((cb[3] >> 16) & 0x1FF) : 0x200;
+      read_count  = 1;
+      write_count = 1;
+   }
+   else if (cc >= 0xA0 && cc <= 0xBF)
+   {
+      writes[0].x = cb[1] & 0x3FF;
+      writes[0].y = (cb[1] >> 16) & 0x3FF;
+      writes[0].w = (cb[2] & 0x3FF) ? (cb[2] & 0x3FF) : 0x400;
+      writes[0].h = ((cb[2] >> 16) & 0x1FF) ? ((cb[2] >> 16) & 0x1FF) : 0x200;
+      write_count = 1;
+   }
+
+   /* What the command reads may be overwritten by the command itself in
+    * another band: the source of a copy onto itself, or the texture or
+    * CLUT of a primitive drawn over them. */
+   if (read_count)
+   {
+      uint16 map[32] = { 0 };
+
+      RegionMark(map, writes[0].x, writes[0].y, writes[0].w, writes[0].h);
+
+      for (i = 0; i < read_count && !*serial; i++)
+         *serial = RegionTest(map, reads[i].x, reads[i].y, reads[i].w, reads[i].h);
+   }
+
+   for (i = 0; i < read_count && !*barrier; i++)
+      *barrier = RegionTest(gpu_thread_write_map, reads[i].x, reads[i].y,
+            reads[i].w, reads[i].h);
+
+   for (i = 0; i < write_count && !*barrier; i++)
+      *barrier = RegionTest(gpu_thread_read_map, writes[i].x, writes[i].y,
+            writes[i].w, writes[i].h);
+
+   if (*barrier || *serial)
+   {
+      *barrier = true;
+      memset(gpu_thread_read_map, 0, sizeof(gpu_thread_read_map));
+      memset(gpu_thread_write_map, 0, sizeof(gpu_thread_write_map));
+   }
+
+   // Nothing may run along with a serial command, the barrier after it
+   // starts afresh
+   if (*serial)
+      return;
+
+   for (i = 0; i < read_count; i++)
+      RegionMark(gpu_thread_read_map, reads[i].x, reads[i].y,
+            reads[i].w, reads[i].h);
+
+   for (i = 0; i < write_count; i++)
+      RegionMark(gpu_thread_write_map, writes[i].x, writes[i].y,
+            writes[i].w, writes[i].h);
+}
+
+static void ThreadCommand(void (*func)(PS_GPU* g, const uint32 *cb),
+      uint32_t cc, const uint32 *cb, unsigned len, bool set_tpage)
+{
+   GPU_ThreadCmd *cmd;
+   bool barrier = false;
+   bool serial  = false;
+
+   if (gpu_thread_count > 1)
+   {
+      ThreadDependencies(cc, cb, &barrier, &serial);
+      if (barrier)
+         gpu_thread_barrier_next = true;
+   }
+
+   cmd                        = ThreadAlloc();
+   cmd->type                  = GPU_THREAD_COMMAND;
+   cmd->cc                    = cc;
+   cmd->InCmd                 = GPU.InCmd;
+   cmd->serial                = serial;
+   cmd->set_tpage             = set_tpage;
+   cmd->TexDisableAllowChange = GPU.TexDisableAllowChange;
+   cmd->field_ram_readout     = GPU.field_ram_readout;
+   cmd->DisplayMode           = GPU.DisplayMode;
+   cmd->DisplayFB_YStart      = GPU.DisplayFB_YStart;
+   cmd->func                  = func;
+   memcpy(cmd->u.cb, cb, len * sizeof(*cb));
+
+   ThreadCommit();
+
+   if (serial)
+      gpu_thread_barrier_next = true;
+}
+
+// Consecutive data words of a FBWrite share a queue entry
+static void ThreadFBWrite(uint32_t data)
+{
+   GPU_ThreadCmd *cmd;
+
+   if (gpu_thread_fbw_open)
+      cmd = &gpu_thread_ring[gpu_thread_write & (GPU_THREAD_RING_SIZE - 1)];
+   else
+   {
+      cmd                 = ThreadAlloc();
+      cmd->type           = GPU_THREAD_FBWRITE;
+      cmd->count          = 0;
+      gpu_thread_fbw_open = true;
+   }
+
+   cmd->u.cb[cmd->count++] = data;
+
+   if (cmd->count == 0x10)
+      ThreadCommit();
+}
+
+static void ThreadScanout(MDFN_Pixel *dest, unsigned pitch32, uint32_t fb_y,
+      bool bpp24, int32 dx_start, int32 dx_end, int32 fb_x, uint32_t dmw)
+{
+   GPU_ThreadCmd *cmd    = ThreadAlloc();
+
+   cmd->type             = GPU_THREAD_SCANOUT;
+   cmd->u.line.dest      = dest;
+   cmd->u.line.pitch32   = pitch32;
+   cmd->u.line.fb_y      = fb_y;
+   cmd->u.line.bpp24     = bpp24;
+   cmd->u.line.dx_start  = dx_start;
+   cmd->u.line.dx_end    = dx_end;
+   cmd->u.line.fb_x      = fb_x;
+   cmd->u.line.dmw       = dmw;
+
+   ThreadCommit();
+}
+
+static void ThreadStop(void)
+{
+   unsigned i;
+
+   if (!gpu_thread_count)
+      return;
+
+   slock_lock(gpu_thread_lock);
+   gpu_thread_quit = true;
+   scond_broadcast(gpu_thread_cond);
+   slock_unlock(gpu_thread_lock);
+
+   for (i = 0; i < gpu_thread_count; i++)
+   {
+      sthread_join(gpu_threads[i]);
+      gpu_threads[i] = NULL;
+   }
+
+   scond_free(gpu_thread_cond);
+   slock_free(gpu_thread_lock);
+   free(gpu_thread_ring);
+
+   gpu_thread_count = 0;
+   gpu_thread_cond  = NULL;
+   gpu_thread_lock  = NULL;
+   gpu_thread_ring  = NULL;
+}
+
+static bool ThreadStart(unsigned threads)
+{
+   gpu_thread_ring         = (GPU_ThreadCmd*)malloc(GPU_THREAD_RING_SIZE * sizeof(*gpu_thread_ring));
+   gpu_thread_lock         = slock_new();
+   gpu_thread_cond         = scond_new();
+   gpu_thread_write        = 0;
+   gpu_thread_read_seen    = 0;
+   gpu_thread_synced       = 0;
+   gpu_thread_fbw_open     = false;
+   gpu_thread_barrier_next = false;
+   gpu_thread_published    = 0;
+   gpu_thread_quit         = false;
+
+   memset(gpu_thread_read, 0, sizeof(gpu_thread_read));
+   memset(gpu_thread_read_map, 0, sizeof(gpu_thread_read_map));
+   memset(gpu_thread_write_map, 0, sizeof(gpu_thread_write_map));
+
+   if (!gpu_thread_ring || !gpu_thread_lock || !gpu_thread_cond)
+   {
+      if (gpu_thread_cond)
+         scond_free(gpu_thread_cond);
+      if (gpu_thread_lock)
+         slock_free(gpu_thread_lock);
+      free(gpu_thread_ring);
+      gpu_thread_cond = NULL;
+      gpu_thread_lock = NULL;
+      gpu_thread_ring = NULL;
+      return false;
+   }
+
+   /* The threads wait for each other at barriers, so they are counted
+    * as they are created */
+   for (gpu_thread_count = 0; gpu_thread_count < threads; )
+   {
+      sthread_t *thread = sthread_create(ThreadMain,
+            (void*)(uintptr_t)gpu_thread_count);
+
+      if (!thread)
+         break;
+
+      slock_lock(gpu_thread_lock);
+      gpu_threads[gpu_thread_count++] = thread;
+      slock_unlock(gpu_thread_lock);
+   }
+
+   if (!gpu_thread_count)
+   {
+      ThreadStop();
+      return false;
+   }
+
+   return true;
+}
+#endif
+
+/* Hands the state of the emulation thread over to the render threads,
+ * after it was changed outside of the command stream. GPU_Sync() must have
+ * been called before the change. */
+static void ThreadCopyState(void)
+{
+#ifdef HAVE_THREADS
+   unsigned i;
+
+   if (!GPU.timing_only)
+      return;
+
+   for (i = 0; i < gpu_thread_count; i++)
+   {
+      GPU_Render[i]             = GPU;
+      GPU_Render[i].timing_only = false;
+      GPU_Render[i].band_count  = gpu_thread_count;
+      GPU_Render[i].band_index  = i;
+   }
+#endif
+}
+
+void GPU_Sync(void)
+{
+#ifdef HAVE_THREADS
+   unsigned i, j;
+
+   if (!GPU.timing_only)
+      return;
+
+   ThreadPublish();
+
+   if (gpu_thread_synced == gpu_thread_write)
+      return;
+
+   slock_lock(gpu_thread_lock);
+   for (;;)
+   {
+      for (i = 0; i < gpu_thread_count; i++)
+         if (gpu_thread_read[i] != gpu_thread_write)
+            break;
+
+      if (i == gpu_thread_count)
+         break;
+
+      scond_wait(gpu_thread_cond, gpu_thread_lock);
+   }
+   gpu_thread_read_seen = gpu_thread_write;
+   slock_unlock(gpu_thread_lock);
+
+   gpu_thread_synced = gpu_thread_write;
+
+   /* Only the tags are maintained by the emulation thread. The CLUT is
+    * fetched by every thread, the texels by the thread drawing the pixel
+    * that last filled the cache entry. */
+   memcpy(GPU.CLUT_Cache, GPU_Render[0].CLUT_Cache, sizeof(GPU.CLUT_Cache));
+   GPU.CLUT_Gen = GPU_Render[0].CLUT_Gen;
+
+   for (i = 0; i < 256; i++)
+   {
+      for (j = 0; j < gpu_thread_count; j++)
+      {
+         if (GPU_Render[j].TexCache[i].Tag == GPU.TexCache[i].Tag)
+         {
+            GPU.TexCache[i] = GPU_Render[j].TexCache[i];
+            break;
+         }
+      }
+   }
+#endif
+}
+
+void GPU_RunOnThreads(void (*func)(void *data, unsigned index, unsigned count),
+      void *data)
+{
+#ifdef HAVE_THREADS
+   if (GPU.timing_only)
+   {
+      GPU_ThreadCmd *cmd = ThreadAlloc();
+
+      cmd->type       = GPU_THREAD_JOB;
+      // Every thread needs the lines scanned out by the others
+      cmd->barrier    = true;
+      cmd->u.job.func = func;
+      cmd->u.job.data = data;
+
+      ThreadCommit();
+      GPU_Sync();
+      return;
+   }
+#endif
+
+   func(data, 0, 1);
+}
+
+void GPU_SetThreaded(unsigned threads)
+{
+#ifdef HAVE_THREADS
+   if (threads > GPU_THREAD_MAX)
+      threads = GPU_THREAD_MAX;
+
+   if (threads == gpu_thread_count)
+      return;
+
+   if (gpu_thread_count)
+   {
+      GPU_Sync();
+      ThreadStop();
+      GPU.timing_only = false;
+   }
+
+   if (!threads || !ThreadStart(threads))
+      return;
+
+   GPU.timing_only = true;
+   ThreadCopyState();
+#endif
+}
+
 static void ProcessFIFO(uint32_t in_count)
 {
    uint32_t CB[0x10], InData;
@@ -987,7 +1996,8 @@ static void ProcessFIFO(uint32_t in_count)
    uint32_t cc            = GPU.InCmd_CC;
    const CTEntry *command = &Commands[cc];
    bool read_fifo         = false;
-   bool sw                = rsx_intf_has_software_renderer();
+   bool set_tpage         = false;
+   void (*func)(PS_GPU* g, const uint32 *cb) = NULL;
 
    switch (GPU.InCmd)
    {
@@ -997,37 +2007,12 @@ static void ProcessFIFO(uint32_t in_count)
       case INCMD_FBWRITE:
          InData = GPU_BlitterFIFO.Read();
 
-         for(i = 0; i < 2; i++)
-         {
-            /* Cannot rely on mask bit if we don't have SW renderer, HW renderer will
-             * perform masking. */
-            bool fetch = false;
-            if (sw)
-                fetch = texel_fetch(&GPU, GPU.FBRW_CurX & 1023, GPU.FBRW_CurY & 511) & GPU.MaskEvalAND;
-
-            if (!fetch)
-               texel_put(GPU.FBRW_CurX & 1023, GPU.FBRW_CurY & 511, InData | GPU.MaskSetOR);
+#ifdef HAVE_THREADS
+         if (GPU.timing_only)
+            ThreadFBWrite(InData);
+#endif
 
-            GPU.FBRW_CurX++;
-            if(GPU.FBRW_CurX == (GPU.FBRW_X + GPU.FBRW_W))
-            {
-               GPU.FBRW_CurX = GPU.FBRW_X;
-               GPU.FBRW_CurY++;
-               if(GPU.FBRW_CurY == (GPU.FBRW_Y + GPU.FBRW_H))
-               {
-                  /* Upload complete, send over to RSX */
-                  rsx_intf_load_image(
-                        GPU.FBRW_X, GPU.FBRW_Y,
-                        GPU.FBRW_W, GPU.FBRW_H,
-                        GPU.vram,
-                        GPU.MaskEvalAND,
-                        GPU.MaskSetOR);
-                  GPU.InCmd = INCMD_NONE;
-                  break;   // Break out of the for() loop.
-               }
-            }
-            InData >>= 16;
-         }
+         FBWrite_Data(&GPU, InData);
          return;
 
       case INCMD_QUAD:
@@ -1085,20 +2070,40 @@ static void ProcessFIFO(uint32_t in_count)
       
       /* Don't alter SpriteFlip here. */
       if(cc >= 0x20 && cc <= 0x3F && (cc & 0x4))
+      {
          SetTPage(&GPU, CB[4 + ((cc >> 4) & 0x1)] >> 16);
+         set_tpage = true;
+      }
    }
 
    if ((cc >= 0x80) && (cc <= 0x9F))
-      Command_FBCopy(&GPU, CB);
+      func = Command_FBCopy;
    else if ((cc >= 0xA0) && (cc <= 0xBF))
-      Command_FBWrite(&GPU, CB);
+      func = Command_FBWrite;
    else if ((cc >= 0xC0) && (cc <= 0xDF))
-      Command_FBRead(&GPU, CB);
-   else
+      func = Command_FBRead;
+   else if (command->func[GPU.abr][GPU.TexMode])
    {
-      if (command->func[GPU.abr][GPU.TexMode])
-         command->func[GPU.abr][GPU.TexMode | (GPU.MaskEvalAND ? 0x4 : 0x0)](&GPU, CB);
+      const unsigned variant = GPU.TexMode | (GPU.MaskEvalAND ? 0x4 : 0x0);
+
+      func = command->func[GPU.abr][variant];
+
+      if (cc >= 0x20 && cc < 0x80)
+         DrawCommandCounts[cc - 0x20][GPU.abr][variant]++;
    }
+
+   if (!func)
+      return;
+
+   VRAMCommandWritten(cc, CB);
+
+#ifdef HAVE_THREADS
+   /* The IRQ is raised by the emulation thread alone */
+   if (GPU.timing_only && func != Command_IRQ)
+      ThreadCommand(func, cc, CB, command_len, set_tpage);
+#endif
+
+   func(&GPU, CB);
 }
 
 static INLINE void GPU_WriteCB(uint32_t InData, uint32_t addr)
@@ -1116,7 +2121,11 @@ static INLINE void GPU_WriteCB(uint32_t InData, uint32_t addr)
    GPU_BlitterFIFO.Write(InData);
 
    if(GPU_BlitterFIFO.in_count && GPU.InCmd != INCMD_FBREAD)
+   {
+      PSX_PROFILE_ENTER(PSX_PROF_GPU_CMD);
       ProcessFIFO(GPU_BlitterFIFO.in_count);
+      PSX_PROFILE_LEAVE();
+   }
 }
 
 void GPU_Write(const int32_t timestamp, uint32_t A, uint32_t V)
@@ -1141,7 +2150,9 @@ void GPU_Write(const int32_t timestamp, uint32_t A, uint32_t V)
             break;
          case 0x00:  // Reset GPU
             //printf("\n\n************ Soft Reset %u ********* \n\n", scanline);
+            GPU_Sync();
             GPU_SoftReset();
+            ThreadCopyState();
             rsx_intf_set_draw_area(GPU.ClipX0, GPU.ClipY0,
                                    GPU.ClipX1, GPU.ClipY1);
             rsx_intf_toggle_display(GPU.DisplayOff); // `true` set by GPU_SoftReset()
@@ -1262,6 +2273,8 @@ static INLINE uint32_t GPU_ReadData(void)
 {
    unsigned i;
 
+   GPU_Sync();
+
    GPU.DataReadBufferEx = 0;
 
    for(i = 0; i < 2; i++)
@@ -1364,28 +2377,141 @@ uint32_t GPU_Read(const int32_t timestamp, uint32_t A)
    return(ret >> ((A & 3) * 8));
 }
 
+#if defined(__SSE2__) && RED_SHIFT == 16 && GREEN_SHIFT == 8 && BLUE_SHIFT == 0
+#define SCANOUT_SSE2
+
+// 15bpp pixels in the low halves of the lanes to 32bpp
+static INLINE __m128i Scanout15_4(__m128i pix)
+{
+   __m128i r = _mm_slli_epi32(_mm_and_si128(pix, _mm_set1_epi32(0x001F)), 19);
+   __m128i g = _mm_slli_epi32(_mm_and_si128(pix, _mm_set1_epi32(0x03E0)), 6);
+   __m128i b = _mm_srli_epi32(_mm_and_si128(pix, _mm_set1_epi32(0x7C00)), 7);
+
+   return _mm_or_si128(r, _mm_or_si128(g, b));
+}
+
+// 4 24bpp pixels from the first 12 bytes of bytes to 32bpp
+static INLINE __m128i Scanout24_4(__m128i bytes)
+{
+   __m128i p01 = _mm_unpacklo_epi32(bytes, _mm_srli_si128(bytes, 3));
+   __m128i p23 = _mm_unpacklo_epi32(_mm_srli_si128(bytes, 6),
+         _mm_srli_si128(bytes, 9));
+   __m128i pix = _mm_unpacklo_epi64(p01, p23);
+   __m128i r   = _mm_slli_epi32(_mm_and_si128(pix, _mm_set1_epi32(0xFF)), 16);
+   __m128i g   = _mm_and_si128(pix, _mm_set1_epi32(0xFF00));
+   __m128i b   = _mm_and_si128(_mm_srli_epi32(pix, 16), _mm_set1_epi32(0xFF));
+
+   return _mm_or_si128(r, _mm_or_si128(g, b));
+}
+
+// Stores 4 32bpp pixels as surface pixels
+static INLINE void ScanoutStore4(MDFN_Pixel *dest, __m128i pix)
+{
+#if defined(WANT_16BPP)
+   __m128i r = _mm_and_si128(_mm_srli_epi32(pix, 8), _mm_set1_epi32(0xF800));
+   __m128i g = _mm_and_si128(_mm_srli_epi32(pix, 5), _mm_set1_epi32(0x07E0));
+   __m128i b = _mm_and_si128(_mm_srli_epi32(pix, 3), _mm_set1_epi32(0x001F));
+
+   // Biased for the signed saturation of the pack
+   pix = _mm_sub_epi32(_mm_or_si128(r, _mm_or_si128(g, b)),
+         _mm_set1_epi32(0x8000));
+   pix = _mm_xor_si128(_mm_packs_epi32(pix, pix), _mm_set1_epi16((int16)0x8000));
+   _mm_storel_epi64((__m128i*)dest, pix);
+#else
+   _mm_storeu_si128((__m128i*)dest, pix);
+#endif
+}
+#endif
+
+// count 15bpp pixels from src to surface pixels
+static INLINE void Scanout15(const uint16_t *src, MDFN_Pixel *dest, int32 count)
+{
+   int32 i = 0;
+
+#ifdef SCANOUT_SSE2
+   for(; i + 8 <= count; i += 8)
+   {
+      __m128i pix = _mm_loadu_si128((const __m128i*)(src + i));
+
+#if defined(WANT_16BPP)
+      __m128i r = _mm_slli_epi16(pix, 11);
+      __m128i g = _mm_slli_epi16(_mm_and_si128(pix, _mm_set1_epi16(0x03E0)), 1);
+      __m128i b = _mm_and_si128(_mm_srli_epi16(pix, 10), _mm_set1_epi16(0x001F));
+
+      _mm_storeu_si128((__m128i*)(dest + i),
+            _mm_or_si128(r, _mm_or_si128(g, b)));
+#else
+      ScanoutStore4(dest + i,
+            Scanout15_4(_mm_unpacklo_epi16(pix, _mm_setzero_si128())));
+      ScanoutStore4(dest + i + 4,
+            Scanout15_4(_mm_unpackhi_epi16(pix, _mm_setzero_si128())));
+#endif
+   }
+#endif
+
+   for(; i < count; i++)
+   {
+      uint32_t srcpix = src[i];
+      dest[i] = MAKECOLOR(
+            (((srcpix >> 0) & 0x1F) << 3),
+            (((srcpix >> 5) & 0x1F) << 3),
+            (((srcpix >> 10) & 0x1F) << 3),
+            0);
+   }
+}
+
 static INLINE void ReorderRGB_Var(uint32_t out_Rshift,
       uint32_t out_Gshift, uint32_t out_Bshift,
-      bool bpp24, const uint16_t *src, uint32_t *dest,
+      bool bpp24, const uint16_t *src, MDFN_Pixel *dest,
       const int32 dx_start, const int32 dx_end, int32 fb_x,
       unsigned upscale_shift, unsigned upscale)
 {
   int32_t fb_mask = ((0x7FF << upscale_shift) + upscale - 1);
+  int32 x         = dx_start;
 
    if(bpp24)   // 24bpp
    {
-      for(int32 x = dx_start; x < dx_end; x+= upscale)
+#ifdef SCANOUT_SSE2
+      // 4 pixels at a time from the 12 bytes at fb_x, as long as the 16
+      // bytes loaded don't cross the end of the line
+      if (upscale == 1)
+      {
+         for(; x + 4 <= dx_end && fb_x + 16 <= 0x800; x += 4)
+         {
+            __m128i bytes = _mm_loadu_si128(
+                  (const __m128i*)((const uint8_t*)src + fb_x));
+
+            ScanoutStore4(dest + x, Scanout24_4(bytes));
+            fb_x += 12;
+         }
+      }
+#endif
+
+      for(; x < dx_end; x+= upscale)
       {
          int i;
-         uint32_t color;
+         MDFN_Pixel color;
          uint32_t srcpix = src[(fb_x >> 1) + 0]
             | (src[((fb_x >> 1) + (1 << upscale_shift)) & fb_mask] << 16);
          srcpix >>= ((fb_x >> upscale_shift) & 1) * 8;
 
-         color =   (((srcpix >> 0) << RED_SHIFT)   & (0xFF << RED_SHIFT))
-            | (((srcpix >> 8) << GREEN_SHIFT) & (0xFF << GREEN_SHIFT))
-            | (((srcpix >> 16) << BLUE_SHIFT) & (0xFF << BLUE_SHIFT));
+         color = MAKECOLOR(((srcpix >> 0) & 0xFF), ((srcpix >> 8) & 0xFF),
+               ((srcpix >> 16) & 0xFF), 0);
+
+#ifdef SCANOUT_SSE2
+         if (upscale * sizeof(MDFN_Pixel) >= 16)
+         {
+#if defined(WANT_16BPP)
+            const __m128i c = _mm_set1_epi16(color);
+#else
+            const __m128i c = _mm_set1_epi32(color);
+#endif
 
+            for (i = 0; i < upscale; i += 16 / sizeof(MDFN_Pixel))
+               _mm_storeu_si128((__m128i*)(dest + x + i), c);
+         }
+         else
+#endif
          for (i = 0; i < upscale; i++)
             dest[x + i] = color;
 
@@ -1394,20 +2520,60 @@ static INLINE void ReorderRGB_Var(uint32_t out_Rshift,
    }           // 15bpp
    else
    {
-      for(int32 x = dx_start; x < dx_end; x++)
+      // One VRAM pixel per dot at any upscaling, converted in runs up to
+      // the end of the VRAM line
+      while(x < dx_end)
       {
-         uint32_t srcpix = src[(fb_x >> 1)];
-         dest[x] = MAKECOLOR(
-               (((srcpix >> 0) & 0x1F) << 3),
-               (((srcpix >> 5) & 0x1F) << 3),
-               (((srcpix >> 10) & 0x1F) << 3),
-               0);
-
-         fb_x = (fb_x + 2) & fb_mask;
+         int32 count = std::min<int32>(dx_end - x, (fb_mask + 2 - fb_x) >> 1);
+
+         Scanout15(src + (fb_x >> 1), dest + x, count);
+
+         x   += count;
+         fb_x = (fb_x + count * 2) & fb_mask;
       }
    }
 }
 
+/* Scans out one line of the display, dest points to the first of its
+ * UPSCALE() rows in the surface */
+static void ScanoutLine(MDFN_Pixel *dest, unsigned pitch32, uint32_t fb_y,
+      bool bpp24, int32 dx_start, int32 dx_end, int32 fb_x, uint32_t dmw)
+{
+   // Convert the necessary variables to the upscaled version
+   uint32_t x;
+   uint32_t y        = fb_y     << GPU.upscale_shift;
+   uint32_t udmw     = dmw      << GPU.upscale_shift;
+   int32 udx_start   = dx_start << GPU.upscale_shift;
+   int32 udx_end     = dx_end   << GPU.upscale_shift;
+   int32 ufb_x       = fb_x     << GPU.upscale_shift;
+   unsigned _upscale = UPSCALE(&GPU);
+
+   for (uint32_t i = 0; i < _upscale; i++)
+   {
+      const uint16_t *src = GPU.vram +
+         ((y + i) << (10 + GPU.upscale_shift));
+      MDFN_Pixel *line    = dest + i * pitch32;
+
+      memset(line, 0, udx_start * sizeof(*line));
+
+      ReorderRGB_Var(
+            RED_SHIFT,
+            GREEN_SHIFT,
+            BLUE_SHIFT,
+            bpp24,
+            src,
+            line,
+            udx_start,
+            udx_end,
+            ufb_x,
+            GPU.upscale_shift,
+            _upscale);
+
+      for(x = udx_end; x < udmw; x++)
+         line[x] = 0;
+   }
+}
+
 int32_t GPU_Update(const int32_t sys_timestamp)
 {
    int32 gpu_clocks;
@@ -1427,7 +2593,11 @@ int32_t GPU_Update(const int32_t sys_timestamp)
       GPU.DrawTimeAvail = (2*EventCycles << psx_gpu_overclock_shift);
 
    if(GPU_BlitterFIFO.in_count && GPU.InCmd != INCMD_FBREAD)
+   {
+      PSX_PROFILE_ENTER(PSX_PROF_GPU_CMD);
       ProcessFIFO(GPU_BlitterFIFO.in_count);
+      PSX_PROFILE_LEAVE();
+   }
 
    //puts("GPU Update Start");
 
@@ -1562,13 +2732,15 @@ int32_t GPU_Update(const int32_t sys_timestamp)
 
                      for(int32 y = 0; y < GPU.DisplayRect->h; y++)
                      {
-                        uint32_t *dest = GPU.surface->pixels + y * GPU.surface->pitch32;
+                        MDFN_Pixel *dest = (MDFN_Pixel*)GPU.surface->pixels + y * GPU.surface->pitch32;
 
                         GPU.LineWidths[y] = 384;
 
-                        memset(dest, 0, 384 * sizeof(int32));
+                        memset(dest, 0, 384 * sizeof(*dest));
                      }
 
+                     ScanoutInvalidate();
+
                      //char buffer[256];
                      //snprintf(buffer, sizeof(buffer), "VIDEO STANDARD MISMATCH");
                      //DrawTextTrans(surface->pixels + ((DisplayRect->h / 2) - (13 / 2)) * surface->pitch32, surface->pitch32 << 2, DisplayRect->w, (UTF8*)buffer,
@@ -1589,8 +2761,9 @@ int32_t GPU_Update(const int32_t sys_timestamp)
 
                      for(int i = 0; i < (GPU.DisplayRect->y + GPU.DisplayRect->h); i++)
                      {
-                        GPU.surface->pixels[i * GPU.surface->pitch32 + 0] =
-                           GPU.surface->pixels[i * GPU.surface->pitch32 + 1] = 0;
+                        MDFN_Pixel *line = (MDFN_Pixel*)GPU.surface->pixels + i * GPU.surface->pitch32;
+
+                        line[0] = line[1] = 0;
                         GPU.LineWidths[i] = 2;
                      }
                   }
@@ -1667,7 +2840,7 @@ int32_t GPU_Update(const int32_t sys_timestamp)
             unsigned pix_clock_offset = 0;
             unsigned pix_clock = 0;
             unsigned pix_clock_div = 0;
-            uint32_t *dest = NULL;
+            MDFN_Pixel *dest = NULL;
 
             if((bool)(GPU.DisplayMode & DISP_PAL) == GPU.HardwarePALType
                   && GPU.scanline >= FirstVisibleLine
@@ -1707,50 +2880,67 @@ int32_t GPU_Update(const int32_t sys_timestamp)
 
                if (rsx_intf_is_type() == RSX_SOFTWARE)
                {
-                  // Convert the necessary variables to the upscaled version
-                  uint32_t x;
-                  uint32_t y        = GPU.DisplayFB_CurLineYReadout << GPU.upscale_shift;
-                  uint32_t udmw     = dmw      << GPU.upscale_shift;
-                  int32 udx_start   = dx_start << GPU.upscale_shift;
-                  int32 udx_end     = dx_end   << GPU.upscale_shift;
-                  int32 ufb_x       = fb_x     << GPU.upscale_shift;
-                  unsigned _upscale = UPSCALE(&GPU);
-
-                  for (uint32_t i = 0; i < _upscale; i++)
+                  uint32 fb_y       = GPU.DisplayFB_CurLineYReadout;
+                  bool bpp24        = GPU.DisplayMode & DISP_RGB24;
+                  int32 scan_start  = dx_start;
+                  int32 scan_end    = dx_end;
+                  uint32 scan_width = dmw;
+
+                  dest = (MDFN_Pixel*)GPU.surface->pixels + ((dest_line << GPU.upscale_shift) * GPU.surface->pitch32);
+
+                  // The deinterlacer and the light guns draw on the
+                  // surface after us
+                  if (scanout_sync || GPU.espec->InterlaceOn
+                        || dest_line >= SCANOUT_MAX_LINES)
                   {
-                     const uint16_t *src = GPU.vram +
-                        ((y + i) << (10 + GPU.upscale_shift));
-
-                     // printf("surface: %dx%d (%d) %u %u + %u\n",
-                     //       surface->w, surface->h, surface->pitchinpix,
-                     //       dest_line, y, i);
-
-                     dest = GPU.surface->pixels +
-                        ((dest_line << GPU.upscale_shift) + i) * GPU.surface->pitch32;
-                     memset(dest, 0, udx_start * sizeof(int32));
-
-                     //printf("%d %d %d - %d %d\n", scanline, dx_start, dx_end, HorizStart, HorizEnd);
-                     ReorderRGB_Var(
-                           RED_SHIFT,
-                           GREEN_SHIFT,
-                           BLUE_SHIFT,
-                           GPU.DisplayMode & DISP_RGB24,
-                           src,
-                           dest,
-                           udx_start,
-                           udx_end,
-                           ufb_x,
-                           GPU.upscale_shift,
-                           _upscale);
-
-                     //printf("dx_end: %d, dmw: %d\n", udx_end, udmw);
-                     //
-                     for(x = udx_end; x < udmw; x++)
-                        dest[x] = 0;
+                     if (scanout_tracked)
+                        ScanoutInvalidate();
                   }
+                  else
+                  {
+                     ScanoutLineState *state = &scanout_lines[dest_line];
+
+                     scanout_tracked = true;
 
-                  //reset dest back to i=0 for PSX_GPULineHook call
-                  dest = GPU.surface->pixels + ((dest_line << GPU.upscale_shift) * GPU.surface->pitch32);
+                     if (state->stamp && vram_line_stamp[fb_y] < state->stamp
+                           && state->fb_y == fb_y && state->fb_x == fb_x
+                           && state->dx_start == dx_start
+                           && state->dx_end == dx_end
+                           && state->dmw == dmw && state->bpp24 == bpp24)
+                     {
+                        // Only the first two pixels, cleared at the
+                        // start of the frame, need to be put back
+                        scan_start = std::min<int32>(dx_start, 2);
+                        scan_end   = std::min<int32>(dx_end, 2);
+                        scan_width = 2;
+                     }
+                     else
+                     {
+                        state->stamp    = ++scanout_stamp;
+                        state->fb_y     = fb_y;
+                        state->fb_x     = fb_x;
+                        state->dx_start = dx_start;
+                        state->dx_end   = dx_end;
+                        state->dmw      = dmw;
+                        state->bpp24    = bpp24;
+
+                        // Let frame duping know the picture changed
+                        GPU.display_possibly_dirty = true;
+                     }
+                  }
+
+#ifdef HAVE_THREADS
+                  // Light guns look at the line in PSX_GPULineHook() below
+                  if (GPU.timing_only && !scanout_sync)
+                     ThreadScanout(dest, GPU.surface->pitch32, fb_y, bpp24,
+                           scan_start, scan_end, fb_x, scan_width);
+                  else
+#endif
+                  {
+                     GPU_Sync();
+                     ScanoutLine(dest, GPU.surface->pitch32, fb_y, bpp24,
+                           scan_start, scan_end, fb_x, scan_width);
+                  }
                }
 
                //if(GPU.scanline == 64)
@@ -1764,7 +2954,7 @@ int32_t GPU_Update(const int32_t sys_timestamp)
                PSX_GPULineHook(sys_timestamp,
                                sys_timestamp - ((uint64)gpu_clocks * 65536) / GPU.GPUClockRatio,
                                GPU.scanline == 0,
-                               dest,
+                               (uint32_t*)dest,
                                &GPU.surface->format,
                                dmw_width,
                                pix_clock_offset,
@@ -1800,6 +2990,11 @@ int32_t GPU_Update(const int32_t sys_timestamp)
    //puts("GPU Update End");
 
 TheEnd:
+#ifdef HAVE_THREADS
+   if (GPU.timing_only)
+      ThreadPublish();
+#endif
+
    GPU.lastts = sys_timestamp;
 
    int32 next_dt = GPU.LineClockCounter;
@@ -1816,11 +3011,20 @@ TheEnd:
 
 void GPU_StartFrame(EmulateSpecStruct *espec_arg)
 {
+   scanout_sync        = PSX_GPULineHookWantsPixels();
    GPU.sl_zero_reached = false;
    GPU.espec           = espec_arg;
    GPU.surface         = GPU.espec->surface;
    GPU.DisplayRect     = &GPU.espec->DisplayRect;
    GPU.LineWidths      = GPU.espec->LineWidths;
+
+   if (GPU.surface->pixels != scanout_pixels
+         || GPU.surface->pitch32 != scanout_pitch32)
+   {
+      scanout_pixels  = GPU.surface->pixels;
+      scanout_pitch32 = GPU.surface->pitch32;
+      ScanoutInvalidate();
+   }
 }
 
 
@@ -1865,11 +3069,8 @@ void GPU_RestoreStateP2(bool load)
       if (load)
       {
          // Restore upscaled VRAM from savestate
-         for (unsigned y = 0; y < 512; y++)
-         {
-            for (unsigned x = 0; x < 1024; x++)
-               texel_put(x, y, vram_new[y * 1024 + x]);
-         }
+         memcpy(GPU.vram, vram_new, VRAM_Size(0));
+         VRAM_RescaleInPlace(GPU.vram, GPU.upscale_shift, 0);
       }
 
       delete [] vram_new;
@@ -1886,6 +3087,9 @@ void GPU_RestoreStateP3(void)
       for(unsigned j = 0; j < 4; j++)
          GPU.TexCache[i].Data[j] = TexCache_Data[i][j];
    }
+   // Decode the texels again with the loaded CLUT
+   GPU.CLUT_Gen++;
+   ScanoutInvalidate();
    RecalcTexWindowStuff(&GPU);
    rsx_intf_set_tex_window(GPU.tww, GPU.twh, GPU.twx, GPU.twy);
 
@@ -1929,13 +3133,14 @@ void GPU_RestoreStateP3(void)
 
 int GPU_StateAction(StateMem *sm, int load, int data_only)
 {
+   GPU_Sync();
    GPU_RestoreStateP1(load);
 
    SFORMAT StateRegs[] =
    {
       // Hardcode entry name to remain backward compatible with the
       // previous fixed internal resolution code
-      SFARRAY16N(vram_new, 1024 * 512, "&GPURAM[0][0]"),
+      SFPAGEDARRAY16N(vram_new, 1024 * 512, "&GPURAM[0][0]"),
 
       SFVARN(GPU.DMAControl, "DMAControl"),
 
@@ -2057,7 +3262,10 @@ int GPU_StateAction(StateMem *sm, int load, int data_only)
    GPU_RestoreStateP2(load);
 
    if(load)
+   {
       GPU_RestoreStateP3();
+      ThreadCopyState();
+   }
 
    return(ret);
 }
@@ -2084,7 +3292,9 @@ unsigned GPU_get_display_change_count(void)
 
 void GPU_set_dither_upscale_shift(uint8 factor)
 {
+   GPU_Sync();
    GPU.dither_upscale_shift = factor;
+   ThreadCopyState();
 }
 
 uint8 GPU_get_dither_upscale_shift(void)
@@ -2114,11 +3324,14 @@ uint16 *GPU_get_vram(void)
 
 uint16 GPU_PeekRAM(uint32 A)
 {
+   GPU_Sync();
    return texel_fetch(&GPU, A & 0x3FF, (A >> 10) & 0x1FF);
 }
 
 void GPU_PokeRAM(uint32 A, uint16 V)
 {
+   GPU_Sync();
+   VRAMLinesWritten((A >> 10) & 0x1FF, 1);
    texel_put(A & 0x3FF, (A >> 10) & 0x1FF, V);
 }
 
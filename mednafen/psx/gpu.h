@@ -60,6 +60,7 @@ struct PS_GPU
    uint16 CLUT_Cache[256];
 
    uint32 CLUT_Cache_VB;   // Don't try to be clever and reduce it to 16 bits... ~0U is value for invalidated state.
+   uint32 CLUT_Gen;        // Incremented when CLUT_Cache changes
 
    struct   // Speedup-cache varibles, derived from other variables; shouldn't be saved in save states.
    {
@@ -75,6 +76,10 @@ struct PS_GPU
    {
       uint16 Data[4];
       uint32 Tag;
+
+      // Data decoded through CLUT_Cache, valid while TexelsGen == CLUT_Gen
+      uint16 Texels[16];
+      uint32 TexelsGen;
    } TexCache[256];
 
    uint32 DMAControl;
@@ -205,6 +210,15 @@ struct PS_GPU
 
    int32 DrawTimeAvail;
 
+   // Set while the render thread draws: commands only charge DrawTimeAvail
+   // and update the cache tags, VRAM is left to the render thread.
+   bool timing_only;
+
+   // Render threads each draw one of band_count interleaved bands of
+   // lines, see BandSkipTest(). 0 or 1 draws everything.
+   uint8 band_count;
+   uint8 band_index;
+
    int32_t lastts;
 
    bool sl_zero_reached;
@@ -268,6 +282,24 @@ void GPU_FillVideoParams(MDFNGI* gi);
 
 void GPU_Power(void);
 
+// Rasterize on separate threads, software renderer only. threads is the
+// number of render threads, 0 to draw on the emulation thread.
+void GPU_SetThreaded(unsigned threads);
+
+// Waits for the render thread to catch up, VRAM and the surface are then
+// up to date. Doesn't do anything when the GPU isn't threaded.
+void GPU_Sync(void);
+
+// Calls func(data, index, count) on each of the count render threads once
+// they are done with everything queued so far, or func(data, 0, 1) when
+// the GPU isn't threaded. Returns when all calls have returned.
+void GPU_RunOnThreads(void (*func)(void *data, unsigned index, unsigned count),
+      void *data);
+
+// Logs how many times each variant of the drawing commands ran since
+// GPU_Init(), in the format of gpu_hot_commands.h
+void GPU_DumpCommandStats(void);
+
 void GPU_ResetTS(void);
 
 void GPU_Write(const int32_t timestamp, uint32_t A, uint32_t V);
@@ -1,5 +1,17 @@
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 extern enum dither_mode psx_gpu_dither_mode;
 
+static const int8 dither_table[4][4] =
+{
+   { -4,  0, -3,  1 },
+   {  2, -2,  3, -1 },
+   { -3,  1, -4,  0 },
+   {  3, -1,  2, -2 },
+};
+
 /* Return a pixel from VRAM */
 #define vram_fetch(gpu, x, y)  ((gpu)->vram[((y) << (10 + (gpu)->upscale_shift)) | (x)])
 
@@ -13,8 +25,15 @@ extern enum dither_mode psx_gpu_dither_mode;
 
 #define UPSCALE(gpu)          (1U << (gpu)->upscale_shift)
 
-template<int BlendMode>
-static INLINE void PlotPixelBlend(uint16_t bg_pix, uint16_t *fore_pix)
+/* BlendMode and TexMode_TA values of the generic command variants, the
+ * modes are then read from the GPU state (see GPU_TRIMMED_COMMANDS) */
+#define BLEND_MODE_RUNTIME    4
+#define TEX_MODE_RUNTIME      3
+
+#define BLEND_MODE(gpu, BlendMode) ((BlendMode) == BLEND_MODE_RUNTIME ? (int)(gpu)->abr : (BlendMode))
+#define TEX_MODE(gpu, TexMode_TA)  ((TexMode_TA) == TEX_MODE_RUNTIME ? std::min<uint32>(2, (gpu)->TexMode) : (TexMode_TA))
+
+static INLINE void PlotPixelBlend(int blend_mode, uint16_t bg_pix, uint16_t *fore_pix)
 {
    /*
     * fore_pix - foreground -  the screen
@@ -24,7 +43,7 @@ static INLINE void PlotPixelBlend(uint16_t bg_pix, uint16_t *fore_pix)
    uint32_t sum, carry;
 
    /* Efficient 15bpp pixel math algorithms from blargg */
-   switch(BlendMode)
+   switch(blend_mode)
    {
       /* 0.5 x B + 0.5 x F */
       case BLEND_MODE_AVERAGE:
@@ -78,7 +97,7 @@ static INLINE void PlotPixel(PS_GPU *gpu, int32_t x, int32_t y, uint16_t fore_pi
    {
       // Don't use bg_pix for mask evaluation, it's modified in blending code paths.
       uint16_t bg_pix = vram_fetch(gpu, x, y);
-      PlotPixelBlend<BlendMode>(bg_pix, &fore_pix);
+      PlotPixelBlend(BLEND_MODE(gpu, BlendMode), bg_pix, &fore_pix);
    }
 
    if(!MaskEval_TA || !(vram_fetch(gpu, x, y) & 0x8000))
@@ -100,7 +119,7 @@ static INLINE void PlotNativePixel(PS_GPU *gpu, int32_t x, int32_t y, uint16_t f
    if(BlendMode >= 0 && (fore_pix & 0x8000))
    {
       uint16_t bg_pix = texel_fetch(gpu, x, y);	// Don't use bg_pix for mask evaluation, it's modified in blending code paths.
-      PlotPixelBlend<BlendMode>(bg_pix, &fore_pix);
+      PlotPixelBlend(BLEND_MODE(gpu, BlendMode), bg_pix, &fore_pix);
    }
 
    if(!MaskEval_TA || !(texel_fetch(gpu, x, y) & 0x8000))
@@ -109,12 +128,158 @@ static INLINE void PlotNativePixel(PS_GPU *gpu, int32_t x, int32_t y, uint16_t f
 
 #define ModTexel(dither_offset, texel, r, g, b) ((texel & 0x8000) | (dither_offset[(((texel & 0x1F)  * (r))   >> (5 - 1))] << 0) | (dither_offset[(((texel & 0x3E0)  * (g))  >> (10 - 1))] << 5) | (dither_offset[(((texel & 0x7C00) * (b)) >> (15 - 1))] << 10))
 
+#if defined(__SSE2__)
+/* SSE2 versions of the functions above for spans of 8 pixels, with the
+ * 16 bit pixels of the span in the lanes of a __m128i. The scalar
+ * versions are the reference, results are identical. */
+
+// Dither offsets of the 8 pixels starting at x on line y
+static INLINE __m128i DitherOffsets8(PS_GPU *g, int32_t x, int32_t y)
+{
+   const int8 *row = dither_table[(y >> g->dither_upscale_shift) & 3];
+   unsigned i;
+   MDFN_ALIGN(16) int16 offsets[8];
+
+   for(i = 0; i < 8; i++)
+      offsets[i] = row[((x + i) >> g->dither_upscale_shift) & 3];
+
+   return _mm_load_si128((const __m128i*)offsets);
+}
+
+// Color components (up to 9 bits) to 5 bits, like DitherLUT
+static INLINE __m128i Dither8(__m128i c, __m128i offsets)
+{
+   c = _mm_srai_epi16(_mm_add_epi16(c, offsets), 3);
+   c = _mm_max_epi16(c, _mm_setzero_si128());
+
+   return _mm_min_epi16(c, _mm_set1_epi16(0x1F));
+}
+
+// ModTexel() of 8 texels, r, g and b are the 8 bit colors of each pixel
+static INLINE __m128i ModTexel8(__m128i texel, __m128i r, __m128i g, __m128i b,
+      __m128i offsets)
+{
+   const __m128i mask = _mm_set1_epi16(0x1F);
+   __m128i tr         = _mm_and_si128(texel, mask);
+   __m128i tg         = _mm_and_si128(_mm_srli_epi16(texel, 5), mask);
+   __m128i tb         = _mm_and_si128(_mm_srli_epi16(texel, 10), mask);
+
+   tr = Dither8(_mm_srli_epi16(_mm_mullo_epi16(tr, r), 4), offsets);
+   tg = Dither8(_mm_srli_epi16(_mm_mullo_epi16(tg, g), 4), offsets);
+   tb = Dither8(_mm_srli_epi16(_mm_mullo_epi16(tb, b), 4), offsets);
+
+   return _mm_or_si128(_mm_and_si128(texel, _mm_set1_epi16((int16)0x8000)),
+         _mm_or_si128(tr, _mm_or_si128(_mm_slli_epi16(tg, 5),
+               _mm_slli_epi16(tb, 10))));
+}
+
+// Per component saturated sum of two 15 bit pixels, as in PlotPixelBlend()
+static INLINE __m128i AddPixels8(__m128i a, __m128i b)
+{
+   __m128i sum   = _mm_add_epi16(a, b);
+   __m128i carry = _mm_and_si128(_mm_sub_epi16(sum,
+            _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi16(0x0421))),
+         _mm_set1_epi16(0x8420));
+
+   return _mm_or_si128(_mm_sub_epi16(sum, carry),
+         _mm_sub_epi16(carry, _mm_srli_epi16(carry, 5)));
+}
+
+/* PlotPixelBlend() of the pixels with the semi-transparency bit set, the
+ * others are returned as is */
+static INLINE __m128i PlotPixelBlend8(int blend_mode, __m128i bg_pix, __m128i fore_pix)
+{
+   const __m128i rgb = _mm_set1_epi16(0x7FFF);
+   const __m128i msb = _mm_set1_epi16((int16)0x8000);
+   __m128i f         = _mm_and_si128(fore_pix, rgb);
+   __m128i b         = _mm_and_si128(bg_pix, rgb);
+   __m128i blended;
+
+   switch(blend_mode)
+   {
+      /* 0.5 x B + 0.5 x F */
+      case BLEND_MODE_AVERAGE:
+         blended = _mm_srli_epi16(_mm_sub_epi16(_mm_add_epi16(f, b),
+                  _mm_and_si128(_mm_xor_si128(f, b), _mm_set1_epi16(0x0421))), 1);
+         break;
+
+         /* 1.0 x B + 1.0 x F */
+      case BLEND_MODE_ADD:
+         blended = AddPixels8(f, b);
+         break;
+
+         /* 1.0 x B - 1.0 x F, the components are subtracted in place */
+      case BLEND_MODE_SUBTRACT:
+         {
+            const __m128i mr = _mm_set1_epi16(0x001F);
+            const __m128i mg = _mm_set1_epi16(0x03E0);
+            const __m128i mb = _mm_set1_epi16(0x7C00);
+
+            blended = _mm_or_si128(
+                  _mm_subs_epu16(_mm_and_si128(b, mr), _mm_and_si128(f, mr)),
+                  _mm_or_si128(
+                     _mm_subs_epu16(_mm_and_si128(b, mg), _mm_and_si128(f, mg)),
+                     _mm_subs_epu16(_mm_and_si128(b, mb), _mm_and_si128(f, mb))));
+         }
+         break;
+
+         /* 1.0 x B + 0.25 * F */
+      case BLEND_MODE_ADD_FOURTH:
+         blended = AddPixels8(_mm_and_si128(_mm_srli_epi16(fore_pix, 2),
+                  _mm_set1_epi16(0x1CE7)), b);
+         break;
+
+      default:
+         return fore_pix;
+   }
+
+   blended = _mm_or_si128(blended, msb);
+
+   // Only the pixels with the semi-transparency bit are blended
+   __m128i semi = _mm_cmpeq_epi16(_mm_and_si128(fore_pix, msb), msb);
+
+   return _mm_or_si128(_mm_and_si128(semi, blended),
+         _mm_andnot_si128(semi, fore_pix));
+}
+
+/* PlotPixel() of 8 pixels: returns the pixels to write, and clears the
+ * lanes of draw that mask evaluation leaves untouched */
+template<int BlendMode, bool MaskEval_TA, bool textured>
+static INLINE __m128i PlotPixel8(PS_GPU *gpu, __m128i bg_pix, __m128i fore_pix,
+      __m128i *draw)
+{
+   const __m128i msb = _mm_set1_epi16((int16)0x8000);
+
+   if(BlendMode >= 0)
+      fore_pix = PlotPixelBlend8(BLEND_MODE(gpu, BlendMode), bg_pix, fore_pix);
+
+   if(MaskEval_TA)
+      *draw = _mm_andnot_si128(_mm_cmpeq_epi16(_mm_and_si128(bg_pix, msb), msb),
+            *draw);
+
+   if(!textured)
+      fore_pix = _mm_andnot_si128(msb, fore_pix);
+
+   return _mm_or_si128(fore_pix, _mm_set1_epi16((int16)gpu->MaskSetOR));
+}
+
+// Writes the lanes of pix selected by draw over bg_pix at dest
+static INLINE void StorePixels8(uint16 *dest, __m128i bg_pix, __m128i pix,
+      __m128i draw)
+{
+   _mm_storeu_si128((__m128i*)dest, _mm_or_si128(_mm_and_si128(draw, pix),
+            _mm_andnot_si128(draw, bg_pix)));
+}
+#endif
+
 template<uint32 TexMode_TA>
 static INLINE void Update_CLUT_Cache(PS_GPU *g, uint16 raw_clut)
 {
- if(TexMode_TA < 2)
+ const uint32 tex_mode = TEX_MODE(g, TexMode_TA);
+
+ if(tex_mode < 2)
  {
-  const uint32 new_ccvb = ((raw_clut & 0x7FFF) | (TexMode_TA << 16));	// Confirmed upper bit of raw_clut is ignored(at least on SCPH-5501's GPU).
+  const uint32 new_ccvb = ((raw_clut & 0x7FFF) | (tex_mode << 16));	// Confirmed upper bit of raw_clut is ignored(at least on SCPH-5501's GPU).
 
   if(g->CLUT_Cache_VB != new_ccvb)
   {
@@ -122,17 +287,21 @@ static INLINE void Update_CLUT_Cache(PS_GPU *g, uint16 raw_clut)
 
      //uint16* const gpulp = GPURAM[(raw_clut >> 6) & 0x1FF];
      const uint32 cxo = (raw_clut & 0x3F) << 4;
-     const uint32 count = (TexMode_TA ? 256 : 16);
+     const uint32 count = (tex_mode ? 256 : 16);
 
      g->DrawTimeAvail -= count;
 
-     for(unsigned i = 0; i < count; i++)
+     if(!g->timing_only)
+     {
+        for(unsigned i = 0; i < count; i++)
         {
            uint16_t x = (cxo + i) & 0x3FF;
            g->CLUT_Cache[i] = texel_fetch(g, x, y);
         }
+     }
 
    g->CLUT_Cache_VB = new_ccvb;
+   g->CLUT_Gen++;
   }
  }
 }
@@ -181,27 +350,56 @@ struct TexCache_t
       uint32 Tag;
 };
 
+template<uint32_t TexMode_TA>
+static INLINE PS_GPU::TexCache_t *TexCacheEntry(PS_GPU *g, uint32_t gro)
+{
+     PS_GPU::TexCache_t *TexCache = &g->TexCache[0];
+
+     switch(TEX_MODE(g, TexMode_TA))
+     {
+      case 0: return &TexCache[((gro >> 2) & 0x3) | ((gro >> 8) & 0xFC)];	// 64x64
+      case 1: return &TexCache[((gro >> 2) & 0x7) | ((gro >> 7) & 0xF8)];	// 64x32 (NOT 32x64!)
+      default: return &TexCache[((gro >> 2) & 0x7) | ((gro >> 7) & 0xF8)];	// 32x32
+     }
+}
+
+// Decodes the 4bpp or 8bpp texels of a texture cache entry through the CLUT
+static NO_INLINE void DecodeTexCacheEntry(PS_GPU *g, PS_GPU::TexCache_t *c,
+      uint32_t tex_mode)
+{
+     unsigned i, j;
+
+     for(i = 0; i < 4; i++)
+     {
+      if(tex_mode == 0)
+      {
+       for(j = 0; j < 4; j++)
+        c->Texels[(i << 2) | j] = g->CLUT_Cache[(c->Data[i] >> (j * 4)) & 0xF];
+      }
+      else
+      {
+       for(j = 0; j < 2; j++)
+        c->Texels[(i << 1) | j] = g->CLUT_Cache[(c->Data[i] >> (j * 8)) & 0xFF];
+      }
+     }
+
+     c->TexelsGen = g->CLUT_Gen;
+}
+
 template<uint32_t TexMode_TA>
 static INLINE uint16_t GetTexel(PS_GPU *g, int32_t u_arg, int32_t v_arg)
 {
 #ifdef HAS_CXX11
-     static_assert(TexMode_TA <= 2, "TexMode_TA must be <= 2");
+     static_assert(TexMode_TA <= 2 || TexMode_TA == TEX_MODE_RUNTIME, "TexMode_TA must be <= 2");
 #endif
 
+     const uint32_t tex_mode = TEX_MODE(g, TexMode_TA);
      uint32_t u_ext = ((u_arg & g->SUCV.TWX_AND) + g->SUCV.TWX_ADD);
-     uint32_t fbtex_x = ((u_ext >> (2 - TexMode_TA))) & 1023;
+     uint32_t fbtex_x = ((u_ext >> (2 - tex_mode))) & 1023;
      uint32_t fbtex_y = (v_arg & g->SUCV.TWY_AND) + g->SUCV.TWY_ADD;
      uint32_t gro = fbtex_y * 1024U + fbtex_x;
 
-     PS_GPU::TexCache_t *TexCache = &g->TexCache[0];
-     PS_GPU::TexCache_t *c = NULL;
-
-     switch(TexMode_TA)
-     {
-      case 0: c = &TexCache[((gro >> 2) & 0x3) | ((gro >> 8) & 0xFC)]; break;	// 64x64
-      case 1: c = &TexCache[((gro >> 2) & 0x7) | ((gro >> 7) & 0xF8)]; break;	// 64x32 (NOT 32x64!)
-      case 2: c = &TexCache[((gro >> 2) & 0x7) | ((gro >> 7) & 0xF8)]; break;	// 32x32
-     }
+     PS_GPU::TexCache_t *c = TexCacheEntry<TexMode_TA>(g, gro);
 
      if(MDFN_UNLIKELY(c->Tag != (gro &~ 0x3)))
      {
@@ -219,25 +417,59 @@ static INLINE uint16_t GetTexel(PS_GPU *g, int32_t u_arg, int32_t v_arg)
       c->Data[2] = texel_fetch(g, cache_x + 2, fbtex_y);
       c->Data[3] = texel_fetch(g, cache_x + 3, fbtex_y);
       c->Tag = (gro &~ 0x3);
+      c->TexelsGen = g->CLUT_Gen - 1;
      }
 
-     uint16 fbw = c->Data[gro & 0x3];
+     if(tex_mode == 2)
+      return c->Data[gro & 0x3];
 
-     if(TexMode_TA != 2)
-     {
-      if(TexMode_TA == 0)
-       fbw = (fbw >> ((u_ext & 3) * 4)) & 0xF;
-      else
-       fbw = (fbw >> ((u_ext & 1) * 8)) & 0xFF;
+     // The texels are decoded once per cache fill or CLUT change
+     if(MDFN_UNLIKELY(c->TexelsGen != g->CLUT_Gen))
+      DecodeTexCacheEntry(g, c, tex_mode);
 
-      fbw = g->CLUT_Cache[fbw];
+     if(tex_mode == 0)
+      return c->Texels[((gro & 0x3) << 2) | (u_ext & 3)];
+
+     return c->Texels[((gro & 0x3) << 1) | (u_ext & 1)];
+}
+
+// Texture cache lookup of GetTexel() without the texel fetch, for the
+// timing_only pass: the cache tags and the time charged for misses stay
+// the same as when the texel is actually drawn.
+template<uint32_t TexMode_TA>
+static INLINE void TouchTexel(PS_GPU *g, int32_t u_arg, int32_t v_arg)
+{
+     const uint32_t tex_mode = TEX_MODE(g, TexMode_TA);
+     uint32_t u_ext = ((u_arg & g->SUCV.TWX_AND) + g->SUCV.TWX_ADD);
+     uint32_t fbtex_x = ((u_ext >> (2 - tex_mode))) & 1023;
+     uint32_t fbtex_y = (v_arg & g->SUCV.TWY_AND) + g->SUCV.TWY_ADD;
+     uint32_t gro = fbtex_y * 1024U + fbtex_x;
+
+     PS_GPU::TexCache_t *c = TexCacheEntry<TexMode_TA>(g, gro);
+
+     if(MDFN_UNLIKELY(c->Tag != (gro &~ 0x3)))
+     {
+      g->DrawTimeAvail -= 4;
+      c->Tag = (gro &~ 0x3);
+      c->TexelsGen = g->CLUT_Gen - 1;
      }
+}
+
+// Lines are split between the render threads in bands of 8 lines
+#define GPU_BAND_SHIFT 3
 
-     return(fbw);
+// Returns true if another render thread draws VRAM line y
+static INLINE bool BandSkipTest(PS_GPU* g, unsigned y)
+{
+   return g->band_count > 1 &&
+      ((y >> GPU_BAND_SHIFT) % g->band_count) != g->band_index;
 }
 
 static INLINE bool LineSkipTest(PS_GPU* g, unsigned y)
 {
+   if(BandSkipTest(g, y))
+      return true;
+
    if((g->DisplayMode & 0x24) != 0x24)
       return false;
 
@@ -251,7 +483,7 @@ static INLINE bool LineSkipTest(PS_GPU* g, unsigned y)
 
 //#define BM_HELPER(fg) { fg(0), fg(1), fg(2), fg(3) }
 
-#define POLY_HELPER_SUB(bm, cv, tm, mam)	\
+#define POLY_VARIANT(bm, cv, tm, mam)	\
 	 G_Command_DrawPolygon<3 + ((cv & 0x8) >> 3), ((cv & 0x10) >> 4), ((cv & 0x4) >> 2), ((cv & 0x2) >> 1) ? bm : -1, ((cv & 1) ^ 1) & ((cv & 0x4) >> 2), tm, mam >
 
 #define POLY_HELPER_FG(bm, cv)						\
@@ -274,7 +506,7 @@ static INLINE bool LineSkipTest(PS_GPU* g, unsigned y)
  	 false															\
 	}
 
-#define SPR_HELPER_SUB(bm, cv, tm, mam) Command_DrawSprite<(cv >> 3) & 0x3,	((cv & 0x4) >> 2), ((cv & 0x2) >> 1) ? bm : -1, ((cv & 1) ^ 1) & ((cv & 0x4) >> 2), tm, mam>
+#define SPR_VARIANT(bm, cv, tm, mam) Command_DrawSprite<(cv >> 3) & 0x3,	((cv & 0x4) >> 2), ((cv & 0x2) >> 1) ? bm : -1, ((cv & 1) ^ 1) & ((cv & 0x4) >> 2), tm, mam>
 
 #define SPR_HELPER_FG(bm, cv)						\
 	 {								\
@@ -297,7 +529,20 @@ static INLINE bool LineSkipTest(PS_GPU* g, unsigned y)
 	 false													\
 	}
 
-#define LINE_HELPER_SUB(bm, cv, mam) Command_DrawLine<((cv & 0x08) >> 3), ((cv & 0x10) >> 4), ((cv & 0x2) >> 1) ? bm : -1, mam>
+#define LINE_VARIANT(bm, cv, mam) Command_DrawLine<((cv & 0x08) >> 3), ((cv & 0x10) >> 4), ((cv & 0x2) >> 1) ? bm : -1, mam>
+
+/* The trimmed table only has one variant per command and mask evaluation
+ * setting, reading the blend and texture modes at runtime. GPU_Init()
+ * then plugs in the specialized variants listed in gpu_hot_commands.h. */
+#ifdef GPU_TRIMMED_COMMANDS
+#define POLY_HELPER_SUB(bm, cv, tm, mam) POLY_VARIANT(BLEND_MODE_RUNTIME, cv, ((cv & 0x4) ? TEX_MODE_RUNTIME : 0), mam)
+#define SPR_HELPER_SUB(bm, cv, tm, mam) SPR_VARIANT(BLEND_MODE_RUNTIME, cv, ((cv & 0x4) ? TEX_MODE_RUNTIME : 0), mam)
+#define LINE_HELPER_SUB(bm, cv, mam) LINE_VARIANT(BLEND_MODE_RUNTIME, cv, mam)
+#else
+#define POLY_HELPER_SUB(bm, cv, tm, mam) POLY_VARIANT(bm, cv, tm, mam)
+#define SPR_HELPER_SUB(bm, cv, tm, mam) SPR_VARIANT(bm, cv, tm, mam)
+#define LINE_HELPER_SUB(bm, cv, mam) LINE_VARIANT(bm, cv, mam)
+#endif
 
 #define LINE_HELPER_FG(bm, cv)											\
 	 {													\
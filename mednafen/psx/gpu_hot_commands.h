@@ -0,0 +1,54 @@
+/* Drawing command variants kept fully specialized when the core is built
+ * with GPU_TRIMMED_COMMANDS=1, the other variants of a command share one
+ * generic function reading the blend and texture modes at runtime.
+ *
+ *  GPU_HOT_POLY(cc, abr, TexMode, MaskEval)
+ *  GPU_HOT_SPRITE(cc, abr, TexMode, MaskEval)
+ *  GPU_HOT_LINE(cc, abr, MaskEval)
+ *
+ * abr is only meaningful for semi-transparent commands and TexMode
+ * (0: 4bpp, 1: 8bpp, 2: 15bpp) for textured ones, they are 0 otherwise.
+ *
+ * The "beetle_psx_dump_gpu_stats" entry point (see libretro_ext.h) logs
+ * the variants run so far in this format, most used first. The list
+ * below covers what most games spend their time drawing. */
+
+/* Flat and gouraud shaded polygons */
+GPU_HOT_POLY(0x20, 0, 0, 0)
+GPU_HOT_POLY(0x28, 0, 0, 0)
+GPU_HOT_POLY(0x30, 0, 0, 0)
+GPU_HOT_POLY(0x38, 0, 0, 0)
+GPU_HOT_POLY(0x22, 0, 0, 0)
+GPU_HOT_POLY(0x32, 0, 0, 0)
+GPU_HOT_POLY(0x3a, 1, 0, 0)
+
+/* Textured polygons */
+GPU_HOT_POLY(0x24, 0, 0, 0)
+GPU_HOT_POLY(0x24, 0, 1, 0)
+GPU_HOT_POLY(0x2c, 0, 0, 0)
+GPU_HOT_POLY(0x2c, 0, 1, 0)
+GPU_HOT_POLY(0x2c, 0, 2, 0)
+GPU_HOT_POLY(0x2d, 0, 1, 0)
+GPU_HOT_POLY(0x2e, 0, 0, 0)
+GPU_HOT_POLY(0x2e, 1, 1, 0)
+GPU_HOT_POLY(0x34, 0, 0, 0)
+GPU_HOT_POLY(0x34, 0, 1, 0)
+GPU_HOT_POLY(0x3c, 0, 0, 0)
+GPU_HOT_POLY(0x3c, 0, 1, 0)
+GPU_HOT_POLY(0x3c, 0, 2, 0)
+GPU_HOT_POLY(0x3e, 1, 1, 0)
+
+/* Sprites and rectangles */
+GPU_HOT_SPRITE(0x60, 0, 0, 0)
+GPU_HOT_SPRITE(0x64, 0, 0, 0)
+GPU_HOT_SPRITE(0x64, 0, 1, 0)
+GPU_HOT_SPRITE(0x65, 0, 0, 0)
+GPU_HOT_SPRITE(0x65, 0, 1, 0)
+GPU_HOT_SPRITE(0x65, 0, 2, 0)
+GPU_HOT_SPRITE(0x66, 0, 0, 0)
+GPU_HOT_SPRITE(0x74, 0, 0, 0)
+GPU_HOT_SPRITE(0x7c, 0, 0, 0)
+
+/* Lines */
+GPU_HOT_LINE(0x40, 0, 0)
+GPU_HOT_LINE(0x48, 0, 0)
@@ -115,6 +115,9 @@ static void DrawLine(PS_GPU *gpu, line_point *points)
 
    gpu->DrawTimeAvail -= k * 2;
 
+   if(gpu->timing_only)
+      return;
+
    line_points_to_fixed_point_step<goraud>(&points[0], &points[1], k, &step);
    line_point_to_fixed_point_coord<goraud>(&points[0], &step, &cur_point);
 
@@ -233,7 +236,7 @@ static void Command_DrawLine(PS_GPU *gpu, const uint32_t *cb)
             ((uint32_t)points[0].r) | ((uint32_t)points[0].g << 8) | ((uint32_t)points[0].b << 16),
             ((uint32_t)points[1].r) | ((uint32_t)points[1].g << 8) | ((uint32_t)points[1].b << 16),
             DitherEnabled(gpu),
-            BlendMode,
+            BLEND_MODE(gpu, BlendMode),
             MaskEval_TA,
             gpu->MaskSetOR);
    }
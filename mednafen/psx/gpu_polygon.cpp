@@ -115,6 +115,140 @@ static INLINE void AddIDeltas_DY(i_group &ig, const i_deltas &idl, uint32_t coun
    }
 }
 
+#if defined(__SSE2__)
+/* Draws the span 8 pixels at a time while at least 8 are left, x, w and
+ * ig are then those of the rest of the span. The texels are still fetched
+ * one at a time, in order, for the texture cache to behave the same. */
+template<bool goraud, bool textured, int BlendMode, bool TexMult, uint32 TexMode_TA, bool MaskEval_TA>
+static INLINE void DrawSpan8(PS_GPU *gpu, int y, int32 &x, int32 &w, i_group &ig, const i_deltas &idl)
+{
+ if(w < 8)
+  return;
+
+ uint16 *line     = gpu->vram + ((y & ((512 << gpu->upscale_shift) - 1)) << (10 + gpu->upscale_shift));
+ bool dither      = DitherEnabled(gpu);
+ // With dither_upscale_shift <= 1 all the chunks have the same dither offsets
+ bool dither_span = gpu->dither_upscale_shift <= 1;
+ int32 count      = w & ~7;
+ __m128i offsets  = _mm_setzero_si128();
+ __m128i flat     = _mm_setzero_si128();
+ __m128i r[2], g[2], b[2], dr, dg, db;
+
+ if(dither && dither_span)
+  offsets = DitherOffsets8(gpu, x, y);
+
+ if(!textured && goraud)
+ {
+  r[0] = _mm_set_epi32(ig.r + idl.dr_dx * 3, ig.r + idl.dr_dx * 2, ig.r + idl.dr_dx, ig.r);
+  g[0] = _mm_set_epi32(ig.g + idl.dg_dx * 3, ig.g + idl.dg_dx * 2, ig.g + idl.dg_dx, ig.g);
+  b[0] = _mm_set_epi32(ig.b + idl.db_dx * 3, ig.b + idl.db_dx * 2, ig.b + idl.db_dx, ig.b);
+  dr   = _mm_set1_epi32(idl.dr_dx * 4);
+  dg   = _mm_set1_epi32(idl.dg_dx * 4);
+  db   = _mm_set1_epi32(idl.db_dx * 4);
+ }
+ else if(!textured)
+ {
+  const uint32 fr = ig.r >> (COORD_FBS + COORD_POST_PADDING);
+  const uint32 fg = ig.g >> (COORD_FBS + COORD_POST_PADDING);
+  const uint32 fb = ig.b >> (COORD_FBS + COORD_POST_PADDING);
+
+  flat = _mm_set1_epi16((int16)(0x8000 | (fr >> 3) | ((fg >> 3) << 5) | ((fb >> 3) << 10)));
+ }
+ else if(TexMult && !goraud)
+ {
+  r[0] = _mm_set1_epi16(ig.r >> (COORD_FBS + COORD_POST_PADDING));
+  g[0] = _mm_set1_epi16(ig.g >> (COORD_FBS + COORD_POST_PADDING));
+  b[0] = _mm_set1_epi16(ig.b >> (COORD_FBS + COORD_POST_PADDING));
+ }
+
+ do
+ {
+  __m128i fore;
+  __m128i draw = _mm_set1_epi16(-1);
+
+  if(dither && !dither_span)
+   offsets = DitherOffsets8(gpu, x, y);
+
+  if(textured)
+  {
+   MDFN_ALIGN(16) uint16 texels[8];
+   MDFN_ALIGN(16) int16 cr[8], cg[8], cb[8];
+
+   for(unsigned i = 0; i < 8; i++)
+   {
+    texels[i] = GetTexel<TexMode_TA>(gpu, ig.u >> (COORD_FBS + COORD_POST_PADDING), ig.v >> (COORD_FBS + COORD_POST_PADDING));
+
+    if(TexMult && goraud)
+    {
+     cr[i] = ig.r >> (COORD_FBS + COORD_POST_PADDING);
+     cg[i] = ig.g >> (COORD_FBS + COORD_POST_PADDING);
+     cb[i] = ig.b >> (COORD_FBS + COORD_POST_PADDING);
+    }
+
+    AddIDeltas_DX<goraud, textured>(ig, idl);
+   }
+
+   fore = _mm_load_si128((const __m128i*)texels);
+   draw = _mm_andnot_si128(_mm_cmpeq_epi16(fore, _mm_setzero_si128()), draw);
+
+   if(TexMult)
+   {
+    // Without dithering the offsets stay 0, as with DitherLUT[2][3]
+    if(goraud)
+     fore = ModTexel8(fore, _mm_load_si128((const __m128i*)cr), _mm_load_si128((const __m128i*)cg), _mm_load_si128((const __m128i*)cb), offsets);
+    else
+     fore = ModTexel8(fore, r[0], g[0], b[0], offsets);
+   }
+  }
+  else if(goraud)
+  {
+   __m128i cr, cg, cb;
+
+   r[1] = _mm_add_epi32(r[0], dr);
+   g[1] = _mm_add_epi32(g[0], dg);
+   b[1] = _mm_add_epi32(b[0], db);
+
+   cr = _mm_packs_epi32(_mm_srli_epi32(r[0], COORD_FBS + COORD_POST_PADDING), _mm_srli_epi32(r[1], COORD_FBS + COORD_POST_PADDING));
+   cg = _mm_packs_epi32(_mm_srli_epi32(g[0], COORD_FBS + COORD_POST_PADDING), _mm_srli_epi32(g[1], COORD_FBS + COORD_POST_PADDING));
+   cb = _mm_packs_epi32(_mm_srli_epi32(b[0], COORD_FBS + COORD_POST_PADDING), _mm_srli_epi32(b[1], COORD_FBS + COORD_POST_PADDING));
+
+   r[0] = _mm_add_epi32(r[1], dr);
+   g[0] = _mm_add_epi32(g[1], dg);
+   b[0] = _mm_add_epi32(b[1], db);
+
+   if(dither)
+   {
+    cr = Dither8(cr, offsets);
+    cg = Dither8(cg, offsets);
+    cb = Dither8(cb, offsets);
+   }
+   else
+   {
+    cr = _mm_srli_epi16(cr, 3);
+    cg = _mm_srli_epi16(cg, 3);
+    cb = _mm_srli_epi16(cb, 3);
+   }
+
+   fore = _mm_or_si128(_mm_set1_epi16((int16)0x8000), _mm_or_si128(cr,
+            _mm_or_si128(_mm_slli_epi16(cg, 5), _mm_slli_epi16(cb, 10))));
+  }
+  else
+   fore = flat;
+
+  __m128i bg_pix = _mm_loadu_si128((const __m128i*)&line[x]);
+  __m128i pix    = PlotPixel8<BlendMode, MaskEval_TA, textured>(gpu, bg_pix, fore, &draw);
+
+  StorePixels8(&line[x], bg_pix, pix, draw);
+
+  x += 8;
+  w -= 8;
+ } while(w >= 8);
+
+ if(!textured)
+  AddIDeltas_DX<goraud, textured>(ig, idl, count);
+}
+#endif
+
 template<bool goraud, bool textured, int BlendMode, bool TexMult, uint32 TexMode_TA, bool MaskEval_TA>
 static INLINE void DrawSpan(PS_GPU *gpu, int y, const int32 x_start, const int32 x_bound, i_group ig, const i_deltas &idl)
 {
@@ -162,6 +296,26 @@ static INLINE void DrawSpan(PS_GPU *gpu, int y, const int32 x_start, const int32
         gpu->DrawTimeAvail -= w >> gpu->upscale_shift;
   }
 
+  if(gpu->timing_only)
+  {
+   if(textured)
+   {
+    do
+    {
+     TouchTexel<TexMode_TA>(gpu, ig.u >> (COORD_FBS + COORD_POST_PADDING), ig.v >> (COORD_FBS + COORD_POST_PADDING));
+     AddIDeltas_DX<goraud, textured>(ig, idl);
+    } while(MDFN_LIKELY(--w > 0));
+   }
+   return;
+  }
+
+#if defined(__SSE2__)
+  DrawSpan8<goraud, textured, BlendMode, TexMult, TexMode_TA, MaskEval_TA>(gpu, y, x, w, ig, idl);
+
+  if(w <= 0)
+   return;
+#endif
+
   do
   {
    const uint32 r = ig.r >> (COORD_FBS + COORD_POST_PADDING);
@@ -806,9 +960,9 @@ static void Command_DrawPolygon(PS_GPU *gpu, const uint32_t *cb)
 						gpu->TexPageX, gpu->TexPageY,
 						clut_x, clut_y,
 						blend_mode,
-						2 - TexMode_TA,
+						2 - TEX_MODE(gpu, TexMode_TA),
 						DitherEnabled(gpu),
-						BlendMode,
+						BLEND_MODE(gpu, BlendMode),
 						MaskEval_TA,
 						gpu->MaskSetOR,
                   false,
@@ -855,9 +1009,9 @@ static void Command_DrawPolygon(PS_GPU *gpu, const uint32_t *cb)
 					gpu->TexPageX, gpu->TexPageY,
 					clut_x, clut_y,
 					blend_mode,
-					2 - TexMode_TA,
+					2 - TEX_MODE(gpu, TexMode_TA),
 					DitherEnabled(gpu),
-					BlendMode,
+					BLEND_MODE(gpu, BlendMode),
 					MaskEval_TA,
 					gpu->MaskSetOR);
 
@@ -1,4 +1,72 @@
 
+#if defined(__SSE2__)
+/* Draws the pixels of a sprite line 8 at a time while at least 8 are
+ * left, x and u_r are then those of the rest of the line */
+template<bool textured, int BlendMode, bool TexMult, uint32_t TexMode_TA,
+   bool MaskEval_TA>
+static INLINE void DrawSpriteSpan8(PS_GPU *gpu, int32_t &x, int32_t x_bound,
+      int32_t y, uint8_t &u_r, int32_t u_inc, uint8_t v, int32_t r, int32_t g,
+      int32_t b, uint16_t fill_color)
+{
+   const __m128i cr = _mm_set1_epi16(r);
+   const __m128i cg = _mm_set1_epi16(g);
+   const __m128i cb = _mm_set1_epi16(b);
+   uint16_t *line   = gpu->vram + ((y & 511) << 10);   // Without upscaling
+   unsigned i;
+
+   for(; MDFN_LIKELY(x + 8 <= x_bound); x += 8)
+   {
+      MDFN_ALIGN(16) uint16_t pixels[8];
+      __m128i fore, bg_pix, pix;
+      __m128i draw = _mm_set1_epi16(-1);
+
+      if(textured)
+      {
+         for(i = 0; i < 8; i++)
+         {
+            pixels[i] = GetTexel<TexMode_TA>(gpu, u_r, v);
+            u_r += u_inc;
+         }
+
+         fore = _mm_load_si128((const __m128i*)pixels);
+         draw = _mm_andnot_si128(_mm_cmpeq_epi16(fore, _mm_setzero_si128()), draw);
+
+         // Sprites use DitherLUT[2][3], which doesn't dither
+         if(TexMult)
+            fore = ModTexel8(fore, cr, cg, cb, _mm_setzero_si128());
+      }
+      else
+         fore = _mm_set1_epi16((int16_t)fill_color);
+
+      if(!gpu->upscale_shift)
+      {
+         bg_pix = _mm_loadu_si128((const __m128i*)&line[x]);
+         pix    = PlotPixel8<BlendMode, MaskEval_TA, textured>(gpu, bg_pix, fore, &draw);
+         StorePixels8(&line[x], bg_pix, pix, draw);
+         continue;
+      }
+
+      // Upscaled VRAM, each pixel is a block of UPSCALE x UPSCALE pixels
+      for(i = 0; i < 8; i++)
+         pixels[i] = texel_fetch(gpu, x + i, y & 511);
+
+      bg_pix = _mm_load_si128((const __m128i*)pixels);
+      pix    = PlotPixel8<BlendMode, MaskEval_TA, textured>(gpu, bg_pix, fore, &draw);
+
+      {
+         MDFN_ALIGN(16) uint16_t draw_lanes[8];
+
+         _mm_store_si128((__m128i*)pixels, pix);
+         _mm_store_si128((__m128i*)draw_lanes, draw);
+
+         for(i = 0; i < 8; i++)
+            if(draw_lanes[i])
+               texel_put(x + i, y & 511, pixels[i]);
+      }
+   }
+}
+#endif
+
 template<bool textured, int BlendMode, bool TexMult, uint32_t TexMode_TA,
    bool MaskEval_TA, bool FlipX, bool FlipY>
 static void DrawSprite(PS_GPU *gpu, int32_t x_arg, int32_t y_arg, int32_t w, int32_t h,
@@ -87,27 +155,47 @@ static void DrawSprite(PS_GPU *gpu, int32_t x_arg, int32_t y_arg, int32_t w, int
             gpu->DrawTimeAvail -= suck_time;
          }
 
-         for(int32_t x = x_start; MDFN_LIKELY(x < x_bound); x++)
+         if(gpu->timing_only)
          {
             if(textured)
             {
-               uint16_t fbw = GetTexel<TexMode_TA>(gpu, u_r, v);
+               for(int32_t x = x_start; MDFN_LIKELY(x < x_bound); x++)
+               {
+                  TouchTexel<TexMode_TA>(gpu, u_r, v);
+                  u_r += u_inc;
+               }
+            }
+         }
+         else
+         {
+            int32_t x = x_start;
 
-               if(fbw)
+#if defined(__SSE2__)
+            DrawSpriteSpan8<textured, BlendMode, TexMult, TexMode_TA, MaskEval_TA>(gpu, x, x_bound, y, u_r, u_inc, v, r, g, b, fill_color);
+#endif
+
+            for(; MDFN_LIKELY(x < x_bound); x++)
+            {
+               if(textured)
                {
-                  if(TexMult)
+                  uint16_t fbw = GetTexel<TexMode_TA>(gpu, u_r, v);
+
+                  if(fbw)
                   {
-                     uint8_t *dither_offset = gpu->DitherLUT[2][3];
-                     fbw = ModTexel(dither_offset, fbw, r, g, b);
+                     if(TexMult)
+                     {
+                        uint8_t *dither_offset = gpu->DitherLUT[2][3];
+                        fbw = ModTexel(dither_offset, fbw, r, g, b);
+                     }
+                     PlotNativePixel<BlendMode, MaskEval_TA, true>(gpu, x, y, fbw);
                   }
-                  PlotNativePixel<BlendMode, MaskEval_TA, true>(gpu, x, y, fbw);
                }
-            }
-            else
-               PlotNativePixel<BlendMode, MaskEval_TA, false>(gpu, x, y, fill_color);
+               else
+                  PlotNativePixel<BlendMode, MaskEval_TA, false>(gpu, x, y, fill_color);
 
-            if(textured)
-               u_r += u_inc;
+               if(textured)
+                  u_r += u_inc;
+            }
          }
       }
       if(textured)
@@ -221,9 +309,9 @@ static void Command_DrawSprite(PS_GPU *gpu, const uint32_t *cb)
                            clut_x,
                            clut_y,
                            blend_mode,
-                           2 - TexMode_TA,
+                           2 - TEX_MODE(gpu, TexMode_TA),
                            DitherEnabled(gpu),
-                           BlendMode,
+                           BLEND_MODE(gpu, BlendMode),
                            MaskEval_TA,
                            gpu->MaskSetOR,
                            true,
@@ -206,7 +206,7 @@ int32_t InputDevice_GunCon::GPULineHook(const int32_t line_timestamp, bool vsync
          {
             int r, g, b, a;
 
-            format->DecodeColor(pixels[ix * upscale_factor], r, g, b, a);
+            format->DecodeColor(((MDFN_Pixel*)pixels)[ix * upscale_factor], r, g, b, a);
 
             if((r + g + b) >= 0x40)	// Wrong, but not COMPLETELY ABSOLUTELY wrong, at least. ;)
             {
@@ -0,0 +1,212 @@
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <streams/file_stream.h>
+
+#include "profiler.h"
+
+unsigned psx_profiler_mode = 0;
+
+#define PROFILER_MAX_DEPTH 16
+
+struct profiler_zone_stats
+{
+   uint64_t host_ns;
+   uint64_t calls;
+   uint64_t cycles;
+};
+
+static const char *const zone_names[PSX_PROF__COUNT] =
+{
+   "other",
+   "cpu",
+   "dynarec",
+   "gpu",
+   "gpu_cmd",
+   "cdc",
+   "spu",
+   "timer",
+   "dma",
+   "fio",
+};
+
+// Per-frame counters, flushed to the CSV log at the end of each frame
+static profiler_zone_stats frame_stats[PSX_PROF__COUNT];
+// Counters accumulated since the last PSX_Profiler_FormatSummary() call
+static profiler_zone_stats window_stats[PSX_PROF__COUNT];
+static unsigned window_frames = 0;
+
+static unsigned zone_stack[PROFILER_MAX_DEPTH];
+static unsigned zone_depth = 0;
+static uint64_t last_mark = 0;
+
+static RFILE *log_file = NULL;
+static uint64_t log_frame = 0;
+
+static uint64_t profiler_now(void)
+{
+#ifdef _WIN32
+   static LARGE_INTEGER freq;
+   LARGE_INTEGER count;
+
+   if (!freq.QuadPart)
+      QueryPerformanceFrequency(&freq);
+
+   QueryPerformanceCounter(&count);
+   return (uint64_t)(count.QuadPart * (1000000000.0 / freq.QuadPart));
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static INLINE void charge_top(uint64_t now)
+{
+   frame_stats[zone_stack[zone_depth - 1]].host_ns += now - last_mark;
+   last_mark = now;
+}
+
+void PSX_Profiler_Enter(unsigned zone)
+{
+   // The mode can only change between frames, but be defensive about
+   // an Enter() coming in before the first BeginFrame().
+   if (!zone_depth || zone_depth >= PROFILER_MAX_DEPTH)
+      return;
+
+   charge_top(profiler_now());
+
+   zone_stack[zone_depth++] = zone;
+   frame_stats[zone].calls++;
+}
+
+void PSX_Profiler_Leave(void)
+{
+   if (zone_depth <= 1)
+      return;
+
+   charge_top(profiler_now());
+   zone_depth--;
+}
+
+void PSX_Profiler_AddCycles(unsigned zone, int32_t cycles)
+{
+   if (cycles > 0)
+      frame_stats[zone].cycles += cycles;
+}
+
+void PSX_Profiler_BeginFrame(void)
+{
+   memset(frame_stats, 0, sizeof(frame_stats));
+
+   zone_stack[0] = PSX_PROF_OTHER;
+   zone_depth    = 1;
+   last_mark     = profiler_now();
+}
+
+void PSX_Profiler_EndFrame(int32_t frame_cycles)
+{
+   unsigned i;
+   uint64_t total_ns = 0;
+
+   if (!zone_depth)
+      return;
+
+   charge_top(profiler_now());
+   zone_depth = 0;
+
+   for (i = 0; i < PSX_PROF__COUNT; i++)
+   {
+      total_ns                += frame_stats[i].host_ns;
+      window_stats[i].host_ns += frame_stats[i].host_ns;
+      window_stats[i].calls   += frame_stats[i].calls;
+      window_stats[i].cycles  += frame_stats[i].cycles;
+   }
+
+   window_frames++;
+
+   if (!log_file)
+      return;
+
+   filestream_printf(log_file, "%llu,%llu,%d",
+         (unsigned long long)log_frame++,
+         (unsigned long long)(total_ns / 1000),
+         frame_cycles);
+
+   for (i = 0; i < PSX_PROF__COUNT; i++)
+      filestream_printf(log_file, ",%llu,%llu,%llu",
+            (unsigned long long)(frame_stats[i].host_ns / 1000),
+            (unsigned long long)frame_stats[i].calls,
+            (unsigned long long)frame_stats[i].cycles);
+
+   filestream_printf(log_file, "\n");
+}
+
+void PSX_Profiler_FormatSummary(char *buf, size_t len)
+{
+   unsigned i;
+   uint64_t total_ns = 0;
+   size_t pos        = 0;
+
+   for (i = 0; i < PSX_PROF__COUNT; i++)
+      total_ns += window_stats[i].host_ns;
+
+   buf[0] = '\0';
+
+   if (total_ns && window_frames)
+   {
+      pos += snprintf(buf, len, "Frame %.2fms:",
+            (double)total_ns / window_frames / 1000000.0);
+
+      for (i = 0; i < PSX_PROF__COUNT && pos < len; i++)
+      {
+         double pct = 100.0 * window_stats[i].host_ns / total_ns;
+
+         // Keep the OSD line short, skip the noise
+         if (pct < 0.5)
+            continue;
+
+         pos += snprintf(buf + pos, len - pos, " %s %.1f%%", zone_names[i], pct);
+      }
+   }
+
+   memset(window_stats, 0, sizeof(window_stats));
+   window_frames = 0;
+}
+
+bool PSX_Profiler_OpenLog(const char *path)
+{
+   unsigned i;
+
+   PSX_Profiler_CloseLog();
+
+   log_file = filestream_open(path, RETRO_VFS_FILE_ACCESS_WRITE,
+         RETRO_VFS_FILE_ACCESS_HINT_NONE);
+
+   if (!log_file)
+      return false;
+
+   log_frame = 0;
+
+   filestream_printf(log_file, "frame,total_us,emu_cycles");
+   for (i = 0; i < PSX_PROF__COUNT; i++)
+      filestream_printf(log_file, ",%s_us,%s_calls,%s_cycles",
+            zone_names[i], zone_names[i], zone_names[i]);
+   filestream_printf(log_file, "\n");
+
+   return true;
+}
+
+void PSX_Profiler_CloseLog(void)
+{
+   if (log_file)
+      filestream_close(log_file);
+
+   log_file = NULL;
+}
@@ -0,0 +1,61 @@
+#ifndef __MDFN_PSX_PROFILER_H
+#define __MDFN_PSX_PROFILER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../mednafen-types.h"
+
+// Host wall-time attribution per emulated subsystem.
+//
+// Zones nest (the CPU calls into the event handler, the CDC calls into the
+// SPU, ...), time is always charged to the innermost active zone so the
+// per-zone figures are exclusive and add up to the whole frame.
+enum
+{
+   PSX_PROF_OTHER = 0,  // Frontend glue, input, frame finalization
+   PSX_PROF_CPU,        // PS_CPU::RunReal interpreter
+   PSX_PROF_DYNAREC,    // Lightrec execution
+   PSX_PROF_GPU,        // PSX_EVENT_GPU dispatch (timing, scanout)
+   PSX_PROF_GPU_CMD,    // GPU command FIFO processing (rasterization)
+   PSX_PROF_CDC,        // PSX_EVENT_CDC dispatch
+   PSX_PROF_SPU,        // PS_SPU::UpdateFromCDC
+   PSX_PROF_TIMER,      // PSX_EVENT_TIMER dispatch
+   PSX_PROF_DMA,        // PSX_EVENT_DMA dispatch
+   PSX_PROF_FIO,        // PSX_EVENT_FIO dispatch
+   PSX_PROF__COUNT
+};
+
+enum
+{
+   PSX_PROFILER_OVERLAY = 1 << 0,
+   PSX_PROFILER_CSV     = 1 << 1
+};
+
+// Bitmask of PSX_PROFILER_*, 0 when disabled.
+extern unsigned psx_profiler_mode;
+
+void PSX_Profiler_Enter(unsigned zone);
+void PSX_Profiler_Leave(void);
+
+// Emulated cycles attributed to a zone (CPU cycles run, SPU clocks
+// processed).
+void PSX_Profiler_AddCycles(unsigned zone, int32_t cycles);
+
+void PSX_Profiler_BeginFrame(void);
+void PSX_Profiler_EndFrame(int32_t frame_cycles);
+
+// Formats the share of host time spent in each zone over the frames
+// elapsed since the previous call, then starts a new sampling window.
+void PSX_Profiler_FormatSummary(char *buf, size_t len);
+
+bool PSX_Profiler_OpenLog(const char *path);
+void PSX_Profiler_CloseLog(void);
+
+#define PSX_PROFILE_ENTER(zone) \
+   do { if (MDFN_UNLIKELY(psx_profiler_mode)) PSX_Profiler_Enter(zone); } while (0)
+
+#define PSX_PROFILE_LEAVE() \
+   do { if (MDFN_UNLIKELY(psx_profiler_mode)) PSX_Profiler_Leave(); } while (0)
+
+#endif
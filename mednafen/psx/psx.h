@@ -80,6 +80,8 @@ void PSX_SetDMACycleSteal(unsigned stealage);
 
 // PSX_GPULineHook modified to take surface pitch (in pixels) and upscale factor for software renderer internal upscaling
 void PSX_GPULineHook(const int32_t timestamp, const int32_t line_timestamp, bool vsync, uint32_t *pixels, const MDFN_PixelFormat* const format, const unsigned width, const unsigned pix_clock_offset, const unsigned pix_clock, const unsigned pix_clock_divider, const unsigned surf_pitchinpix, const unsigned upscale_factor);
+// True when PSX_GPULineHook() looks at the pixels of the line (light guns)
+bool PSX_GPULineHookWantsPixels(void);
 
 uint32_t PSX_GetRandU32(uint32_t mina, uint32_t maxa);
 
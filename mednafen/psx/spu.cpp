@@ -1472,7 +1472,7 @@ int PS_SPU::StateAction(StateMem *sm, int load, int data_only)
 
       SFVAR(clock_divider),
 
-      SFARRAY16(SPURAM, 524288 / sizeof(uint16)),
+      SFPAGEDARRAY16N(SPURAM, 524288 / sizeof(uint16), "SPURAM"),
       SFEND
    };
 #undef SFSWEEP
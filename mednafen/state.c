@@ -33,12 +33,50 @@
 /* Forward declaration */
 int StateAction(StateMem *sm, int load, int data_only);
 
-/* Fast Save States exclude string labels from 
- * variables in the savestate, and are at least 20% faster.
+/* Fast Save States use the binary layout (see SubWriteRaw()), without
+ * string labels or per-variable sizes, and are at least 20% faster.
  * Only used for internal savestates which will not be written to a file. */
 
 uint8_t FastSaveStates = false;
 
+/* Delta states, see MDFNSS_SaveDeltaSM(). Each MDFNSTATE_PAGED array
+ * gets a shadow copy of its contents as of the last snapshot, pages are
+ * compared against it on save and it is the base the saved pages are
+ * applied on at load time. */
+#define DELTA_PAGE_SHIFT  12
+#define DELTA_PAGE_SIZE   (1 << DELTA_PAGE_SHIFT)
+#define DELTA_MAX_SHADOWS 8
+
+struct delta_shadow
+{
+   const char *name;
+   uint32_t size;
+   uint8_t *data;
+   bool valid;
+};
+
+static struct delta_shadow delta_shadows[DELTA_MAX_SHADOWS];
+
+/* Pages of a delta being saved, only copied to the shadows once the
+ * delta made it to the frontend */
+struct delta_pending
+{
+   struct delta_shadow *sh;
+   const uint8_t *src;
+   uint32_t bitmap_pos;
+};
+
+static struct delta_pending delta_pending[DELTA_MAX_SHADOWS];
+static unsigned delta_pending_count = 0;
+static bool delta_tracking = false;
+/* Set while a delta state is being saved or loaded */
+static bool delta_mode = false;
+/* Set while a snapshot the next delta will be based on is saved */
+static bool delta_base = false;
+/* Serial number of the current snapshot, 0 if unknown */
+static uint32_t delta_serial = 0;
+static uint32_t delta_last_serial = 0;
+
 static INLINE void MDFN_en32lsb_(uint8_t *buf, uint32_t morp)
 {
    buf[0]=morp;
@@ -143,6 +181,185 @@ int smem_read32le(StateMem *st, uint32_t *b)
    return(4);
 }
 
+static struct delta_shadow *GetDeltaShadow(const SFORMAT *sf)
+{
+   unsigned i;
+
+   for (i = 0; i < DELTA_MAX_SHADOWS; i++)
+   {
+      struct delta_shadow *sh = &delta_shadows[i];
+
+      if (sh->name && strcmp(sh->name, sf->name))
+         continue;
+
+      if (!sh->name || sh->size != sf->size)
+      {
+         uint8_t *data = (uint8_t*)realloc(sh->data, sf->size);
+
+         if (!data)
+            return NULL;
+
+         sh->name  = sf->name;
+         sh->size  = sf->size;
+         sh->data  = data;
+         sh->valid = false;
+      }
+
+      return sh;
+   }
+
+   return NULL;
+}
+
+static void UpdateDeltaShadow(const SFORMAT *sf)
+{
+   struct delta_shadow *sh = GetDeltaShadow(sf);
+
+   if (!sh)
+      return;
+
+   memcpy(sh->data, sf->v, sf->size);
+   sh->valid = true;
+}
+
+/* Paged entry payload: page bitmap, then the contents of the pages
+ * whose bit is set. */
+static void WritePagedDelta(StateMem *st, const SFORMAT *sf)
+{
+   uint32_t i;
+   uint32_t size_pos, bitmap_pos, start_pos, end_pos;
+   const uint8_t *src      = (const uint8_t*)sf->v;
+   uint32_t npages         = (sf->size + DELTA_PAGE_SIZE - 1) >> DELTA_PAGE_SHIFT;
+   struct delta_shadow *sh = GetDeltaShadow(sf);
+
+   size_pos = st->loc;
+   smem_write32le(st, 0);
+   start_pos  = st->loc;
+   bitmap_pos = st->loc;
+
+   for (i = 0; i < (npages + 7) >> 3; i++)
+      smem_putc(st, 0);
+
+   for (i = 0; i < npages; i++)
+   {
+      uint32_t offset = i << DELTA_PAGE_SHIFT;
+      uint32_t len    = sf->size - offset;
+
+      if (len > DELTA_PAGE_SIZE)
+         len = DELTA_PAGE_SIZE;
+
+      if (sh && sh->valid && !memcmp(src + offset, sh->data + offset, len))
+         continue;
+
+      st->data[bitmap_pos + (i >> 3)] |= 1 << (i & 7);
+      smem_write(st, (void*)(src + offset), len);
+   }
+
+   if (sh && delta_pending_count < DELTA_MAX_SHADOWS)
+   {
+      struct delta_pending *p = &delta_pending[delta_pending_count++];
+
+      p->sh         = sh;
+      p->src        = src;
+      p->bitmap_pos = bitmap_pos;
+   }
+
+   end_pos = st->loc;
+   smem_seek(st, size_pos, SEEK_SET);
+   smem_write32le(st, end_pos - start_pos);
+   smem_seek(st, end_pos, SEEK_SET);
+}
+
+/* Makes the delta just saved in st the base of the next one */
+static void CommitPagedDeltas(const StateMem *st)
+{
+   unsigned i;
+   uint32_t j;
+
+   for (i = 0; i < delta_pending_count; i++)
+   {
+      struct delta_pending *p = &delta_pending[i];
+      uint32_t npages         = (p->sh->size + DELTA_PAGE_SIZE - 1) >> DELTA_PAGE_SHIFT;
+
+      for (j = 0; j < npages; j++)
+      {
+         uint32_t offset = j << DELTA_PAGE_SHIFT;
+         uint32_t len    = p->sh->size - offset;
+
+         if (!(st->data[p->bitmap_pos + (j >> 3)] & (1 << (j & 7))))
+            continue;
+
+         if (len > DELTA_PAGE_SIZE)
+            len = DELTA_PAGE_SIZE;
+
+         memcpy(p->sh->data + offset, p->src + offset, len);
+      }
+
+      p->sh->valid = true;
+   }
+
+   delta_pending_count = 0;
+}
+
+static int ReadPagedDelta(StateMem *st, SFORMAT *sf, uint32_t recorded_size)
+{
+   uint32_t i;
+   uint8_t *dst            = (uint8_t*)sf->v;
+   uint32_t npages         = (sf->size + DELTA_PAGE_SIZE - 1) >> DELTA_PAGE_SHIFT;
+   uint32_t bitmap_len     = (npages + 7) >> 3;
+   uint32_t needed         = bitmap_len;
+   const uint8_t *bitmap, *src;
+   struct delta_shadow *sh = GetDeltaShadow(sf);
+
+   if (recorded_size < bitmap_len || st->loc + recorded_size > st->len)
+      return 0;
+
+   bitmap = st->data + st->loc;
+   src    = bitmap + bitmap_len;
+
+   /* Validate before touching anything */
+   for (i = 0; i < npages; i++)
+   {
+      uint32_t len = sf->size - (i << DELTA_PAGE_SHIFT);
+
+      if (len > DELTA_PAGE_SIZE)
+         len = DELTA_PAGE_SIZE;
+
+      if (bitmap[i >> 3] & (1 << (i & 7)))
+         needed += len;
+      else if (!sh || !sh->valid)
+         return 0;
+   }
+
+   if (needed != recorded_size)
+      return 0;
+
+   for (i = 0; i < npages; i++)
+   {
+      uint32_t offset = i << DELTA_PAGE_SHIFT;
+      uint32_t len    = sf->size - offset;
+
+      if (len > DELTA_PAGE_SIZE)
+         len = DELTA_PAGE_SIZE;
+
+      if (bitmap[i >> 3] & (1 << (i & 7)))
+      {
+         memcpy(dst + offset, src, len);
+         if (sh)
+            memcpy(sh->data + offset, src, len);
+         src += len;
+      }
+      else
+         memcpy(dst + offset, sh->data + offset, len);
+   }
+
+   if (sh)
+      sh->valid = true;
+
+   st->loc += recorded_size;
+   return 1;
+}
+
 static bool SubWrite(StateMem *st, SFORMAT *sf, const char *name_prefix)
 {
    while(sf->size || sf->name)	/* Size can sometimes be zero, so also check for the text name.  These two should both be zero only at the end of a struct. */
@@ -163,25 +380,24 @@ static bool SubWrite(StateMem *st, SFORMAT *sf, const char *name_prefix)
       }
 
       int32_t bytesize = sf->size;
+      char nameo[1 + 256];
+      int slen;
 
-      /* exclude text labels from fast savestates */
-      if (!FastSaveStates)
+      if (name_prefix)
+         slen       = snprintf(
+               nameo + 1, 256, "%s%s", name_prefix, sf->name);
+      else
       {
-         char nameo[1 + 256];
-         int slen;
+         slen       = strlcpy(nameo + 1, sf->name, 255);
+         nameo[256] = 0;
+      }
+      nameo[0]      = slen;
 
-         if (name_prefix)
-            slen       = snprintf(
-                  nameo + 1, 256, "%s%s", name_prefix, sf->name);
-         else
-         {
-            slen       = strlcpy(nameo + 1, sf->name, 255);
-            nameo[256] = 0;
-         }
-         nameo[0]      = slen;
+      smem_write(st, nameo, 1 + nameo[0]);
+
+      if ((sf->flags & MDFNSTATE_PAGED) && delta_base)
+         UpdateDeltaShadow(sf);
 
-         smem_write(st, nameo, 1 + nameo[0]);
-      }
       smem_write32le(st, bytesize);
 
 #ifdef MSB_FIRST
@@ -230,6 +446,110 @@ static bool SubWrite(StateMem *st, SFORMAT *sf, const char *name_prefix)
    return true;
 }
 
+/* Binary layout, used by fast and delta states: the variables of a
+ * section are stored back to back in SFORMAT order and host layout (bool
+ * arrays as they are in memory), so saving is a series of memcpy() and
+ * loading needs no name lookups. Instead of names, the chunk starts with
+ * a hash of the section layout (size and flags of every entry), checked
+ * before anything is loaded.
+ *
+ * The only variable length entries are MDFNSTATE_PAGED ones in delta
+ * states, which are preceded by their size. */
+static uint32_t LayoutHash(const SFORMAT *sf, uint32_t hash)
+{
+   for (; sf->size || sf->name; sf++)
+   {
+      if(!sf->size || !sf->v)
+         continue;
+
+      if(sf->size == (uint32_t)~0)
+      {
+         hash = LayoutHash((const SFORMAT*)sf->v, hash);
+         continue;
+      }
+
+      hash = (hash ^ sf->size)  * 16777619;
+      hash = (hash ^ sf->flags) * 16777619;
+   }
+
+   return hash;
+}
+
+static void SubWriteRaw(StateMem *st, SFORMAT *sf)
+{
+   for (; sf->size || sf->name; sf++)
+   {
+      uint32_t bytesize;
+
+      if(!sf->size || !sf->v)
+         continue;
+
+      if(sf->size == (uint32_t)~0)
+      {
+         SubWriteRaw(st, (SFORMAT*)sf->v);
+         continue;
+      }
+
+      if (sf->flags & MDFNSTATE_PAGED)
+      {
+         if (delta_mode)
+         {
+            WritePagedDelta(st, sf);
+            continue;
+         }
+
+         if (delta_base)
+            UpdateDeltaShadow(sf);
+      }
+
+      bytesize = sf->size;
+
+      /* The size of bool entries is the number of elements */
+      if(sf->flags & MDFNSTATE_BOOL)
+         bytesize *= sizeof(bool);
+
+      smem_write(st, sf->v, bytesize);
+   }
+}
+
+static int ReadStateChunkRaw(StateMem *st, SFORMAT *sf)
+{
+   for (; sf->size || sf->name; sf++)
+   {
+      uint32_t bytesize;
+
+      if(!sf->size || !sf->v)
+         continue;
+
+      if(sf->size == (uint32_t)~0)
+      {
+         if (!ReadStateChunkRaw(st, (SFORMAT*)sf->v))
+            return(0);
+         continue;
+      }
+
+      if ((sf->flags & MDFNSTATE_PAGED) && delta_mode)
+      {
+         if (!smem_read32le(st, &bytesize) || !ReadPagedDelta(st, sf, bytesize))
+            return(0);
+         continue;
+      }
+
+      bytesize = sf->size;
+
+      if(sf->flags & MDFNSTATE_BOOL)
+         bytesize *= sizeof(bool);
+
+      if (smem_read(st, sf->v, bytesize) != bytesize)
+         return(0);
+
+      if ((sf->flags & MDFNSTATE_PAGED) && delta_tracking)
+         UpdateDeltaShadow(sf);
+   }
+
+   return(1);
+}
+
 static int WriteStateChunk(StateMem *st, const char *sname, SFORMAT *sf)
 {
    int32_t data_start_pos;
@@ -246,7 +566,12 @@ static int WriteStateChunk(StateMem *st, const char *sname, SFORMAT *sf)
 
    data_start_pos = st->loc;
 
-   if(!SubWrite(st, sf, NULL))
+   if (FastSaveStates)
+   {
+      smem_write32le(st, LayoutHash(sf, 2166136261U));
+      SubWriteRaw(st, sf);
+   }
+   else if(!SubWrite(st, sf, NULL))
       return(0);
 
    end_pos = st->loc;
@@ -277,11 +602,6 @@ static SFORMAT *FindSF(const char *name, SFORMAT *sf)
       }
       else
       {
-         /* for fast savestates, we no longer have the 
-          * text label in the state, and need to assume 
-          * that it is the correct one. */
-         if (FastSaveStates)
-            return sf;
          assert(sf->name);
          if (!strcmp(sf->name, name))
             return sf;
@@ -293,44 +613,6 @@ static SFORMAT *FindSF(const char *name, SFORMAT *sf)
    return NULL;
 }
 
-/* Fast raw chunk reader */
-static void DOReadChunk(StateMem *st, SFORMAT *sf)
-{
-   /* Size can sometimes be zero, so also check for the text name.  
-    * These two should both be zero only at the end of a struct. */
-   while(sf->size || sf->name)       
-   {
-      int32_t bytesize;
-      if(!sf->size || !sf->v)
-      {
-         sf++;
-         continue;
-      }
-
-      /* Link to another SFORMAT struct */
-      if(sf->size == (uint32_t) ~0) 
-      {
-         DOReadChunk(st, (SFORMAT *)sf->v);
-         sf++;
-         continue;
-      }
-
-      bytesize = sf->size;
-
-      /* Loading raw data, bool types are stored as 
-       * they appear in memory, not as single bytes in the full state format.
-       * In the SFORMAT structure, the size member for 
-       * bool entries is the number of bool elements, 
-       * not the total in-memory size,
-       * so we adjust it here. */
-      if(sf->flags & MDFNSTATE_BOOL)
-         bytesize *= sizeof(bool);
-
-      smem_read(st, (uint8_t *)sf->v, bytesize);
-      sf++;
-   }
-}
-
 static int ReadStateChunk(StateMem *st, SFORMAT *sf, int size)
 {
    int temp = st->loc;
@@ -344,30 +626,25 @@ static int ReadStateChunk(StateMem *st, SFORMAT *sf, int size)
 
    while (st->loc < (temp + size))
    {
-      /* exclude text labels from fast savestates */
-      if (!FastSaveStates)
+      if (smem_read(st, toa, 1) != 1)
       {
-         if (smem_read(st, toa, 1) != 1)
-         {
-            puts("Unexpected EOF");
-            return(0);
-         }
-
-         if (smem_read(st, toa + 1, toa[0]) != toa[0])
-         {
-            puts("Unexpected EOF?");
-            return 0;
-         }
+         puts("Unexpected EOF");
+         return(0);
+      }
 
-         toa[1 + toa[0]] = 0;
+      if (smem_read(st, toa + 1, toa[0]) != toa[0])
+      {
+         puts("Unexpected EOF?");
+         return 0;
       }
 
+      toa[1 + toa[0]] = 0;
+
       smem_read32le(st, &recorded_size);
 
       SFORMAT *tmp = FindSF((char*)toa + 1, sf);
       /* Fix for unnecessary name checks, when we find 
-       * it in the first slot, don't recheck that slot again.
-       * Also necessary for fast savestates to work. */
+       * it in the first slot, don't recheck that slot again. */
       if (tmp == sf)
          sf++;
 
@@ -408,6 +685,8 @@ static int ReadStateChunk(StateMem *st, SFORMAT *sf, int size)
             else if(tmp->flags & RLSB)
                FlipByteOrder((uint8_t*)tmp->v, expected_size);
 #endif
+            if((tmp->flags & MDFNSTATE_PAGED) && delta_tracking)
+               UpdateDeltaShadow(tmp);
          }
       }
       else
@@ -429,7 +708,45 @@ static int MDFNSS_StateAction_internal(void *st_p, int load, int data_only, stru
 {
    StateMem *st = (StateMem*)st_p;
 
-   if(load)
+   if(load && FastSaveStates)
+   {
+      char sname[32];
+      uint32_t tmp_size;
+      uint32_t hash;
+      uint32_t data_start_pos = st->loc;
+
+      /* Sections are written in the same order they are loaded in,
+       * so there is no need to search for them. */
+      if(smem_read(st, (uint8_t *)sname, 32) != 32
+            || strncmp(sname, section->name, 32))
+      {
+         if(smem_seek(st, data_start_pos, SEEK_SET) < 0)
+            return(0);
+         if (section->optional)
+            return(1);
+         printf("Section missing:  %.32s\n", section->name);
+         return(0);
+      }
+
+      if(smem_read32le(st, &tmp_size) != 4 || smem_read32le(st, &hash) != 4)
+         return(0);
+
+      if(hash != LayoutHash(section->sf, 2166136261U))
+      {
+         printf("Section layout mismatch:  %.32s\n", section->name);
+         return(0);
+      }
+
+      data_start_pos += 32 + 4;
+
+      if(!ReadStateChunkRaw(st, section->sf)
+            || st->loc != data_start_pos + tmp_size)
+      {
+         printf("Bad section data:  %.32s\n", section->name);
+         return(0);
+      }
+   }
+   else if(load)
    {
       char sname[32];
 
@@ -495,33 +812,106 @@ int MDFNSS_StateAction(
    return(MDFNSS_StateAction_internal(st, load, 0, &love));
 }
 
-int MDFNSS_SaveSM(void *st_p, int a, int b, const void *c, const void *d,
-      const void *e)
+/* The state is rejected if it is larger than max_size */
+static int SaveSM_internal(StateMem *st, const char *header_magic,
+      bool base, uint32_t max_size)
 {
+   int ret;
    uint32_t sizy;
    uint8_t header[32];
-   StateMem *st = (StateMem*)st_p;
-   static const char *header_magic = "MDFNSVST";
+   uint32_t serial = 0;
    int neowidth = 0, neoheight = 0;
 
    memset(header, 0, sizeof(header));
    memcpy(header, header_magic, 8);
 
+   /* Snapshot serial and the serial of the snapshot it is based on,
+    * used to check delta states are applied in order. Snapshots that
+    * are thrown away (size queries, ...) leave both untouched. */
+   delta_base = base && delta_tracking;
+
+   if (delta_base)
+   {
+      serial = ++delta_last_serial;
+      MDFN_en32lsb_(header + 8, serial);
+      MDFN_en32lsb_(header + 12, delta_mode ? delta_serial : 0);
+   }
+
    MDFN_en32lsb_(header + 16, MEDNAFEN_VERSION_NUMERIC);
    MDFN_en32lsb_(header + 24, neowidth);
    MDFN_en32lsb_(header + 28, neoheight);
    smem_write(st, header, 32);
 
-   if(!StateAction(st, 0, 0))
+   delta_pending_count = 0;
+
+   ret        = StateAction(st, 0, 0);
+   delta_base = false;
+
+   if(!ret)
       return(0);
 
    sizy = st->loc;
+
+   /* Rejected before the delta base moves */
+   if (sizy > max_size)
+      return(0);
+
    smem_seek(st, 16 + 4, SEEK_SET);
    smem_write32le(st, sizy);
+   smem_seek(st, sizy, SEEK_SET);
+
+   CommitPagedDeltas(st);
+
+   if (serial)
+      delta_serial = serial;
 
    return(1);
 }
 
+int MDFNSS_SaveSM(void *st_p, int a, int b, const void *c, const void *d,
+      const void *e)
+{
+   return SaveSM_internal((StateMem*)st_p,
+         FastSaveStates ? "MDFNSVFS" : "MDFNSVST", false, 0xFFFFFFFF);
+}
+
+int MDFNSS_SaveBaseSM(void *st_p)
+{
+   return SaveSM_internal((StateMem*)st_p,
+         FastSaveStates ? "MDFNSVFS" : "MDFNSVST", true, 0xFFFFFFFF);
+}
+
+int MDFNSS_SaveDeltaSM(void *st_p, uint32_t max_size)
+{
+   int ret;
+   uint8_t fast_save_states = FastSaveStates;
+
+   delta_tracking = true;
+   delta_mode     = true;
+   FastSaveStates = true;
+
+   ret = SaveSM_internal((StateMem*)st_p, "MDFNSVDT", true, max_size);
+
+   FastSaveStates = fast_save_states;
+   delta_mode     = false;
+
+   return ret;
+}
+
+void MDFNSS_ResetDelta(void)
+{
+   unsigned i;
+
+   for (i = 0; i < DELTA_MAX_SHADOWS; i++)
+   {
+      free(delta_shadows[i].data);
+      memset(&delta_shadows[i], 0, sizeof(delta_shadows[i]));
+   }
+
+   delta_tracking = false;
+   delta_serial   = 0;
+}
+
 int MDFNSS_LoadSM(void *st_p, int a, int b)
 {
    uint8_t header[32];
@@ -530,11 +920,76 @@ int MDFNSS_LoadSM(void *st_p, int a, int b)
 
    smem_read(st, header, 32);
 
-   if(memcmp(header, "MEDNAFENSVESTATE", 16) 
-         && memcmp(header, "MDFNSVST", 8))
-      return(0);
-
    stateversion = MDFN_de32lsb_(header + 16);
 
-   return(StateAction(st, stateversion, 0));
+   if(!memcmp(header, "MDFNSVDT", 8))
+   {
+      int ret;
+      uint8_t fast_save_states = FastSaveStates;
+      uint32_t serial          = MDFN_de32lsb_(header + 8);
+      uint32_t base            = MDFN_de32lsb_(header + 12);
+
+      /* Must either be the current snapshot itself or follow it,
+       * unless it was the first delta saved and holds every page. */
+      if (base && (!delta_tracking ||
+               (serial != delta_serial && base != delta_serial)))
+      {
+         puts("Delta state does not apply to the current state");
+         return(0);
+      }
+
+      delta_tracking = true;
+      delta_mode     = true;
+      FastSaveStates = true;
+
+      ret = StateAction(st, stateversion, 0);
+
+      FastSaveStates = fast_save_states;
+      delta_mode     = false;
+
+      if (ret)
+         delta_serial = serial;
+
+      return(ret);
+   }
+
+   if(!memcmp(header, "MDFNSVFS", 8))
+   {
+      int ret;
+      uint8_t fast_save_states = FastSaveStates;
+
+      FastSaveStates = true;
+      ret            = StateAction(st, stateversion, 0);
+      FastSaveStates = fast_save_states;
+
+      if(!ret)
+         return(0);
+   }
+   else
+   {
+      uint8_t fast_save_states = FastSaveStates;
+      int ret;
+
+      if(memcmp(header, "MEDNAFENSVESTATE", 16) 
+            && memcmp(header, "MDFNSVST", 8))
+         return(0);
+
+      FastSaveStates = false;
+      ret            = StateAction(st, stateversion, 0);
+      FastSaveStates = fast_save_states;
+
+      if(!ret)
+         return(0);
+   }
+
+   if (delta_tracking)
+   {
+      /* States saved without tracking have no serial */
+      delta_serial = memcmp(header, "MEDNAFENSVESTATE", 16) ?
+         MDFN_de32lsb_(header + 8) : 0;
+      if (!delta_serial)
+         delta_serial = ++delta_last_serial;
+   }
+
+   return(1);
 }
@@ -44,6 +44,10 @@ struct SSDescriptor
 
 #define MDFNSTATE_BOOL		  0x08000000
 
+/* Large memory array (RAM, VRAM, ...) that delta states
+ * save page by page, see MDFNSS_SaveDeltaSM(). */
+#define MDFNSTATE_PAGED           0x04000000
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -58,11 +62,28 @@ int smem_write32le(StateMem *st, uint32_t b);
 int smem_read32le(StateMem *st, uint32_t *b);
 
 int MDFNSS_SaveSM(void *st, int a, int b, const void *c, const void *d, const void *e);
+/* Same as MDFNSS_SaveSM(), for states the frontend keeps: once delta
+ * tracking started, the next delta state is based on this one. */
+int MDFNSS_SaveBaseSM(void *st);
 int MDFNSS_LoadSM(void *st, int a, int b);
 
 int MDFNSS_StateAction(void *st, int load, int data_only,
       SFORMAT *sf, const char *name);
 
+/* Delta states hold every variable like a fast save state, except for
+ * MDFNSTATE_PAGED arrays of which only the pages modified since the
+ * previous snapshot (state saved or loaded) are stored. They are host
+ * endian, in-memory only, and MDFNSS_LoadSM() accepts them when they
+ * either follow the previous snapshot or are the previous snapshot.
+ *
+ * Page tracking starts with the first delta saved, from then on full
+ * states loaded or saved with MDFNSS_SaveBaseSM() also become delta
+ * bases. States saved with MDFNSS_SaveSM() leave the base untouched.
+ *
+ * A delta larger than max_size is rejected and doesn't become a base. */
+int MDFNSS_SaveDeltaSM(void *st, uint32_t max_size);
+void MDFNSS_ResetDelta(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,350 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+#include <rhash.h>
+#ifdef HAVE_LZMA
+#include <LzmaLib.h>
+#endif
+#ifdef HAVE_THREADS
+#include <rthreads/rthreads.h>
+#endif
+
+#include "state.h"
+#include "state_async.h"
+
+/* Released jobs kept around with their buffers, a rewind buffer or a
+ * save pipeline only has a few states in flight at any time. */
+#define ASYNC_POOL_SIZE 4
+
+struct MDFNSS_AsyncJob
+{
+   /* Uncompressed state, written on the emulation thread */
+   StateMem st;
+   uint8_t *out;
+   size_t out_malloced;
+   size_t out_size;
+   unsigned compression;
+   int level;
+   char sha256[65];
+   bool ok;
+   volatile bool done;
+   struct MDFNSS_AsyncJob *next;
+};
+
+static MDFNSS_AsyncJob *async_pool      = NULL;
+static unsigned async_pool_count        = 0;
+
+#ifdef HAVE_THREADS
+static sthread_t *async_thread          = NULL;
+static slock_t *async_lock              = NULL;
+static scond_t *async_cond              = NULL;
+static MDFNSS_AsyncJob *async_queue     = NULL;
+static MDFNSS_AsyncJob *async_queue_end = NULL;
+static bool async_quit                  = false;
+#endif
+
+static bool ReserveOutput(MDFNSS_AsyncJob *job, size_t size)
+{
+   uint8_t *out;
+
+   if (job->out_malloced >= size)
+      return true;
+
+   out = (uint8_t*)realloc(job->out, size);
+   if (!out)
+      return false;
+
+   job->out          = out;
+   job->out_malloced = size;
+
+   return true;
+}
+
+static bool Compress(MDFNSS_AsyncJob *job)
+{
+   size_t state_size = job->st.len;
+
+   switch (job->compression)
+   {
+      case MDFNSS_COMPRESS_NONE:
+         return true;
+      case MDFNSS_COMPRESS_ZLIB:
+         {
+            uLongf dest_len = compressBound(state_size);
+
+            if (!ReserveOutput(job, dest_len))
+               return false;
+
+            if (compress2(job->out, &dest_len, job->st.data, state_size,
+                     job->level < 0 ? Z_DEFAULT_COMPRESSION : job->level) != Z_OK)
+               return false;
+
+            job->out_size = dest_len;
+            return true;
+         }
+#ifdef HAVE_LZMA
+      case MDFNSS_COMPRESS_LZMA:
+         {
+            /* Worst case of incompressible data, see Lzma86Enc.h */
+            size_t dest_len      = state_size + state_size / 3 + 128;
+            size_t props_size    = LZMA_PROPS_SIZE;
+            unsigned dict_size   = 1 << 16;
+
+            /* No point in a dictionary larger than the state */
+            while (dict_size < state_size && dict_size < (1 << 24))
+               dict_size <<= 1;
+
+            if (!ReserveOutput(job, LZMA_PROPS_SIZE + dest_len))
+               return false;
+
+            if (LzmaCompress(job->out + LZMA_PROPS_SIZE, &dest_len,
+                     job->st.data, state_size, job->out, &props_size,
+                     job->level < 0 ? 5 : job->level, dict_size,
+                     -1, -1, -1, -1, 1) != SZ_OK)
+               return false;
+
+            job->out_size = LZMA_PROPS_SIZE + dest_len;
+            return true;
+         }
+#endif
+   }
+
+   return false;
+}
+
+static void ProcessJob(MDFNSS_AsyncJob *job)
+{
+   job->ok = Compress(job);
+
+   if (job->ok)
+   {
+      if (job->compression == MDFNSS_COMPRESS_NONE)
+         sha256_hash(job->sha256, job->st.data, job->st.len);
+      else
+         sha256_hash(job->sha256, job->out, job->out_size);
+   }
+}
+
+#ifdef HAVE_THREADS
+static void AsyncThread(void *data)
+{
+   slock_lock(async_lock);
+
+   for (;;)
+   {
+      MDFNSS_AsyncJob *job;
+
+      while (!async_queue && !async_quit)
+         scond_wait(async_cond, async_lock);
+
+      if (!async_queue)
+         break;
+
+      job         = async_queue;
+      async_queue = job->next;
+      if (!async_queue)
+         async_queue_end = NULL;
+
+      slock_unlock(async_lock);
+      ProcessJob(job);
+      slock_lock(async_lock);
+
+      job->done = true;
+      scond_broadcast(async_cond);
+   }
+
+   slock_unlock(async_lock);
+}
+
+static bool StartThread(void)
+{
+   if (async_thread)
+      return true;
+
+   async_lock = slock_new();
+   async_cond = scond_new();
+   async_quit = false;
+
+   if (async_lock && async_cond)
+      async_thread = sthread_create(AsyncThread, NULL);
+
+   if (!async_thread)
+   {
+      if (async_cond)
+         scond_free(async_cond);
+      if (async_lock)
+         slock_free(async_lock);
+      async_cond = NULL;
+      async_lock = NULL;
+      return false;
+   }
+
+   return true;
+}
+#endif
+
+static void FreeJob(MDFNSS_AsyncJob *job)
+{
+   free(job->st.data);
+   free(job->out);
+   free(job);
+}
+
+MDFNSS_AsyncJob *MDFNSS_SaveAsync(unsigned compression, int level)
+{
+   MDFNSS_AsyncJob *job;
+
+#ifndef HAVE_LZMA
+   if (compression == MDFNSS_COMPRESS_LZMA)
+      return NULL;
+#endif
+   if (compression > MDFNSS_COMPRESS_LZMA)
+      return NULL;
+
+   if (async_pool)
+   {
+      job        = async_pool;
+      async_pool = job->next;
+      async_pool_count--;
+   }
+   else if (!(job = (MDFNSS_AsyncJob*)calloc(1, sizeof(*job))))
+      return NULL;
+
+   /* Keep the buffer of the previous state, states are always about
+    * the same size so this is the only copy made once warmed up. */
+   job->st.loc            = 0;
+   job->st.len            = 0;
+   job->st.initial_malloc = 0;
+   job->compression       = compression;
+   job->level             = level;
+   job->out_size          = 0;
+   job->ok                = false;
+   job->done              = false;
+   job->next              = NULL;
+
+   if (!MDFNSS_SaveSM(&job->st, 0, 0, NULL, NULL, NULL))
+   {
+      /* Never queued, release must not wait for the worker */
+      job->done = true;
+      MDFNSS_AsyncRelease(job);
+      return NULL;
+   }
+
+   if (compression == MDFNSS_COMPRESS_NONE)
+      job->out_size = job->st.len;
+
+#ifdef HAVE_THREADS
+   if (StartThread())
+   {
+      slock_lock(async_lock);
+      if (async_queue_end)
+         async_queue_end->next = job;
+      else
+         async_queue           = job;
+      async_queue_end          = job;
+      scond_broadcast(async_cond);
+      slock_unlock(async_lock);
+
+      return job;
+   }
+#endif
+
+   ProcessJob(job);
+   job->done = true;
+
+   return job;
+}
+
+bool MDFNSS_AsyncDone(MDFNSS_AsyncJob *job)
+{
+   bool done;
+
+#ifdef HAVE_THREADS
+   if (async_lock)
+   {
+      slock_lock(async_lock);
+      done = job->done;
+      slock_unlock(async_lock);
+      return done;
+   }
+#endif
+
+   return job->done;
+}
+
+bool MDFNSS_AsyncWait(MDFNSS_AsyncJob *job, const void **data, size_t *size,
+      size_t *state_size, const char **sha256)
+{
+#ifdef HAVE_THREADS
+   if (async_lock)
+   {
+      slock_lock(async_lock);
+      while (!job->done)
+         scond_wait(async_cond, async_lock);
+      slock_unlock(async_lock);
+   }
+#endif
+
+   if (!job->ok)
+      return false;
+
+   if (data)
+      *data = job->compression == MDFNSS_COMPRESS_NONE ?
+         (const void*)job->st.data : (const void*)job->out;
+   if (size)
+      *size = job->out_size;
+   if (state_size)
+      *state_size = job->st.len;
+   if (sha256)
+      *sha256 = job->sha256;
+
+   return true;
+}
+
+void MDFNSS_AsyncRelease(MDFNSS_AsyncJob *job)
+{
+   if (!job)
+      return;
+
+   MDFNSS_AsyncWait(job, NULL, NULL, NULL, NULL);
+
+   if (async_pool_count >= ASYNC_POOL_SIZE)
+   {
+      FreeJob(job);
+      return;
+   }
+
+   job->next  = async_pool;
+   async_pool = job;
+   async_pool_count++;
+}
+
+void MDFNSS_AsyncShutdown(void)
+{
+#ifdef HAVE_THREADS
+   if (async_thread)
+   {
+      slock_lock(async_lock);
+      async_quit = true;
+      scond_broadcast(async_cond);
+      slock_unlock(async_lock);
+
+      sthread_join(async_thread);
+      scond_free(async_cond);
+      slock_free(async_lock);
+
+      async_thread = NULL;
+      async_cond   = NULL;
+      async_lock   = NULL;
+   }
+#endif
+
+   while (async_pool)
+   {
+      MDFNSS_AsyncJob *job = async_pool;
+      async_pool           = job->next;
+      FreeJob(job);
+   }
+   async_pool_count = 0;
+}
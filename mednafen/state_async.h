@@ -0,0 +1,50 @@
+#ifndef _STATE_ASYNC_H
+#define _STATE_ASYNC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <boolean.h>
+
+/* Asynchronous save states: MDFNSS_SaveAsync() saves the state into a
+ * pooled buffer on the calling (emulation) thread, compression and
+ * hashing of that copy are then done by a worker thread. Jobs are
+ * processed in submission order. Without thread support the work is
+ * done by MDFNSS_SaveAsync() itself. */
+
+#define MDFNSS_COMPRESS_NONE 0
+/* zlib stream, as written by compress2() */
+#define MDFNSS_COMPRESS_ZLIB 1
+/* The 5 LZMA properties bytes followed by the raw LZMA stream,
+ * as written by LzmaCompress() */
+#define MDFNSS_COMPRESS_LZMA 2
+
+typedef struct MDFNSS_AsyncJob MDFNSS_AsyncJob;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Level -1 uses the default level of the compressor. Returns NULL if the
+ * state couldn't be saved or the compression isn't supported. */
+MDFNSS_AsyncJob *MDFNSS_SaveAsync(unsigned compression, int level);
+
+bool MDFNSS_AsyncDone(MDFNSS_AsyncJob *job);
+
+/* Waits for the job to finish. On success data/size point to the
+ * compressed state, which stays valid until the job is released,
+ * state_size is the size of the uncompressed state and sha256 the hex
+ * SHA-256 of data. */
+bool MDFNSS_AsyncWait(MDFNSS_AsyncJob *job, const void **data, size_t *size,
+      size_t *state_size, const char **sha256);
+
+/* Waits for the job if needed, then returns its buffers to the pool */
+void MDFNSS_AsyncRelease(MDFNSS_AsyncJob *job);
+
+/* Finishes the queued jobs, stops the worker and frees the pool */
+void MDFNSS_AsyncShutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -44,6 +44,10 @@ INLINE uint32_t SF_FORCE_D(double *) { return(0); }
 #define SFARRAYDN(x, l, n) { (x), (uint32_t)((l) * 8), MDFNSTATE_RLSB64 | SF_FORCE_D(x), n }
 #define SFARRAYD(x, l) SFARRAYDN((x), (l), #x)
 
+/* Large memory arrays, stored page by page in delta states */
+#define SFPAGEDARRAYN(x, l, n) { (x), (uint32_t)(l), MDFNSTATE_PAGED | SF_FORCE_A8(x), n }
+#define SFPAGEDARRAY16N(x, l, n) { (x), (uint32_t)((l) * sizeof(uint16_t)), MDFNSTATE_RLSB16 | MDFNSTATE_PAGED | SF_FORCE_A16(x), n }
+
 #define SFEND { 0, 0, 0, 0 }
 
 #endif
@@ -4,10 +4,17 @@
 
 #include "surface.h"
 
-extern "C" uint8_t psx_gpu_upscale_shift;
-
 #include "Deinterlacer.h"
-Deinterlacer::Deinterlacer() : FieldBuffer(NULL), StateValid(false), DeintType(DEINT_WEAVE)
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Largest difference of a color component between the previous field and
+// the interpolated current one for a pixel to be taken as still
+#define BLEND_MOTION_THRESHOLD 0x18
+
+Deinterlacer::Deinterlacer() : StateValid(false), PrevField(false), PrevUpscaleShift(0), DeintType(DEINT_WEAVE)
 {
  PrevDRect.x = 0;
  PrevDRect.y = 0;
@@ -18,11 +25,6 @@ Deinterlacer::Deinterlacer() : FieldBuffer(NULL), StateValid(false), DeintType(D
 
 Deinterlacer::~Deinterlacer()
 {
- if(FieldBuffer)
- {
-  delete FieldBuffer;
-  FieldBuffer = NULL;
- }
 }
 
 void Deinterlacer::SetType(unsigned dt)
@@ -32,150 +34,225 @@ void Deinterlacer::SetType(unsigned dt)
   DeintType = dt;
 
   LWBuffer.resize(0);
-  if(FieldBuffer)
-  {
-   delete FieldBuffer;
-   FieldBuffer = NULL;
-  }
+  EdgeBuffer.resize(0);
   StateValid = false;
  }
 }
 
-template<typename T>
-void Deinterlacer::InternalProcess(MDFN_Surface *surface, MDFN_Rect &DisplayRect, int32 *LineWidths, const bool field)
+// Pixels of the previous field where they match the interpolation of the
+// lines around them, the interpolation elsewhere
+static void BlendLine(const MDFN_PixelFormat &format, MDFN_Pixel *dest, const MDFN_Pixel *above, const MDFN_Pixel *below, int32 width, bool still)
 {
- //
- // We need to output with LineWidths as always being valid to handle the case of horizontal resolution change between fields
- // while in interlace mode, so clear the first LineWidths entry if it's == ~0, and
- // [...]
- const bool LineWidths_In_Valid = (LineWidths[0] != ~0);
- const bool WeaveGood = (StateValid && PrevDRect.h == DisplayRect.h && DeintType == DEINT_WEAVE);
- //
- // XReposition stuff is to prevent exceeding the dimensions of the video surface under certain conditions(weave deinterlacer, previous field has higher
- // horizontal resolution than current field, and current field's rectangle has an x offset that's too large when taking into consideration the previous field's
- // width; for simplicity, we don't check widths, but just assume that the previous field's maximum width is >= than the current field's maximum width).
- //
- const int32 XReposition = ((WeaveGood && DisplayRect.x > PrevDRect.x) ? DisplayRect.x : 0);
+ int32 x = 0;
+
+#if defined(__SSE2__) && !defined(WANT_16BPP)
+ const __m128i threshold = _mm_set1_epi8(BLEND_MOTION_THRESHOLD);
+ const __m128i rgb = _mm_set1_epi32(0x00FFFFFF);
+
+ for(; x + 4 <= width; x += 4)
+ {
+  __m128i interp = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(above + x)),
+    _mm_loadu_si128((const __m128i*)(below + x)));
 
- //printf("%2d %2d, %d\n", DisplayRect.x, PrevDRect.x, XReposition);
+  if(still)
+  {
+   __m128i prev = _mm_loadu_si128((const __m128i*)(dest + x));
+   __m128i diff = _mm_or_si128(_mm_subs_epu8(prev, interp), _mm_subs_epu8(interp, prev));
+   __m128i keep = _mm_cmpeq_epi32(_mm_and_si128(_mm_subs_epu8(diff, threshold), rgb), _mm_setzero_si128());
+
+   interp = _mm_or_si128(_mm_and_si128(keep, prev), _mm_andnot_si128(keep, interp));
+  }
 
- if(XReposition)
-  DisplayRect.x = 0;
+  _mm_storeu_si128((__m128i*)(dest + x), interp);
+ }
+#endif
 
- if(surface->h && !LineWidths_In_Valid)
+ for(; x < width; x++)
  {
-  LineWidths[0] = 0;
+  int ar, ag, ab, br, bg, bb, a;
+  int r, g, b;
+  MDFN_Pixel interp;
+
+  format.DecodeColor(above[x], ar, ag, ab, a);
+  format.DecodeColor(below[x], br, bg, bb, a);
+
+  r = (ar + br + 1) >> 1;
+  g = (ag + bg + 1) >> 1;
+  b = (ab + bb + 1) >> 1;
+  interp = MAKECOLOR(r, g, b, 0);
+
+  if(still)
+  {
+   int pr, pg, pb;
+
+   format.DecodeColor(dest[x], pr, pg, pb, a);
+
+   if(abs(pr - r) <= BLEND_MOTION_THRESHOLD && abs(pg - g) <= BLEND_MOTION_THRESHOLD && abs(pb - b) <= BLEND_MOTION_THRESHOLD)
+    continue;
+  }
+
+  dest[x] = interp;
  }
+}
 
- for(int y = 0; y < DisplayRect.h / 2; y++)
+template<typename T>
+void Deinterlacer::InternalProcess(unsigned first, unsigned last)
+{
+ const MDFN_Rect &DisplayRect = *DRect;
+ const unsigned upscale = 1 << UpscaleShift;
+ const int32 pitch = Surface->pitchinpix;
+ T *pixels = (T*)Surface->pixels;
+
+ for(unsigned y = first; y < last; y++)
  {
+  // Lines are numbered at 1x, each is upscale rows of the surface
+  const int32 sly = (y * 2) + Field + DisplayRect.y;
+  const int32 oly = (y * 2) + (Field ^ 1) + DisplayRect.y;
+  T *src = pixels + (sly << UpscaleShift) * pitch;
+  T *other = pixels + (oly << UpscaleShift) * pitch;
+  T *edge = &EdgeBuffer[(y << UpscaleShift) * 2];
+  unsigned r;
+
   // [...]
   // set all relevant source line widths to the contents of DisplayRect(also simplifies the src_lw and related pointer calculation code
   // farther below.
-  if(!LineWidths_In_Valid)
-   LineWidths[(y * 2) + field + DisplayRect.y] = DisplayRect.w;
+  if(!LineWidthsInValid)
+   LW[sly] = DisplayRect.w;
 
-  if(XReposition)
+  const int32 src_lw = LW[sly];
+  const int32 row_len = src_lw << UpscaleShift;
+
+  // The rows of the other field were left as the previous field made
+  // them, save for their first two pixels
+  if(WeaveGood)
   {
-    memmove(surface->pixels + ((y * 2) + field + DisplayRect.y) * surface->pitchinpix,
-	    surface->pixels + ((y * 2) + field + DisplayRect.y) * surface->pitchinpix + XReposition,
-	    LineWidths[(y * 2) + field + DisplayRect.y] * sizeof(T));
+   for(r = 0; r < upscale; r++)
+   {
+    other[r * pitch + 0] = edge[r * 2 + 0];
+    other[r * pitch + 1] = edge[r * 2 + 1];
+   }
   }
 
-  if(WeaveGood)
+  if(WeaveGood && DeintType == DEINT_WEAVE)
+   LW[oly] = LWBuffer[y];
+  else if(DeintType == DEINT_BLEND)
   {
-   const T* src = FieldBuffer->pixels + y * FieldBuffer->pitchinpix;
-   T* dest = surface->pixels + ((y * 2) + (field ^ 1) + DisplayRect.y) * surface->pitchinpix + DisplayRect.x;
-   int32 *dest_lw = &LineWidths[(y * 2) + (field ^ 1) + DisplayRect.y];
+   const bool still = WeaveGood && LWBuffer[y] == src_lw;
+   int32 above_ly = oly - 1;
+   int32 below_ly = oly + 1;
 
-   *dest_lw = LWBuffer[y];
+   if(above_ly < DisplayRect.y)
+    above_ly = below_ly;
+   if(below_ly >= (DisplayRect.y + DisplayRect.h))
+    below_ly = above_ly;
 
-   if (psx_gpu_upscale_shift == 0)
-      memcpy(dest, src, LWBuffer[y] * sizeof(T));
+   // Nearest rows of the lines of this field
+   const T *above = pixels + (((above_ly + 1) << UpscaleShift) - 1) * pitch + (DisplayRect.x << UpscaleShift);
+   const T *below = pixels + (below_ly << UpscaleShift) * pitch + (DisplayRect.x << UpscaleShift);
+
+   if(oly < (DisplayRect.y + DisplayRect.h))
+   {
+    LW[oly] = src_lw;
+
+    for(r = 0; r < upscale; r++)
+     BlendLine(Surface->format, other + r * pitch + (DisplayRect.x << UpscaleShift), above, below, row_len, still);
+   }
   }
   else if(DeintType == DEINT_BOB)
   {
-   const T* src = surface->pixels + ((y * 2) + field + DisplayRect.y) * surface->pitchinpix + DisplayRect.x;
-   T* dest = surface->pixels + ((y * 2) + (field ^ 1) + DisplayRect.y) * surface->pitchinpix + DisplayRect.x;
-   const int32 *src_lw = &LineWidths[(y * 2) + field + DisplayRect.y];
-   int32 *dest_lw = &LineWidths[(y * 2) + (field ^ 1) + DisplayRect.y];
-
-   *dest_lw = *src_lw;
+   LW[oly] = src_lw;
 
-   memcpy(dest, src, *src_lw * sizeof(T));
+   for(r = 0; r < upscale; r++)
+    memcpy(other + r * pitch + (DisplayRect.x << UpscaleShift), src + r * pitch + (DisplayRect.x << UpscaleShift), row_len * sizeof(T));
   }
   else
   {
-   const int32 *src_lw = &LineWidths[(y * 2) + field + DisplayRect.y];
-   const T* src = surface->pixels + ((y * 2) + field + DisplayRect.y) * surface->pitchinpix + DisplayRect.x;
-   const int32 dly = ((y * 2) + (field + 1) + DisplayRect.y);
-   T* dest = surface->pixels + dly * surface->pitchinpix + DisplayRect.x;
+   const int32 dly = ((y * 2) + (Field + 1) + DisplayRect.y);
+   T* dest = pixels + (dly << UpscaleShift) * pitch + (DisplayRect.x << UpscaleShift);
 
-   if(y == 0 && field)
+   if(y == 0 && Field)
    {
     T black = MAKECOLOR(0, 0, 0, 0);
-    T* dm2 = surface->pixels + (dly - 2) * surface->pitchinpix;
+    T* dm2 = pixels + ((dly - 2) << UpscaleShift) * pitch;
 
-    LineWidths[dly - 2] = *src_lw;
+    LW[dly - 2] = src_lw;
 
-    for(int x = 0; x < *src_lw; x++)
-     dm2[x] = black;
+    for(r = 0; r < upscale; r++)
+     for(int x = 0; x < row_len; x++)
+      dm2[r * pitch + x] = black;
    }
 
    if(dly < (DisplayRect.y + DisplayRect.h))
    {
-    LineWidths[dly] = *src_lw;
-    memcpy(dest, src, *src_lw * sizeof(T));
+    LW[dly] = src_lw;
+
+    for(r = 0; r < upscale; r++)
+     memcpy(dest + r * pitch, src + r * pitch + (DisplayRect.x << UpscaleShift), row_len * sizeof(T));
    }
   }
 
-  //
-  //
-  //
-  //
-  //
-  //
-  if(DeintType == DEINT_WEAVE)
+  for(r = 0; r < upscale; r++)
   {
-   const int32 *src_lw = &LineWidths[(y * 2) + field + DisplayRect.y];
-   const T* src = surface->pixels + ((y * 2) + field + DisplayRect.y) * surface->pitchinpix + DisplayRect.x;
-   T* dest = FieldBuffer->pixels + y * FieldBuffer->pitchinpix;
-
-   memcpy(dest, src, *src_lw * sizeof(uint32));
-   LWBuffer[y] = *src_lw;
-
-   StateValid = true;
+   edge[r * 2 + 0] = src[r * pitch + 0];
+   edge[r * 2 + 1] = src[r * pitch + 1];
   }
+
+  LWBuffer[y] = src_lw;
  }
 }
 
-void Deinterlacer::Process(MDFN_Surface *surface, MDFN_Rect &DisplayRect, int32 *LineWidths, const bool field)
+void Deinterlacer::Begin(MDFN_Surface *surface, MDFN_Rect &DisplayRect, int32 *LineWidths, const bool field, const unsigned upscale_shift)
 {
- const MDFN_Rect DisplayRect_Original = DisplayRect;
+ const unsigned field_lines = DisplayRect.h / 2;
 
- if(DeintType == DEINT_WEAVE)
- {
-  if(!FieldBuffer || FieldBuffer->w < surface->w || FieldBuffer->h < (surface->h / 2))
-  {
-   if(FieldBuffer)
-    delete FieldBuffer;
+ //
+ // We need to output with LineWidths as always being valid to handle the case of horizontal resolution change between fields
+ // while in interlace mode, so clear the first LineWidths entry if it's == ~0, and
+ // [...]
+ LineWidthsInValid = (LineWidths[0] != ~0);
 
-   FieldBuffer = new MDFN_Surface(NULL, surface->w, surface->h / 2, surface->w, surface->format);
-   LWBuffer.resize(FieldBuffer->h);
-  }
-  else if(memcmp(&surface->format, &FieldBuffer->format, sizeof(MDFN_PixelFormat)))
-  {
-   FieldBuffer->SetFormat(surface->format, StateValid && PrevDRect.h == DisplayRect.h);
-  }
+ Surface = surface;
+ DRect = &DisplayRect;
+ DRectOriginal = DisplayRect;
+ LW = LineWidths;
+ Field = field;
+ UpscaleShift = upscale_shift;
+
+ // The rows of the other field have to hold the previous field
+ WeaveGood = (StateValid && PrevDRect.h == DisplayRect.h && PrevField != field && PrevUpscaleShift == upscale_shift && DeintType != DEINT_BOB_OFFSET);
+
+ if(LWBuffer.size() < field_lines)
+  LWBuffer.resize(field_lines);
+
+ if(EdgeBuffer.size() < (field_lines << upscale_shift) * 2)
+  EdgeBuffer.resize((field_lines << upscale_shift) * 2);
+
+ if(surface->h && !LineWidthsInValid)
+ {
+  LineWidths[0] = 0;
  }
+}
 
-#if defined(WANT_32BPP)
- InternalProcess<uint32>(surface, DisplayRect, LineWidths, field);
-#elif defined(WANT_16BPP)
- InternalProcess<uint16>(surface, DisplayRect, LineWidths, field);
-#endif
+void Deinterlacer::ProcessPart(unsigned part, unsigned count)
+{
+ const unsigned field_lines = DRect->h / 2;
+
+ InternalProcess<MDFN_Pixel>(field_lines * part / count, field_lines * (part + 1) / count);
+}
 
- PrevDRect = DisplayRect_Original;
+void Deinterlacer::End(void)
+{
+ PrevDRect = DRectOriginal;
+ PrevField = Field;
+ PrevUpscaleShift = UpscaleShift;
+ StateValid = true;
+}
+
+void Deinterlacer::Process(MDFN_Surface *surface, MDFN_Rect &DisplayRect, int32 *LineWidths, const bool field, const unsigned upscale_shift)
+{
+ Begin(surface, DisplayRect, LineWidths, field, upscale_shift);
+ ProcessPart(0, 1);
+ End();
 }
 
 void Deinterlacer::ClearState(void)
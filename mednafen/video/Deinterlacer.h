@@ -32,6 +32,7 @@ class Deinterlacer
   DEINT_BOB_OFFSET = 0,	// Code will fall-through to this case under certain conditions, too.
   DEINT_BOB,
   DEINT_WEAVE,
+  DEINT_BLEND,		// Weave where the picture is still, interpolate where it moves
  };
 
  void SetType(unsigned t);
@@ -40,20 +41,43 @@ class Deinterlacer
   return(DeintType);
  }
 
- void Process(MDFN_Surface *surface, MDFN_Rect &DisplayRect, int32 *LineWidths, const bool field);
+ // Works in place on a surface upscaled by (1 << upscale_shift), which
+ // must hold the other field as it was left by the previous call.
+ void Process(MDFN_Surface *surface, MDFN_Rect &DisplayRect, int32 *LineWidths, const bool field, const unsigned upscale_shift);
+
+ // Process() split up so that the lines can be shared between threads:
+ // ProcessPart() handles the part-th of count groups of lines, all of them
+ // have to be processed between Begin() and End().
+ void Begin(MDFN_Surface *surface, MDFN_Rect &DisplayRect, int32 *LineWidths, const bool field, const unsigned upscale_shift);
+ void ProcessPart(unsigned part, unsigned count);
+ void End(void);
 
  void ClearState(void);
 
  private:
 
  template<typename T>
- void InternalProcess(MDFN_Surface *surface, MDFN_Rect &DisplayRect, int32 *LineWidths, const bool field);
+ void InternalProcess(unsigned first, unsigned last);
 
- MDFN_Surface *FieldBuffer;
+ // Pixels 0 and 1 of the rows of the last field, the GPU clears them in
+ // the rows it doesn't scan out
+ std::vector<MDFN_Pixel> EdgeBuffer;
  std::vector<int32> LWBuffer;
  bool StateValid;
  MDFN_Rect PrevDRect;
+ bool PrevField;
+ unsigned PrevUpscaleShift;
  unsigned DeintType;
+
+ // Frame being processed
+ MDFN_Surface *Surface;
+ MDFN_Rect *DRect;
+ MDFN_Rect DRectOriginal;
+ int32 *LW;
+ bool Field;
+ unsigned UpscaleShift;
+ bool LineWidthsInValid;
+ bool WeaveGood;
 };
 
 #endif
@@ -17,6 +17,7 @@
 
 #include "../mednafen.h"
 #include "surface.h"
+#include "../largemem.h"
 
 MDFN_PixelFormat::MDFN_PixelFormat()
 {
@@ -45,6 +46,7 @@ MDFN_Surface::MDFN_Surface()
    format = MDFN_PixelFormat();
 
    pixels = NULL;
+   pixels_size = 0;
    pitchinpix = 0;
    w = 0;
    h = 0;
@@ -63,8 +65,11 @@ bool MDFN_Surface::Init(void *const p_pixels, const uint32 p_width, const uint32
    format = nf;
 
    pixels = NULL;
+   pixels_size = (size_t)p_pitchinpix * p_height * (nf.bpp / 8);
 
-   rpix = calloc(1, p_pitchinpix * p_height * (nf.bpp / 8));
+   // Upscaled surfaces are large and mostly unused at lower resolutions,
+   // their pages are only committed once drawn to.
+   rpix = MDFN_LargeAlloc(pixels_size, false);
    if(!rpix)
       return false;
 
@@ -89,6 +94,6 @@ void MDFN_Surface::SetFormat(const MDFN_PixelFormat &nf, bool convert)
 MDFN_Surface::~MDFN_Surface()
 {
    if(pixels)
-      free(pixels);
+      MDFN_LargeFree(pixels, pixels_size);
 }
 
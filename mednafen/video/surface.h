@@ -5,7 +5,16 @@
 #define GREEN_SHIFT 8
 #define BLUE_SHIFT 0
 #define ALPHA_SHIFT 24
+
+/* Builds with NEED_BPP=16 output RGB565 surfaces, the components given
+ * to MAKECOLOR() and returned by DecodeColor() are still 8 bits. */
+#if defined(WANT_16BPP)
+typedef uint16 MDFN_Pixel;
+#define MAKECOLOR(r, g, b, a) ((((r) & 0xF8) << 8) | (((g) & 0xFC) << 3) | (((b) & 0xF8) >> 3))
+#else
+typedef uint32 MDFN_Pixel;
 #define MAKECOLOR(r, g, b, a) ((r << RED_SHIFT) | (g << GREEN_SHIFT) | (b << BLUE_SHIFT) | (a << ALPHA_SHIFT))
+#endif
 
 struct MDFN_PaletteEntry
 {
@@ -56,13 +65,20 @@ class MDFN_PixelFormat
 
  uint8 Ashift;  // [...] alpha component.
 
- // Gets the R/G/B/A values for the passed 32-bit surface pixel value
+ // Gets the R/G/B/A values for the passed surface pixel value
  INLINE void DecodeColor(uint32 value, int &r, int &g, int &b, int &a) const
  {
+#if defined(WANT_16BPP)
+    r = (value >> 8) & 0xF8;
+    g = (value >> 3) & 0xFC;
+    b = (value << 3) & 0xF8;
+    a = 0;
+#else
     r = (value >> RED_SHIFT) & 0xFF;
     g = (value >> GREEN_SHIFT) & 0xFF;
     b = (value >> BLUE_SHIFT) & 0xFF;
     a = (value >> ALPHA_SHIFT) & 0xFF;
+#endif
  }
 
 }; // MDFN_PixelFormat;
@@ -96,22 +112,36 @@ class MDFN_Surface //typedef struct
 
  void SetFormat(const MDFN_PixelFormat &new_format, bool convert);
 
- // Gets the R/G/B/A values for the passed 32-bit surface pixel value
+ // Gets the R/G/B/A values for the passed surface pixel value
  INLINE void DecodeColor(uint32 value, int &r, int &g, int &b, int &a) const
  {
+#if defined(WANT_16BPP)
+    r = (value >> 8) & 0xF8;
+    g = (value >> 3) & 0xFC;
+    b = (value << 3) & 0xF8;
+    a = 0;
+#else
     r = (value >> RED_SHIFT) & 0xFF;
     g = (value >> GREEN_SHIFT) & 0xFF;
     b = (value >> BLUE_SHIFT) & 0xFF;
     a = (value >> ALPHA_SHIFT) & 0xFF;
+#endif
  }
 
  INLINE void DecodeColor(uint32 value, int &r, int &g, int &b) const
  {
+#if defined(WANT_16BPP)
+    r = (value >> 8) & 0xF8;
+    g = (value >> 3) & 0xFC;
+    b = (value << 3) & 0xF8;
+#else
     r = (value >> RED_SHIFT) & 0xFF;
     g = (value >> GREEN_SHIFT) & 0xFF;
     b = (value >> BLUE_SHIFT) & 0xFF;
+#endif
  }
  private:
+ size_t pixels_size;
  bool Init(void *const p_pixels, const uint32 p_width, const uint32 p_height, const uint32 p_pitchinpix, const MDFN_PixelFormat &nf);
 };
 
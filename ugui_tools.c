@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <stdint.h>
 #include <string/stdstring.h>
 #include <ugui.h>
 #include <stdio.h>
@@ -8,16 +9,17 @@ static UG_GUI gui;
 static UG_WINDOW gui_window;
 static UG_TEXTBOX gui_textbox;
 static UG_OBJECT gui_objbuf_wnd[UGUI_MAX_OBJECTS];
-static unsigned *frame_buf = NULL;
+static void *frame_buf = NULL;
 static int width = 0;
 static int height = 0;
+static int frame_bpp = 0;
 static char gui_message[4096] = {0};
 
 static void gui_window_callback(UG_MESSAGE *msg)
 {
 }
 
-unsigned* gui_get_framebuffer(void)
+void* gui_get_framebuffer(void)
 {
    return frame_buf;
 }
@@ -25,14 +27,20 @@ unsigned* gui_get_framebuffer(void)
 /* uGUI callback that draws raw pixels onto our frame buffer */
 static void UserPixelSetFunction(UG_S16 x, UG_S16 y, UG_COLOR c)
 {
-   frame_buf[width * y + x] = c;
+   /* uGUI colors are RGB888, packed to RGB565 for 2 bytes per pixel */
+   if (frame_bpp == 2)
+      ((uint16_t*)frame_buf)[width * y + x] = ((c >> 8) & 0xF800) |
+         ((c >> 5) & 0x07E0) | ((c >> 3) & 0x001F);
+   else
+      ((unsigned*)frame_buf)[width * y + x] = c;
 }
 
 void gui_init(int w, int h, int bpp)
 {
    width = w;
    height = h;
-   frame_buf = (unsigned*)calloc(width * height, bpp);
+   frame_bpp = bpp;
+   frame_buf = calloc(width * height, bpp);
 
    /* init uGUI */
    UG_Init(&gui, UserPixelSetFunction, width, height);